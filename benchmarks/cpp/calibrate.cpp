@@ -0,0 +1,25 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 4) {
+      std::cerr << "Usage: calibrate <grammar> <worker_num> <sample>..." << std::endl;
+      return 1;
+    }
+    const char *grammar_path = argv[1];
+    int worker_num = std::atoi(argv[2]);
+    std::vector<std::string> samples(argv + 3, argv + argc);
+
+    Context<char> context{grammar_path};
+
+    size_t threshold = context.calibrate_inline_threshold(samples, worker_num);
+
+    std::cout << "inline threshold: " << threshold << std::endl;
+    return 0;
+}
@@ -58,7 +58,7 @@ int main(int argc, const char *argv[])
   bool size = argc >= 3 && argv[2] == std::string("size");
   bool debug = argc >= 3 && argv[2] == std::string("debug");
 
-  const char *input_path = "../../datasets/citylots.json";
+  const char *input_path = argc >= 4 ? argv[3] : "../../datasets/citylots.json";
   const char *grammar_path = "../../grammars/citylots.cgr";
 
   Context<char> context{grammar_path};
@@ -79,7 +79,10 @@ int main(int argc, const char *argv[])
 
   auto end = high_resolution_clock::now();;
 
-  std::cout << worker_num << " " << duration_cast<milliseconds>(end - start).count() << std::endl;
+  auto elapsed = duration_cast<milliseconds>(end - start).count();
+  double throughput = elapsed > 0 ? context.get_input_size() / 1e3 / elapsed : 0.0;
+
+  std::cout << worker_num << " " << elapsed << " " << throughput << std::endl;
 
   if (size) {
     std::cout << result.size() << std::endl;
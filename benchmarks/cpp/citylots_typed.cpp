@@ -0,0 +1,359 @@
+#include <list>
+#include <unordered_map>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+
+enum class JSONType
+{
+    None,
+    Number,
+    String,
+    Boolean,
+    List,
+    Object
+};
+
+class JSONValue;
+
+using JSONString = std::string;
+using JSONList = std::list<JSONValue>;
+using JSONObject = std::unordered_map<std::string, JSONValue>;
+
+class JSONValue
+{
+    friend std::ostream& operator<<(std::ostream& os, const JSONValue& v);
+
+    JSONType type;
+    union
+    {
+        bool bvalue;
+        double dvalue;
+        JSONString *svalue;
+        JSONList *lvalue;
+        JSONObject *ovalue;
+    };
+public:
+    JSONValue(JSONValue&& old)
+        : type(old.type)
+    {
+        switch (type)
+        {
+        case JSONType::Boolean: bvalue = old.bvalue; break;
+        case JSONType::Number: dvalue = old.dvalue; break;
+        case JSONType::String: svalue = old.svalue; old.svalue = nullptr; break;
+        case JSONType::List: lvalue = old.lvalue; old.lvalue = nullptr; break;
+        case JSONType::Object: ovalue = old.ovalue; old.ovalue = nullptr; break;
+        }
+    }
+    JSONValue(const JSONValue& old)
+        : type(old.type)
+    {
+        switch (type)
+        {
+        case JSONType::Boolean: bvalue = old.bvalue; break;
+        case JSONType::Number: dvalue = old.dvalue; break;
+        case JSONType::String: svalue = new JSONString(*old.svalue); break;
+        case JSONType::List: lvalue = new JSONList(*old.lvalue); break;
+        case JSONType::Object: ovalue = new JSONObject(*old.ovalue); break;
+        }
+    }
+    JSONValue& operator=(JSONValue&& old)
+    {
+        type = old.type;
+        switch (type)
+        {
+        case JSONType::Boolean: bvalue = old.bvalue; break;
+        case JSONType::Number: dvalue = old.dvalue; break;
+        case JSONType::String: svalue = old.svalue; old.svalue = nullptr; break;
+        case JSONType::List: lvalue = old.lvalue; old.lvalue = nullptr; break;
+        case JSONType::Object: ovalue = old.ovalue; old.ovalue = nullptr;break;
+        }
+    }
+    JSONValue& operator=(const JSONValue& old)
+    {
+        type = old.type;
+        switch (type)
+        {
+        case JSONType::Boolean: bvalue = old.bvalue; break;
+        case JSONType::Number: dvalue = old.dvalue; break;
+        case JSONType::String: svalue = new JSONString(*old.svalue); break;
+        case JSONType::List: lvalue = new JSONList(*old.lvalue); break;
+        case JSONType::Object: ovalue = new JSONObject(*old.ovalue); break;
+        }
+    }
+    JSONValue(bool b) : type(JSONType::Boolean), bvalue(b) {}
+    JSONValue(double d) : type(JSONType::Number), dvalue(d) {}
+    JSONValue() : type(JSONType::None) {}
+    JSONValue(JSONString&& s) : type(JSONType::String), svalue(new JSONString(s)) {}
+    JSONValue(JSONString *s) : type(JSONType::String), svalue(s) {}
+    JSONValue(JSONList *l) : type(JSONType::List), lvalue(l) {}
+    JSONValue(JSONObject *o) : type(JSONType::Object), ovalue(o) {}
+    ~JSONValue()
+    {
+        switch (type)
+        {
+        case JSONType::String:
+            if (svalue != nullptr) delete svalue; break;
+        case JSONType::List:
+            if (lvalue != nullptr) delete lvalue; break;
+        case JSONType::Object:
+            if (ovalue != nullptr) delete ovalue; break;
+        }
+    }
+    const JSONString& str() const
+    {
+        assert(type == JSONType::String);
+        return *svalue;
+    }
+    double num() const
+    {
+        assert(type == JSONType::Number);
+        return dvalue;
+    }
+    operator bool() const
+    {
+        assert(type == JSONType::Boolean);
+        return bvalue;
+    }
+    const JSONObject& object() const
+    {
+        return *ovalue;
+    }
+    bool is_object() const
+    {
+        return type == JSONType::Object;
+    }
+    bool is_str() const
+    {
+        return type == JSONType::String;
+    }
+    const JSONValue& operator[](const std::string& key) const
+    {
+        assert(is_object());
+        return ovalue->at(key);
+    }
+    bool has_item(const std::string& key) const
+    {
+        assert(is_object());
+        return ovalue->count(key) > 0;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const JSONValue& v)
+{
+    switch (v.type)
+    {
+    case JSONType::None:
+        os << "None";
+        break;
+    case JSONType::Number:
+        os << "Number " << v.dvalue;
+        break;
+    case JSONType::String:
+        os << "String " << v.svalue;
+        break;
+    case JSONType::Boolean:
+        os << "Boolean " << v.bvalue;
+        break;
+    case JSONType::List:
+        os << "List" << std::endl;
+        break;
+    case JSONType::Object:
+        os << "Object" << std::endl;
+        break;
+    }
+    return os;
+}
+
+/*!
+ * Semantic value passed between the actions. Numbers and booleans are stored
+ * inline; strings and containers are owned by the value until they are moved
+ * into their parent.
+ */
+struct JSONRef
+{
+    JSONType type;
+    union
+    {
+        bool bvalue;
+        double dvalue;
+        JSONString *svalue;
+        JSONList *lvalue;
+        JSONObject *ovalue;
+        std::pair<JSONString, JSONValue> *entry;
+    };
+};
+
+static JSONRef make_ref(JSONType type)
+{
+    JSONRef r;
+    r.type = type;
+    r.svalue = nullptr;
+    return r;
+}
+
+static JSONValue adopt(const JSONRef& r)
+{
+    switch (r.type)
+    {
+    case JSONType::Number: return JSONValue(r.dvalue);
+    case JSONType::Boolean: return JSONValue(r.bvalue);
+    case JSONType::String: return JSONValue(r.svalue);
+    case JSONType::List: return JSONValue(r.lvalue);
+    case JSONType::Object: return JSONValue(r.ovalue);
+    default: return JSONValue();
+    }
+}
+
+void parseNumbers(const SymbolBatch<char, JSONRef>& batch, JSONRef *results)
+{
+    for (int i = 0; i < batch.size(); i++)
+    {
+        TextView<char> text = batch.view(i).trim();
+        results[i] = make_ref(JSONType::Number);
+        if (decode_double(text.begin(), text.end(), results[i].dvalue) != text.end())
+            results[i].dvalue = 0.0;
+    }
+}
+
+JSONRef parseString(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONRef r = make_ref(JSONType::String);
+    r.svalue = new std::string();
+    ctx.unescape_json(*r.svalue);
+    return r;
+}
+
+JSONRef parseNull(const SymbolContext<char, JSONRef>& ctx)
+{
+    return make_ref(JSONType::None);
+}
+
+JSONRef parseTrue(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONRef r = make_ref(JSONType::Boolean);
+    r.bvalue = true;
+    return r;
+}
+
+JSONRef parseFalse(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONRef r = make_ref(JSONType::Boolean);
+    r.bvalue = false;
+    return r;
+}
+
+JSONRef parseList(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONRef r = make_ref(JSONType::List);
+    r.lvalue = new JSONList();
+    for (int i = 1; i <= ctx.count(); i++)
+    {
+        r.lvalue->emplace_back(adopt(ctx.value(i)));
+    }
+    return r;
+}
+
+JSONRef parseDictionary(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONRef r = make_ref(JSONType::Object);
+    r.ovalue = new JSONObject();
+    for (int i = 1; i <= ctx.count(); i++)
+    {
+        std::pair<JSONString, JSONValue> *p = ctx.value(i).entry;
+        r.ovalue->emplace(p->first, std::move(p->second));
+    }
+    return r;
+}
+
+JSONRef parseDictionaryEntry(const SymbolContext<char, JSONRef>& ctx)
+{
+    JSONString *s = ctx.value(1).svalue;
+    JSONRef r = make_ref(JSONType::None);
+    //Entries only live until their object is built, so they go to the arena
+    r.entry = ctx.alloc<std::pair<JSONString, JSONValue> >(std::move(*s), adopt(ctx.value(2)));
+    delete s;
+    return r;
+}
+
+std::atomic<int> count;
+
+JSONRef parseObject(const SymbolContext<char, JSONRef>& ctx)
+{
+    const JSONRef& v = ctx.value(1);
+
+    if (v.type == JSONType::Object && v.ovalue->count("type") > 0)
+    {
+        const JSONObject& o = *v.ovalue;
+        if (o.at("type").str() == "Feature")
+        {
+            if (o.count("properties") > 0)
+            {
+                const JSONValue& properties = o.at("properties");
+
+                if (properties.has_item("STREET"))
+                {
+                    const JSONValue& street = properties.operator[]("STREET");
+                    if (street.is_str())
+                    {
+                        if (street.str() != "JEFFERSON")
+                        {
+                            adopt(v);
+                            return make_ref(JSONType::None);
+                        }
+                        else
+                        {
+                            // count++;
+                        }
+                    }
+                    else
+                    {
+                        // count++;
+                    }
+                }
+            }
+        }
+    }
+    return v;
+}
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 1) return 1;
+    int worker_num = std::atoi(argv[1]);
+    bool no_action = argc >= 3 && argv[2] == std::string("dry");
+
+    const char *input_path = "../../datasets/citylots.json";
+    const char *grammar_path = "../../grammars/json.cgr";
+
+    Context<char, JSONRef> context{grammar_path};
+
+    if (!no_action) {
+      context.attach(L"Null", parseNull);
+      context.attach(L"String", parseString);
+      context.attach(L"Dict", parseDictionary);
+      context.attach(L"List", parseList);
+      context.attach(L"DictEntry", parseDictionaryEntry);
+      context.attach_batch(L"Number", parseNumbers);
+      context.attach(L"True", parseTrue);
+      context.attach(L"False", parseFalse);
+      context.attach(L"Object", parseObject);
+    }
+
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();;
+
+    context.parse(input_path, worker_num);
+
+    auto end = high_resolution_clock::now();;
+
+    std::cout << worker_num << " " << duration_cast<milliseconds>(end - start).count() << std::endl;
+
+    return 0;
+}
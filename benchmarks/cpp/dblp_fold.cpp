@@ -0,0 +1,122 @@
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Context.hpp"
+#include "pugixml.hpp"
+
+using namespace Centaurus;
+
+int placeholder;
+
+void *parseDocument(const SymbolContext<char>& ctx)
+{
+  return ctx.value<int>(1);
+}
+
+using ArticleList = std::vector<std::vector<std::string>*>;
+
+static ArticleList result;
+
+//The articles are folded into lists by the workers instead of piling up under DblpRoot
+void *initArticles()
+{
+  return new ArticleList();
+}
+
+void addArticle(void *&acc, void *article)
+{
+  //Articles are deferred, so the ones without a value arrive as null
+  if (article != nullptr)
+    static_cast<ArticleList*>(acc)->push_back(static_cast<std::vector<std::string>*>(article));
+}
+
+void mergeArticles(void *&acc, void *partial)
+{
+  std::unique_ptr<ArticleList> rest(static_cast<ArticleList*>(partial));
+  auto list = static_cast<ArticleList*>(acc);
+  list->insert(list->end(), rest->begin(), rest->end());
+}
+
+void *parseDblpRoot(const SymbolContext<char>& ctx)
+{
+  std::unique_ptr<ArticleList> articles(ctx.value<ArticleList>(1));
+  result = std::move(*articles);
+  return &result;
+}
+
+void *parseArticle(const SymbolContext<char>& ctx)
+{
+  if (ctx.count() > 0) {
+    auto ret = ctx.alloc<std::vector<std::string>>();
+    pugi::xml_document doc;
+    doc.load_buffer(ctx.start(), ctx.end() -  ctx.start());
+    pugi::xpath_node_set authors = doc.select_nodes("/article/author/text()");
+    for (auto& node : authors) {
+      ret->emplace_back(node.node().value());
+    }
+    return ret;
+  } else {
+    return nullptr;
+  }
+}
+
+void *parseYearInfo(const SymbolContext<char>& ctx)
+{
+  return (ctx.count() > 0) ? &placeholder : nullptr;
+}
+
+void *parseTargetYearInfo(const SymbolContext<char>& ctx)
+{
+  return &placeholder;
+}
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 2) return 1;
+    int worker_num = std::atoi(argv[1]);
+    bool no_action = argc >= 3 && argv[2] == std::string("dry");
+    bool size = argc >= 3 && argv[2] == std::string("size");
+    bool debug = argc >= 3 && argv[2] == std::string("debug");
+
+    const char *input_path = argc >= 4 ? argv[3] : "../../datasets/dblp.xml";
+    const char *grammar_path = "../../grammars/dblp.cgr";
+
+    Context<char> context{grammar_path};
+
+    if (!no_action) {
+      context.attach(L"Document", parseDocument);
+      context.attach(L"DblpRoot", parseDblpRoot);
+      context.attach_fold(L"DblpRoot", CppFold<char>{initArticles, addArticle, mergeArticles});
+      //The XPath queries run on a pool of their own instead of holding up the banks
+      context.attach_deferred(L"Article", parseArticle);
+      context.attach(L"YearInfo", parseYearInfo);
+      context.attach(L"TargetYearInfo", parseTargetYearInfo);
+    }
+
+    using namespace std::chrono;
+
+    auto start = high_resolution_clock::now();;
+
+    context.parse(input_path, worker_num);
+
+    auto end = high_resolution_clock::now();;
+
+    auto elapsed = duration_cast<milliseconds>(end - start).count();
+    double throughput = elapsed > 0 ? context.get_input_size() / 1e3 / elapsed : 0.0;
+
+    std::cout << worker_num << " " << elapsed << " " << throughput << std::endl;
+
+    if (size) {
+      std::cout << result.size() << std::endl;
+    }
+    if (debug) {
+      for (auto vec_ptr : result) {
+        for (auto& author : *vec_ptr) {
+          std::cout << author << std::endl;
+        }
+        std::cout << std::endl;
+      }
+    }
+    return 0;
+}
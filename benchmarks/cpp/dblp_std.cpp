@@ -187,9 +187,10 @@ void *parseContent(const SymbolContext<char>& ctx)
     {
         if (!isspace(i)) break;
     }
+    std::string *content = new std::string();
     if (i != len)
-        return new std::string(s, len);
-    return new std::string();
+        ctx.decode_xml(*content);
+    return content;
 }
 
 void *parseAttribute(const SymbolContext<char>& ctx)
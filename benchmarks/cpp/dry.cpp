@@ -10,6 +10,8 @@ int main(int argc, const char *argv[])
     const char *grammar_path = argv[1];
     const char *input_path = argv[2];
     const bool result_captured = argc > 3 && argv[3] == std::string("debug");
+    //"dump <path>" saves the markers for Context::replay()
+    const char *dump_path = argc > 4 && argv[3] == std::string("dump") ? argv[4] : nullptr;
 
     Centaurus::Grammar<char> grammar;
     Centaurus::ParserEM64T<char> parser;
@@ -23,11 +25,20 @@ int main(int argc, const char *argv[])
     auto start = high_resolution_clock::now();;
 
     Centaurus::Stage1Runner runner{input_path, &parser, 8 * 1024 * 1024,  worker_num * 2, true, result_captured};
+    Centaurus::CSTDump dump(grammar.get_hash());
+    if (dump_path != nullptr)
+      runner.set_dump(&dump);
     runner.start();
     runner.wait();
 
     auto end = high_resolution_clock::now();;
 
+    if (dump_path != nullptr) {
+      const char *end = static_cast<const char *>(runner.get_result());
+      dump.finish(runner.get_input_size(), end != nullptr ? end - static_cast<const char *>(runner.get_input()) : Centaurus::detail::CST_DUMP_REJECTED);
+      dump.write(dump_path);
+    }
+
     if (result_captured) {
       for (auto& chunk : runner.result_chunks()) {
         for (auto& m : chunk) {
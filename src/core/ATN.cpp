@@ -3,19 +3,64 @@
 namespace Centaurus
 {
 template<typename TCHAR>
-void ATNNode<TCHAR>::parse_literal(Stream& stream)
+std::basic_string<TCHAR> ATNNode<TCHAR>::read_literal(Stream& stream)
 {
+    std::basic_string<TCHAR> literal;
+
     wchar_t leader = stream.get();
 
     wchar_t ch = stream.get();
 
     for (; ch != L'\0' && ch != leader; ch = stream.get())
     {
-        m_literal.push_back(wide_to_target<TCHAR>(ch));
+        literal.push_back(wide_to_target<TCHAR>(ch));
     }
 
     if (leader != ch)
         throw stream.unexpected(ch);
+
+    return literal;
+}
+
+template<typename TCHAR>
+void ATNNode<TCHAR>::parse_literal(Stream& stream)
+{
+    m_literal = read_literal(stream);
+}
+
+template<typename TCHAR>
+void ATNNode<TCHAR>::parse_opaque(Stream& stream)
+{
+    //%('brackets' 'quote escape') marks the following nonterminal as opaque
+    wchar_t ch = stream.skip_whitespace();
+    if (ch != L'(')
+        throw stream.unexpected(ch);
+    stream.discard();
+
+    ch = stream.skip_whitespace();
+    if (ch != L'\'' && ch != L'"')
+        throw stream.unexpected(ch);
+    m_opaque.brackets = read_literal(stream);
+    if (m_opaque.brackets.empty() || m_opaque.brackets.size() % 2 != 0 || m_opaque.brackets.size() > OpaqueSyntax<TCHAR>::MAX_BRACKETS)
+        throw stream.unexpected(ch);
+
+    ch = stream.skip_whitespace();
+    if (ch == L'\'' || ch == L'"')
+    {
+        std::basic_string<TCHAR> quote = read_literal(stream);
+        if (quote.empty() || quote.size() > 2)
+            throw stream.unexpected(ch);
+        m_opaque.quote = quote[0];
+        m_opaque.escape = (quote.size() == 2) ? quote[1] : 0;
+        ch = stream.skip_whitespace();
+    }
+    if (ch != L')')
+        throw stream.unexpected(ch);
+    stream.discard();
+
+    ch = stream.skip_whitespace();
+    if (!Identifier::is_symbol_leader(ch))
+        throw stream.unexpected(ch);
 }
 
 template<typename TCHAR>
@@ -23,6 +68,21 @@ void ATNNode<TCHAR>::parse(Stream& stream)
 {
     wchar_t ch = stream.peek();
 
+    if (ch == L'@')
+    {
+        stream.discard();
+        ch = stream.peek();
+        if (ch != L'/' && ch != L'\'' && ch != L'"')
+            throw stream.unexpected(ch);
+        m_captured = true;
+    }
+    else if (ch == L'%')
+    {
+        stream.discard();
+        parse_opaque(stream);
+        ch = stream.peek();
+    }
+
     if (Identifier::is_symbol_leader(ch))
     {
         m_invoke.parse(stream);
@@ -7,6 +7,7 @@
 #include "Identifier.hpp"
 #include "Stream.hpp"
 #include "CharClass.hpp"
+#include "Opaque.hpp"
 
 namespace Centaurus
 {
@@ -88,32 +89,37 @@ template<typename TCHAR> class ATNNode
     NFA<TCHAR> m_nfa;
     std::basic_string<TCHAR> m_literal;
     int m_localid;
+    bool m_captured;
+    OpaqueSyntax<TCHAR> m_opaque;
 private:
+    static std::basic_string<TCHAR> read_literal(Stream& stream);
     void parse_literal(Stream& stream);
+    void parse_opaque(Stream& stream);
     void parse(Stream& stream);
 public:
     ATNNode()
-        : m_type(ATNNodeType::Blank), m_localid(-1)
+        : m_type(ATNNodeType::Blank), m_localid(-1), m_captured(false)
     {
     }
     ATNNode(ATNNodeType type)
-        : m_type(type), m_localid(-1)
+        : m_type(type), m_localid(-1), m_captured(false)
     {
     }
     ATNNode(Stream& stream)
+        : m_localid(-1), m_captured(false)
     {
         parse(stream);
     }
     ATNNode(ATNNode<TCHAR>&& old)
-        : m_transitions(std::move(old.m_transitions)), m_type(old.m_type), m_invoke(std::move(old.m_invoke)), m_nfa(std::move(old.m_nfa)), m_literal(std::move(old.m_literal)), m_localid(old.m_localid)
+        : m_transitions(std::move(old.m_transitions)), m_type(old.m_type), m_invoke(std::move(old.m_invoke)), m_nfa(std::move(old.m_nfa)), m_literal(std::move(old.m_literal)), m_localid(old.m_localid), m_captured(old.m_captured), m_opaque(old.m_opaque)
     {
     }
     ATNNode(const ATNNode<TCHAR>& old)
-        : m_transitions(old.m_transitions), m_type(old.m_type), m_invoke(old.m_invoke), m_nfa(old.m_nfa), m_literal(old.m_literal), m_localid(old.m_localid)
+        : m_transitions(old.m_transitions), m_type(old.m_type), m_invoke(old.m_invoke), m_nfa(old.m_nfa), m_literal(old.m_literal), m_localid(old.m_localid), m_captured(old.m_captured), m_opaque(old.m_opaque)
     {
     }
     ATNNode(const ATNNode<TCHAR>& old, std::vector<ATNTransition<TCHAR> >&& transitions)
-        : m_transitions(transitions), m_type(old.m_type), m_invoke(old.m_invoke), m_nfa(old.m_nfa), m_literal(old.m_literal), m_localid(old.m_localid)
+        : m_transitions(transitions), m_type(old.m_type), m_invoke(old.m_invoke), m_nfa(old.m_nfa), m_literal(old.m_literal), m_localid(old.m_localid), m_captured(old.m_captured), m_opaque(old.m_opaque)
     {
     }
 	ATNNode<TCHAR> offset(int off) const
@@ -237,6 +243,24 @@ public:
 	{
 		return m_localid;
 	}
+    /*!
+     * @brief True for a terminal marked with @, whose span is passed to the actions
+     */
+    bool is_captured() const
+    {
+        return m_captured;
+    }
+    /*!
+     * @brief True for a nonterminal marked with %, which the parser skips as a single leaf
+     */
+    bool is_opaque() const
+    {
+        return !m_opaque.empty();
+    }
+    const OpaqueSyntax<TCHAR>& get_opaque() const
+    {
+        return m_opaque;
+    }
 };
 
 template<typename TCHAR> class ATNMachine
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace Centaurus
+{
+/*!
+ * @brief Result of a parse collected in one shard per reduction worker
+ *
+ * Actions add to the shard of the worker they run on, given by
+ * SymbolContext::worker(), so the hot path takes no lock and touches no
+ * cache line shared with another worker. The shards are combined when the
+ * result is read, which must happen after the parse has returned. Register
+ * an aggregator with Context::attach_aggregator() so that it has a shard for
+ * every worker; the shards keep accumulating over successive parses until
+ * clear() is called.
+ */
+class Aggregator
+{
+public:
+    Aggregator() {}
+    virtual ~Aggregator() {}
+    /*!
+     * @brief Makes room for workers shards; called by the Context before each parse
+     */
+    virtual void reserve(int workers) = 0;
+    virtual void clear() = 0;
+};
+namespace detail
+{
+/*!
+ * @brief Per-worker copies of T, kept on separate cache lines
+ */
+template<typename T>
+class Shards
+{
+    struct Slot
+    {
+        T value;
+        //Keeps the values of neighbouring workers off each other's cache line
+        char padding[64];
+        explicit Slot(const T& init) : value(init) {}
+    };
+    std::vector<Slot> m_slots;
+    T m_init;
+public:
+    explicit Shards(const T& init = T()) : m_init(init)
+    {
+    }
+    void reserve(int workers)
+    {
+        while (static_cast<int>(m_slots.size()) < workers)
+            m_slots.emplace_back(m_init);
+    }
+    void clear()
+    {
+        for (auto& slot : m_slots)
+            slot.value = m_init;
+    }
+    T& operator[](int worker)
+    {
+        return m_slots[worker].value;
+    }
+    template<typename Fn>
+    void for_each(Fn fn) const
+    {
+        for (const auto& slot : m_slots)
+            fn(slot.value);
+    }
+};
+}
+/*!
+ * @brief Sums values of T added by the workers
+ */
+template<typename T>
+class Sum : public Aggregator
+{
+    detail::Shards<T> m_shards;
+public:
+    Sum() : m_shards(T())
+    {
+    }
+    virtual void reserve(int workers) override
+    {
+        m_shards.reserve(workers);
+    }
+    virtual void clear() override
+    {
+        m_shards.clear();
+    }
+    void add(int worker, const T& value)
+    {
+        m_shards[worker] += value;
+    }
+    T total() const
+    {
+        T result = T();
+        m_shards.for_each([&](const T& value) { result += value; });
+        return result;
+    }
+};
+/*!
+ * @brief Counts events, typically the occurrences of a symbol
+ */
+class Counter : public Sum<uint64_t>
+{
+public:
+    void add(int worker, uint64_t count = 1)
+    {
+        Sum<uint64_t>::add(worker, count);
+    }
+};
+/*!
+ * @brief Keeps the extreme value added by the workers, as chosen by Compare
+ *
+ * value() returns the initial value if nothing has been added.
+ */
+template<typename T, typename Compare>
+class Extremum : public Aggregator
+{
+    detail::Shards<T> m_shards;
+    T m_init;
+    Compare m_compare;
+public:
+    explicit Extremum(const T& init) : m_shards(init), m_init(init)
+    {
+    }
+    virtual void reserve(int workers) override
+    {
+        m_shards.reserve(workers);
+    }
+    virtual void clear() override
+    {
+        m_shards.clear();
+    }
+    void add(int worker, const T& value)
+    {
+        T& shard = m_shards[worker];
+        if (m_compare(value, shard))
+            shard = value;
+    }
+    T value() const
+    {
+        T result = m_init;
+        m_shards.for_each([&](const T& value) { if (m_compare(value, result)) result = value; });
+        return result;
+    }
+};
+template<typename T>
+class Min : public Extremum<T, std::less<T> >
+{
+public:
+    Min() : Extremum<T, std::less<T> >(std::numeric_limits<T>::max())
+    {
+    }
+};
+template<typename T>
+class Max : public Extremum<T, std::greater<T> >
+{
+public:
+    Max() : Extremum<T, std::greater<T> >(std::numeric_limits<T>::lowest())
+    {
+    }
+};
+/*!
+ * @brief Combines the values added under equal keys with Combine
+ *
+ * Each worker fills a hash map of its own. merge() folds them into one,
+ * combining the values of a key in no particular order, so Combine must be
+ * commutative and associative.
+ */
+template<typename Key, typename T, typename Combine = std::plus<T>, typename Hash = std::hash<Key> >
+class GroupBy : public Aggregator
+{
+public:
+    typedef std::unordered_map<Key, T, Hash> map_type;
+private:
+    detail::Shards<map_type> m_shards;
+    Combine m_combine;
+public:
+    virtual void reserve(int workers) override
+    {
+        m_shards.reserve(workers);
+    }
+    virtual void clear() override
+    {
+        m_shards.clear();
+    }
+    void add(int worker, const Key& key, const T& value)
+    {
+        map_type& shard = m_shards[worker];
+        auto result = shard.emplace(key, value);
+        if (!result.second)
+            result.first->second = m_combine(result.first->second, value);
+    }
+    map_type merge() const
+    {
+        map_type result;
+        m_shards.for_each([&](const map_type& shard) {
+            for (const auto& p : shard)
+            {
+                auto it = result.emplace(p.first, p.second);
+                if (!it.second)
+                    it.first->second = m_combine(it.first->second, p.second);
+            }
+        });
+        return result;
+    }
+};
+/*!
+ * @brief Counts the occurrences of each key
+ */
+template<typename Key, typename Hash = std::hash<Key> >
+class Histogram : public GroupBy<Key, uint64_t, std::plus<uint64_t>, Hash>
+{
+    typedef GroupBy<Key, uint64_t, std::plus<uint64_t>, Hash> Base;
+public:
+    void add(int worker, const Key& key, uint64_t count = 1)
+    {
+        Base::add(worker, key, count);
+    }
+};
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Centaurus
+{
+/*!
+ * @brief Bump allocator whose memory is released all at once
+ *
+ * Objects are carved out of malloc'd chunks and never freed one by one. The
+ * destructors of objects that have one are recorded and run, newest first,
+ * when the arena is cleared. An arena is used by one thread at a time; its
+ * chunks can be handed to another arena with splice() without copying.
+ */
+class Arena
+{
+  struct Chunk
+  {
+    Chunk *next;
+  };
+  struct Finalizer
+  {
+    Finalizer *next;
+    void (*destroy)(void *object);
+    void *object;
+  };
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+  //Allocations larger than this get a chunk of their own
+  static constexpr size_t LARGE_SIZE = CHUNK_SIZE / 4;
+  static constexpr size_t HEADER_SIZE = (sizeof(Chunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+  //The first chunk is the one being bumped
+  Chunk *m_chunks, *m_last_chunk;
+  uintptr_t m_cursor, m_limit;
+  //Newest first
+  Finalizer *m_finalizers, *m_oldest_finalizer;
+
+  static Chunk *new_chunk(size_t size)
+  {
+    Chunk *chunk = static_cast<Chunk *>(std::malloc(HEADER_SIZE + size));
+    if (chunk == nullptr)
+      throw std::bad_alloc();
+    chunk->next = nullptr;
+    return chunk;
+  }
+  static uintptr_t chunk_data(Chunk *chunk)
+  {
+    return reinterpret_cast<uintptr_t>(chunk) + HEADER_SIZE;
+  }
+  static uintptr_t align_up(uintptr_t p, size_t align)
+  {
+    return (p + align - 1) & ~static_cast<uintptr_t>(align - 1);
+  }
+  template<typename T>
+  static void destroy(void *object)
+  {
+    static_cast<T *>(object)->~T();
+  }
+  void *allocate_slow(size_t size, size_t align)
+  {
+    if (size + align > LARGE_SIZE) {
+      Chunk *chunk = new_chunk(size + align);
+      if (m_chunks == nullptr) {
+        m_chunks = m_last_chunk = chunk;
+      } else {
+        //Keep bumping in the current chunk
+        chunk->next = m_chunks->next;
+        m_chunks->next = chunk;
+        if (m_last_chunk == m_chunks)
+          m_last_chunk = chunk;
+      }
+      return reinterpret_cast<void *>(align_up(chunk_data(chunk), align));
+    }
+    Chunk *chunk = new_chunk(CHUNK_SIZE);
+    chunk->next = m_chunks;
+    m_chunks = chunk;
+    if (m_last_chunk == nullptr)
+      m_last_chunk = chunk;
+    m_cursor = chunk_data(chunk);
+    m_limit = m_cursor + CHUNK_SIZE;
+    return allocate(size, align);
+  }
+  void reset()
+  {
+    m_chunks = m_last_chunk = nullptr;
+    m_cursor = m_limit = 0;
+    m_finalizers = m_oldest_finalizer = nullptr;
+  }
+public:
+  Arena()
+  {
+    reset();
+  }
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  Arena(Arena&& other)
+  {
+    reset();
+    splice(other);
+  }
+  Arena& operator=(Arena&& other)
+  {
+    if (this != &other) {
+      clear();
+      splice(other);
+    }
+    return *this;
+  }
+  ~Arena()
+  {
+    clear();
+  }
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t))
+  {
+    uintptr_t p = align_up(m_cursor, align);
+    if (m_cursor != 0 && p + size <= m_limit) {
+      m_cursor = p + size;
+      return reinterpret_cast<void *>(p);
+    }
+    return allocate_slow(size, align);
+  }
+  /*!
+   * @brief Constructs a T in the arena
+   *
+   * The object lives until the arena is cleared or destroyed.
+   */
+  template<typename T, typename... Args>
+  T *create(Args&&... args)
+  {
+    Finalizer *finalizer = nullptr;
+    if (!std::is_trivially_destructible<T>::value)
+      finalizer = static_cast<Finalizer *>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+    T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    if (finalizer != nullptr) {
+      finalizer->destroy = &Arena::destroy<T>;
+      finalizer->object = object;
+      finalizer->next = m_finalizers;
+      m_finalizers = finalizer;
+      if (m_oldest_finalizer == nullptr)
+        m_oldest_finalizer = finalizer;
+    }
+    return object;
+  }
+  /*!
+   * @brief Takes over the chunks and the objects of other, leaving it empty
+   *
+   * The objects of other are destroyed after the ones of this arena.
+   */
+  void splice(Arena& other)
+  {
+    if (other.m_chunks == nullptr)
+      return;
+    if (m_chunks == nullptr) {
+      m_chunks = other.m_chunks;
+      m_last_chunk = other.m_last_chunk;
+      m_cursor = other.m_cursor;
+      m_limit = other.m_limit;
+    } else {
+      m_last_chunk->next = other.m_chunks;
+      m_last_chunk = other.m_last_chunk;
+    }
+    if (m_finalizers == nullptr) {
+      m_finalizers = other.m_finalizers;
+      m_oldest_finalizer = other.m_oldest_finalizer;
+    } else if (other.m_finalizers != nullptr) {
+      m_oldest_finalizer->next = other.m_finalizers;
+      m_oldest_finalizer = other.m_oldest_finalizer;
+    }
+    other.reset();
+  }
+  /*!
+   * @brief Destroys every object and frees every chunk
+   */
+  void clear()
+  {
+    for (Finalizer *f = m_finalizers; f != nullptr; f = f->next)
+      f->destroy(f->object);
+    for (Chunk *chunk = m_chunks; chunk != nullptr; ) {
+      Chunk *next = chunk->next;
+      std::free(chunk);
+      chunk = next;
+    }
+    reset();
+  }
+  bool empty() const
+  {
+    return m_chunks == nullptr;
+  }
+};
+}
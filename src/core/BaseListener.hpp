@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 namespace Centaurus
 {
 class BaseListener
@@ -10,13 +12,26 @@ public:
     virtual void *feed_callback() { return NULL; }
     virtual void terminal_callback(int id, const void *start, const void *end) {}
     virtual const void *nonterminal_callback(int id, const void *input) { return NULL; }
+    virtual const void *refill_callback(const void *position) { return reinterpret_cast<const void *>(UINTPTR_MAX); }
+};
+//Machine id of the marker pair the parser writes around a captured terminal
+constexpr int CAPTURE_MACHINE_ID = 0x7FFF;
+/*!
+ * @brief Offsets of a captured terminal in the input
+ */
+struct TokenSpan
+{
+	long start, end;
 };
 struct SymbolEntry
 {
 	long id;
 	long start, end;
-	SymbolEntry(int id, long start, long end)
-		: id(id), start(start), end(end)
+	//Captured terminals of the symbol, in input order
+	const TokenSpan *spans;
+	long num_spans;
+	SymbolEntry(int id, long start, long end, const TokenSpan *spans = nullptr, long num_spans = 0)
+		: id(id), start(start), end(end), spans(spans), num_spans(num_spans)
 	{
 	}
 };
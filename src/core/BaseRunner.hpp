@@ -2,9 +2,14 @@
 
 #include <stdio.h>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 #include "BaseListener.hpp"
 #include "Platform.hpp"
+#include "Input.hpp"
+#include "Batch.hpp"
+#include "Cancellation.hpp"
 
 #define ALIGN_NEXT(x, a) (((x) + (a) - 1) / (a) * (a))
 #define PROGRAM_UUID "{57DF45C9-6D0C-4DD2-9B41-B71F8CF66B13}"
@@ -37,6 +42,15 @@ public:
     bool is_sv_marker() const
     {
         return get_sign_bit() && get_machine_id() == 0;
+    }
+    /*!
+     * @brief True for both markers around a captured terminal
+     *
+     * The start and end markers of a capture are always adjacent in a bank.
+     */
+    bool is_span_marker() const
+    {
+        return get_machine_id() == CAPTURE_MACHINE_ID;
     }
 	uint64_t get_offset() const
 	{
@@ -82,11 +96,15 @@ public:
 
 typedef long (CENTAURUS_CALLBACK * ReductionListener)(const SymbolEntry *symbol, uint64_t *values, int num_values, void *context);
 typedef void (CENTAURUS_CALLBACK * TransferListener)(int index, int new_index, void *context);
+typedef void (CENTAURUS_CALLBACK * InputListener)(int input, const void *window, void *context);
+typedef void (CENTAURUS_CALLBACK * CompletionListener)(int input, bool accepted, uint64_t value, void *context);
 
 class BaseRunner : public BaseListener
 {
-    static constexpr size_t STACK_SIZE = 1024 * 1024 * 1024;
 protected:
+    static constexpr size_t STACK_SIZE = 1024 * 1024 * 1024;
+    //Enough for threads that never run a parser recursing on the native stack
+    static constexpr size_t COMPACT_STACK_SIZE = 1024 * 1024;
 	enum class WindowBankState
 	{
 		Free,
@@ -100,6 +118,10 @@ protected:
 	struct WindowBankEntry
 	{
 		int number;
+        //Index of the input in the batch and of the bank within the input
+        int input, sequence;
+        //Set on the final bank of an input; rejected if the parser failed on it
+        bool last, rejected;
 		std::atomic<WindowBankState> state;
 	};
 	const void *m_input_window;
@@ -107,6 +129,17 @@ protected:
     void *m_main_window, *m_sub_window;
     size_t m_bank_size;
 	int m_bank_num;
+    bool m_owns_input;
+    Batch *m_batch;
+    //Checked by the parser at bank boundaries; null if the parse cannot be cancelled
+    const CancellationToken *m_cancellation;
+    //Stack reserved for the thread, fixed once the thread has been started
+    size_t m_stack_size;
+    //Parked mode: the thread outlives a single parse and waits for resume()
+    bool m_parked, m_shutdown;
+    unsigned int m_jobs_issued, m_jobs_done;
+    std::mutex m_park_mutex;
+    std::condition_variable m_park_cond;
 #if defined(CENTAURUS_BUILD_WINDOWS)
     HANDLE m_mem_handle;
     HANDLE m_slave_lock;
@@ -119,7 +152,8 @@ protected:
 #endif
 public:
 	BaseRunner(const char *filename, size_t bank_size, int bank_num, int pid = get_current_pid())
-		: m_bank_size(bank_size), m_bank_num(bank_num)
+		: m_bank_size(bank_size), m_bank_num(bank_num), m_owns_input(true), m_batch(nullptr), m_cancellation(nullptr), m_stack_size(STACK_SIZE),
+        m_parked(false), m_shutdown(false), m_jobs_issued(0), m_jobs_done(0)
 	{
 #if defined(CENTAURUS_BUILD_WINDOWS)
 		HANDLE hInputFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
@@ -136,10 +170,6 @@ public:
 
         //CloseHandle(hInputMapping);
         //CloseHandle(hInputFile);
-
-		sprintf(m_memory_name, "%s%s[%u]Window", PROGRAM_UUID, PROGRAM_NAME, pid);
-
-		sprintf(m_slave_lock_name, "%s%s[%u]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid);
 #elif defined(CENTAURUS_BUILD_LINUX)
         int fd = open(filename, O_RDONLY);
 
@@ -150,20 +180,69 @@ public:
         m_input_window = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
 
         close(fd);
-
-        snprintf(m_memory_name, sizeof(m_memory_name), "/%s%s[%d]Window", PROGRAM_UUID, PROGRAM_NAME, pid);
-
-		snprintf(m_slave_lock_name, sizeof(m_slave_lock_name), "/%s%s[%d]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid);
 #endif
+        set_ipc_names(pid);
 	}
+    /*!
+     * @brief Runs on an input owned by the caller, which must outlive the runner
+     *
+     * Runners with the same nonzero channel share a window; this allows several
+     * pipelines to coexist in one process.
+     */
+    BaseRunner(const Input& input, size_t bank_size, int bank_num, int pid = get_current_pid(), int channel = 0)
+        : m_input_window(input.get_buffer()), m_input_size(input.get_length()),
+        m_bank_size(bank_size), m_bank_num(bank_num), m_owns_input(false), m_batch(nullptr), m_cancellation(nullptr), m_stack_size(STACK_SIZE),
+        m_parked(false), m_shutdown(false), m_jobs_issued(0), m_jobs_done(0)
+    {
+        set_ipc_names(pid, channel);
+    }
 	virtual ~BaseRunner()
 	{
+        shutdown();
+        release_input();
+	}
+private:
+    void set_ipc_names(int pid, int channel = 0)
+    {
+#if defined(CENTAURUS_BUILD_WINDOWS)
+        if (channel == 0)
+        {
+		    sprintf(m_memory_name, "%s%s[%u]Window", PROGRAM_UUID, PROGRAM_NAME, pid);
+
+		    sprintf(m_slave_lock_name, "%s%s[%u]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid);
+        }
+        else
+        {
+		    sprintf(m_memory_name, "%s%s[%u.%d]Window", PROGRAM_UUID, PROGRAM_NAME, pid, channel);
+
+		    sprintf(m_slave_lock_name, "%s%s[%u.%d]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid, channel);
+        }
+#elif defined(CENTAURUS_BUILD_LINUX)
+        if (channel == 0)
+        {
+            snprintf(m_memory_name, sizeof(m_memory_name), "/%s%s[%d]Window", PROGRAM_UUID, PROGRAM_NAME, pid);
+
+		    snprintf(m_slave_lock_name, sizeof(m_slave_lock_name), "/%s%s[%d]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid);
+        }
+        else
+        {
+            snprintf(m_memory_name, sizeof(m_memory_name), "/%s%s[%d.%d]Window", PROGRAM_UUID, PROGRAM_NAME, pid, channel);
+
+		    snprintf(m_slave_lock_name, sizeof(m_slave_lock_name), "/%s%s[%d.%d]SlaveLock", PROGRAM_UUID, PROGRAM_NAME, pid, channel);
+        }
+#endif
+    }
+    void release_input()
+    {
+        if (!m_owns_input)
+            return;
 #if defined(CENTAURUS_BUILD_WINDOWS)
         UnmapViewOfFile(m_input_window);
 #elif defined(CENTAURUS_BUILD_LINUX)
         munmap(const_cast<void *>(m_input_window), m_input_size);
 #endif
-	}
+        m_owns_input = false;
+    }
 public:
 	size_t get_main_window_size() const
 	{
@@ -184,22 +263,55 @@ public:
     const void *get_input() const
     {
         return m_input_window;
+    }
+    /*!
+     * @brief Switches the runner to another input between two runs
+     */
+    virtual void set_input(const Input& input)
+    {
+        release_input();
+        m_input_window = input.get_buffer();
+        m_input_size = input.get_length();
+    }
+    /*!
+     * @brief Makes the next runs process the inputs of the batch instead
+     *
+     * Pass nullptr to go back to the single input set by set_input().
+     */
+    void set_batch(Batch *batch)
+    {
+        m_batch = batch;
+    }
+    /*!
+     * @brief Lets the token stop the parses of the runner, or none if it is null
+     */
+    void set_cancellation(const CancellationToken *token)
+    {
+        m_cancellation = token;
+    }
+    bool is_cancelled() const
+    {
+        return m_cancellation != nullptr && m_cancellation->cancelled();
     }
 	virtual void start() = 0;
+    /*!
+     * @brief Starts a thread that runs once per resume() until shutdown()
+     */
+    virtual void park() {}
     template<typename RunnerImpl>
     void _start()
     {
         clock_t start_time = clock();
 
 #if defined(CENTAURUS_BUILD_WINDOWS)
-        m_thread = CreateThread(NULL, STACK_SIZE, BaseRunner::thread_runner<RunnerImpl>, this, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+        m_thread = CreateThread(NULL, m_stack_size, BaseRunner::thread_runner<RunnerImpl>, this, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
 #elif defined(CENTAURUS_BUILD_LINUX)
         pthread_t thread;
         pthread_attr_t attr;
 
         pthread_attr_init(&attr);
 
-        pthread_attr_setstacksize(&attr, STACK_SIZE);
+        pthread_attr_setstacksize(&attr, m_stack_size);
 
         pthread_create(&m_thread, &attr, BaseRunner::thread_runner<RunnerImpl>, this);
 #endif
@@ -209,9 +321,63 @@ public:
         //char buf[64];
         //snprintf(buf, 64, "Elapsed time = %lf[ms]\r\n", (double)(end_time - start_time) * 1000.0 / CLOCKS_PER_SEC);
         //Logger::WriteMessage(buf);
+    }
+    template<typename RunnerImpl>
+    void _park()
+    {
+        m_parked = true;
+#if defined(CENTAURUS_BUILD_WINDOWS)
+        m_thread = CreateThread(NULL, m_stack_size, BaseRunner::parked_thread_runner<RunnerImpl>, this, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+#elif defined(CENTAURUS_BUILD_LINUX)
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+
+        pthread_attr_setstacksize(&attr, m_stack_size);
+
+        pthread_create(&m_thread, &attr, BaseRunner::parked_thread_runner<RunnerImpl>, this);
+
+        pthread_attr_destroy(&attr);
+#endif
+    }
+    /*!
+     * @brief Lets a parked thread run once more
+     */
+    void resume()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_park_mutex);
+            m_jobs_issued++;
+        }
+        m_park_cond.notify_all();
+    }
+    /*!
+     * @brief Stops a parked thread and joins it
+     */
+    void shutdown()
+    {
+        if (!m_parked)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_park_mutex);
+            m_shutdown = true;
+        }
+        m_park_cond.notify_all();
+#if defined(CENTAURUS_BUILD_WINDOWS)
+		WaitForSingleObject(m_thread, INFINITE);
+#elif defined(CENTAURUS_BUILD_LINUX)
+		pthread_join(m_thread, NULL);
+#endif
+        m_parked = false;
     }
 	virtual void wait()
 	{
+        if (m_parked)
+        {
+            std::unique_lock<std::mutex> lock(m_park_mutex);
+            m_park_cond.wait(lock, [this]{ return m_jobs_done == m_jobs_issued; });
+            return;
+        }
 #if defined(CENTAURUS_BUILD_WINDOWS)
 		WaitForSingleObject(m_thread, INFINITE);
 #elif defined(CENTAURUS_BUILD_LINUX)
@@ -234,6 +400,34 @@ private:
     ExitThread(0);
 #elif defined(CENTAURUS_BUILD_LINUX)
     return nullptr;
+#endif
+  }
+  template <typename RunnerImpl>
+#if defined(CENTAURUS_BUILD_WINDOWS)
+  static DWORD WINAPI parked_thread_runner(LPVOID param)
+#elif defined(CENTAURUS_BUILD_LINUX)
+  static void *parked_thread_runner(void *param)
+#endif
+  {
+    RunnerImpl *runner = reinterpret_cast<RunnerImpl*>(param);
+    unsigned int jobs_done = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(runner->m_park_mutex);
+        runner->m_park_cond.wait(lock, [&]{ return runner->m_shutdown || runner->m_jobs_issued != jobs_done; });
+        if (runner->m_shutdown) break;
+      }
+      runner->thread_runner_impl();
+      {
+        std::lock_guard<std::mutex> lock(runner->m_park_mutex);
+        runner->m_jobs_done = ++jobs_done;
+      }
+      runner->m_park_cond.notify_all();
+    }
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    ExitThread(0);
+#elif defined(CENTAURUS_BUILD_LINUX)
+    return nullptr;
 #endif
   }
 
@@ -303,6 +497,13 @@ protected:
     WaitForSingleObject(m_slave_lock, INFINITE);
 #elif defined(CENTAURUS_BUILD_LINUX)
     sem_wait(m_slave_lock);
+#endif
+  }
+  void drain_semaphore() {
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    while (WaitForSingleObject(m_slave_lock, 0) == WAIT_OBJECT_0);
+#elif defined(CENTAURUS_BUILD_LINUX)
+    while (sem_trywait(m_slave_lock) == 0);
 #endif
   }
 
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "Input.hpp"
+#include "DecompressedInput.hpp"
+#include "Exception.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief A sequence of inputs parsed back to back by one pipeline
+ *
+ * Stage1 opens the inputs one by one while the reduction stages are still
+ * working on the preceding ones. An input is closed by Stage3 right after its
+ * last bank has been reduced.
+ */
+class Batch
+{
+public:
+    Batch() {}
+    virtual ~Batch() {}
+    virtual int size() const = 0;
+    /*!
+     * @brief Called by Stage1 before the index-th input is parsed
+     */
+    virtual const Input& open(int index) = 0;
+    /*!
+     * @brief Returns an input that has been opened and not yet closed
+     */
+    virtual const Input& get(int index) const = 0;
+    /*!
+     * @brief Called by Stage3 after the index-th input has been reduced
+     *
+     * Returns false if the input turned out to be unreadable.
+     */
+    virtual bool close(int index) = 0;
+};
+/*!
+ * @brief Batch of files, mapped or decompressed only while they are in flight
+ */
+class FileBatch : public Batch
+{
+    std::vector<std::string> m_paths;
+    std::vector<std::unique_ptr<Input> > m_inputs;
+    std::vector<char> m_failed;
+public:
+    FileBatch(const std::vector<std::string>& paths)
+        : m_paths(paths), m_inputs(paths.size()), m_failed(paths.size(), 0)
+    {
+    }
+    virtual ~FileBatch()
+    {
+    }
+    virtual int size() const override
+    {
+        return m_paths.size();
+    }
+    virtual const Input& open(int index) override
+    {
+        try
+        {
+            m_inputs[index].reset(open_input(m_paths[index].c_str()));
+        }
+        catch (const SimpleException& e)
+        {
+        }
+
+        if (!m_inputs[index] || m_inputs[index]->get_buffer() == NULL)
+        {
+            //Unreadable inputs are parsed as empty text and reported as failed
+            static const char empty[64] = {0};
+            m_inputs[index].reset(new MemoryInput(empty, 0));
+            m_failed[index] = 1;
+        }
+        return *m_inputs[index];
+    }
+    virtual const Input& get(int index) const override
+    {
+        return *m_inputs[index];
+    }
+    virtual bool close(int index) override
+    {
+        bool ok = !m_failed[index];
+        try
+        {
+            m_inputs[index]->wait();
+        }
+        catch (const SimpleException& e)
+        {
+            ok = false;
+        }
+        m_inputs[index].reset();
+        return ok;
+    }
+    const std::string& get_path(int index) const
+    {
+        return m_paths[index];
+    }
+};
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Exception.hpp"
+
+namespace Centaurus
+{
+namespace detail
+{
+/*!
+ * @brief Header of a CST dump file, followed by one segment per bank
+ *
+ * Everything is written in the byte order of the machine taking the dump.
+ */
+struct CSTDumpHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    //Grammar::get_hash() of the grammar the markers were written for
+    uint64_t grammar_hash;
+    //Length of the parsed input in bytes, checked before the dump is replayed
+    uint64_t input_length;
+    //Offset of the end of the parse from the start of the input, or CST_DUMP_REJECTED
+    uint64_t end;
+    uint64_t bank_count;
+};
+/*!
+ * @brief Header of a segment, followed by the markers of the bank up to its terminator
+ */
+struct CSTDumpSegmentHeader
+{
+    //Position of the bank in the parse
+    uint64_t number;
+    //Number of markers, without the terminator
+    uint64_t length;
+};
+constexpr char CST_DUMP_MAGIC[8] = { 'C', 'T', 'C', 'S', 'T', '\0', '\0', '\0' };
+constexpr uint32_t CST_DUMP_VERSION = 1;
+constexpr uint64_t CST_DUMP_REJECTED = ~(uint64_t)0;
+//Size of the banks of a Context, IPC_PAGESIZE
+constexpr size_t CST_DUMP_BANK_SIZE = 8 * 1024 * 1024;
+}
+/*!
+ * @brief The CST markers written by the parser for one input, in bank order
+ *
+ * Taken with Context::dump() and fed to the reduction stages again with
+ * Context::replay(), which runs the actions without running the parser. A
+ * dump is only valid for the grammar and the input it was taken from; both
+ * are checked before a replay. The offsets in the markers are relative to
+ * the start of the input, so the dump does not contain the text itself.
+ */
+class CSTDump
+{
+    std::vector<std::vector<uint64_t> > m_banks;
+    uint64_t m_grammar_hash;
+    uint64_t m_input_length;
+    uint64_t m_end;
+public:
+    CSTDump()
+        : m_grammar_hash(0), m_input_length(0), m_end(detail::CST_DUMP_REJECTED)
+    {
+    }
+    explicit CSTDump(uint64_t grammar_hash)
+        : m_grammar_hash(grammar_hash), m_input_length(0), m_end(detail::CST_DUMP_REJECTED)
+    {
+    }
+    /*!
+     * @brief Loads a dump written by write()
+     *
+     * Throws SimpleException unless every segment fits in a bank of
+     * bank_size bytes and every marker and the end of the parse lie within
+     * the input, so a replay cannot write past a bank or read past the text.
+     */
+    explicit CSTDump(const char *path, size_t bank_size = detail::CST_DUMP_BANK_SIZE)
+    {
+        std::FILE *file = std::fopen(path, "rb");
+        if (file == NULL)
+            throw SimpleException(std::string("Cannot open CST dump ") + path);
+        detail::CSTDumpHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, detail::CST_DUMP_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == detail::CST_DUMP_VERSION &&
+            (header.end == detail::CST_DUMP_REJECTED || header.end <= header.input_length);
+        for (uint64_t i = 0; ok && i < header.bank_count; i++)
+        {
+            detail::CSTDumpSegmentHeader segment;
+            ok = std::fread(&segment, sizeof(segment), 1, file) == 1 && segment.number == i &&
+                segment.length <= bank_size / sizeof(uint64_t);
+            if (ok)
+            {
+                m_banks.emplace_back(segment.length);
+                ok = std::fread(m_banks.back().data(), sizeof(uint64_t), segment.length, file) == segment.length;
+            }
+            //A zero word would end the bank early
+            for (size_t j = 0; ok && j < m_banks.back().size(); j++)
+            {
+                uint64_t marker = m_banks.back()[j];
+                ok = marker != 0 && (marker & (((uint64_t)1 << 48) - 1)) <= header.input_length;
+            }
+        }
+        std::fclose(file);
+        if (!ok)
+            throw SimpleException(std::string("Invalid CST dump ") + path);
+        m_grammar_hash = header.grammar_hash;
+        m_input_length = header.input_length;
+        m_end = header.end;
+    }
+    /*!
+     * @brief Appends a bank, whose markers run up to the first zero word
+     */
+    void add_bank(const uint64_t *bank, size_t capacity)
+    {
+        size_t length = 0;
+        while (length < capacity && bank[length] != 0)
+            length++;
+        m_banks.emplace_back(bank, bank + length);
+    }
+    /*!
+     * @brief Records the length of the input and where the parse ended, once the last bank is added
+     */
+    void finish(uint64_t input_length, uint64_t end)
+    {
+        m_input_length = input_length;
+        m_end = end;
+    }
+    void write(const char *path) const
+    {
+        detail::CSTDumpHeader header;
+        std::memcpy(header.magic, detail::CST_DUMP_MAGIC, sizeof(header.magic));
+        header.version = detail::CST_DUMP_VERSION;
+        header.reserved = 0;
+        header.grammar_hash = m_grammar_hash;
+        header.input_length = m_input_length;
+        header.end = m_end;
+        header.bank_count = m_banks.size();
+
+        std::FILE *file = std::fopen(path, "wb");
+        if (file == NULL)
+            throw SimpleException(std::string("Cannot create CST dump ") + path);
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        for (size_t i = 0; ok && i < m_banks.size(); i++)
+        {
+            detail::CSTDumpSegmentHeader segment{ i, m_banks[i].size() };
+            ok = std::fwrite(&segment, sizeof(segment), 1, file) == 1 &&
+                std::fwrite(m_banks[i].data(), sizeof(uint64_t), m_banks[i].size(), file) == m_banks[i].size();
+        }
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok)
+            throw SimpleException(std::string("Cannot write CST dump ") + path);
+    }
+    uint64_t grammar_hash() const
+    {
+        return m_grammar_hash;
+    }
+    uint64_t input_length() const
+    {
+        return m_input_length;
+    }
+    /*!
+     * @brief Returns true if the parser accepted the input
+     */
+    bool accepted() const
+    {
+        return m_end != detail::CST_DUMP_REJECTED;
+    }
+    /*!
+     * @brief Returns where the parse ended, in bytes from the start of the input
+     */
+    uint64_t end() const
+    {
+        return m_end;
+    }
+    size_t size() const
+    {
+        return m_banks.size();
+    }
+    /*!
+     * @brief Returns the markers of the i-th bank, without the terminator
+     */
+    const std::vector<uint64_t>& operator[](size_t i) const
+    {
+        return m_banks[i];
+    }
+};
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+namespace Centaurus
+{
+/*!
+ * @brief Flag that stops a parse in flight
+ *
+ * May be tripped from any thread, including the actions. The parser checks
+ * it whenever it moves on to a new bank and rejects the input if it is set,
+ * so the parse stops within one bank of output.
+ */
+class CancellationToken
+{
+    std::atomic<bool> m_cancelled;
+public:
+    CancellationToken()
+        : m_cancelled(false)
+    {
+    }
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+    void cancel()
+    {
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+    bool cancelled() const
+    {
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+    void reset()
+    {
+        m_cancelled.store(false, std::memory_order_relaxed);
+    }
+};
+}
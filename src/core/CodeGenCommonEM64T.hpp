@@ -9,6 +9,10 @@
  *  OUTPUT_REG      EDI/RDI
  *  OUTPUT_BOUND    EDX/RDX
  *  Stack backup    MM3/R9
+ *  INPUT_BOUND     R12 (refill mode only)
+ *  RSTACK_REG      R13 (explicit stack mode only)
+ *  RSTACK_BOUND    R14 (explicit stack mode only)
+ *  RSTACK_STATE    R15 (explicit stack mode only)
  * ATN Machine scope (Chaser mode)
  *  CONTEXT_REG     MM2/R8
  *  INPUT_REG       ESI/RSI
@@ -48,6 +52,10 @@
 #define MARKER_REG asmjit::x86::rax
 #define ID_REG asmjit::x86::rbx
 #define STACK_BACKUP_REG asmjit::x86::r9
+#define INPUT_BOUND_REG asmjit::x86::r12
+#define RSTACK_REG asmjit::x86::r13
+#define RSTACK_BOUND_REG asmjit::x86::r14
+#define RSTACK_STATE_REG asmjit::x86::r15
 
 //DFA/LDFA routine scope registers
 #define BACKUP_REG asmjit::x86::rbx
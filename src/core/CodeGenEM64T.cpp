@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 #include "DFA.hpp"
 #include "ATN.hpp"
 #include "asmjit/asmjit.h"
@@ -75,14 +77,17 @@ void ChaserEM64T<TCHAR>::init(const Grammar<TCHAR>& grammar, asmjit::Logger *log
 }
 
 template<typename TCHAR>
-ParserEM64T<TCHAR>::ParserEM64T(const Grammar<TCHAR>& grammar, asmjit::Logger *logger, asmjit::ErrorHandler *errhandler)
+ParserEM64T<TCHAR>::ParserEM64T(const Grammar<TCHAR>& grammar, asmjit::Logger *logger, asmjit::ErrorHandler *errhandler, const ParserOptions& options)
 {
-    init(grammar, logger, errhandler);
+    init(grammar, logger, errhandler, options);
 }
 
 template<typename TCHAR>
-void ParserEM64T<TCHAR>::init(const Grammar<TCHAR>& grammar, asmjit::Logger *logger, asmjit::ErrorHandler *errhandler)
+void ParserEM64T<TCHAR>::init(const Grammar<TCHAR>& grammar, asmjit::Logger *logger, asmjit::ErrorHandler *errhandler, const ParserOptions& options)
 {
+    m_options = options;
+    m_projection = Projection<TCHAR>(grammar, options.projection);
+
     m_code.init(m_runtime.getCodeInfo());
     if (logger != NULL)
         m_code.setLogger(logger);
@@ -91,62 +96,122 @@ void ParserEM64T<TCHAR>::init(const Grammar<TCHAR>& grammar, asmjit::Logger *log
 
     asmjit::X86Assembler as(&m_code);
 
-    std::unordered_map<Identifier, asmjit::Label> machine_map;
-
-    emit_parser_prolog(as);
-
-    as.mov(CONTEXT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG1_STACK_OFFSET));
-    as.mov(INPUT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG2_STACK_OFFSET));
-    as.mov(OUTPUT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG3_STACK_OFFSET));
-    as.mov(OUTPUT_BOUND_REG, OUTPUT_REG);
-    as.add(OUTPUT_BOUND_REG, asmjit::Imm(AST_BUF_SIZE));
-    as.mov(INPUT_BASE_REG, INPUT_REG);
-
+    MachineCopies copies;
     MyConstPool pool(as);
 
-    pool.load_charclass_filter(PATTERN_REG, m_skipfilter);
-
     asmjit::Label rejectlabel = as.newLabel();
+    asmjit::Label refilllabel = as.newLabel();
+    asmjit::Label finishlabel = as.newLabel();
+    ReturnStateTable returns;
+    returns.table = as.newLabel();
+    returns.grow = as.newLabel();
 
+    //The entry of the root comes first, at the address of m_func
+    emit_entry(as, get_machine_label(as, grammar, copies, grammar.get_root_id(), m_projection.root_mode(grammar)), finishlabel, returns, pool);
+
+    //A parser specialized for a projection only starts from the root
+    std::vector<std::pair<int, asmjit::Label> > entries;
+    if (m_projection.empty())
     {
         for (const auto& p : grammar.get_machines())
         {
-            machine_map.emplace(p.first, as.newLabel());
+            if (p.first == grammar.get_root_id())
+                continue;
+            entries.emplace_back(grammar.get_machine_id(p.first), as.newLabel());
+            as.bind(entries.back().second);
+            emit_entry(as, get_machine_label(as, grammar, copies, p.first, Projection<TCHAR>::FULL), finishlabel, returns, pool);
         }
+    }
 
-        as.call(machine_map[grammar.get_root_id()]);
+    CompositeATN<TCHAR> catn(grammar);
+
+    //Emit the copies reachable from the entries, which are all the machines
+    //in the one mode there is without a projection
+    while (!copies.pending.empty())
+    {
+        Identifier id = copies.pending.back().first;
+        int mode = copies.pending.back().second;
+        copies.pending.pop_back();
+
+        as.bind(copies.labels[std::make_pair(mode, grammar.get_machine_id(id))]);
+
+        emit_machine(as, grammar, grammar[id], copies, mode, catn, id, rejectlabel, refilllabel, returns, pool);
     }
 
-    asmjit::Label landfilllabel = as.newLabel();
+    if (m_options.refill_input)
+    {
+        emit_refill_routine(as, refilllabel);
+    }
+
+    //Terminate the bank the parser gave up in, so that its markers can be
+    //read up to there. OUTPUT_REG is null if the bank was taken back on a
+    //cancellation.
+    asmjit::Label abortlabel = as.newLabel();
+    as.bind(rejectlabel);
+    as.test(OUTPUT_REG, OUTPUT_REG);
+    as.jz(abortlabel);
     as.xor_(MARKER_REG, MARKER_REG);
-    as.bind(landfilllabel);
     as.movnti(asmjit::X86Mem(OUTPUT_REG, 0), MARKER_REG);
-    as.add(OUTPUT_REG, asmjit::Imm(8));
-    as.cmp(OUTPUT_REG, OUTPUT_BOUND_REG);
-    as.jne(landfilllabel);
     as.sfence();
+    as.jmp(abortlabel);
 
-    asmjit::Label finishlabel = as.newLabel();
-    as.jmp(finishlabel);
+    as.bind(finishlabel);
 
-    CompositeATN<TCHAR> catn(grammar);
+    emit_parser_epilog(as, abortlabel, uses_extended_registers());
 
-    for (const auto& p : grammar.get_machines())
+    if (m_options.explicit_stack)
     {
-        as.bind(machine_map[p.first]);
-
-        emit_machine(as, p.second, machine_map, catn, p.first, rejectlabel, pool);
+        emit_return_stack_routines(as, rejectlabel, returns);
     }
 
-    as.bind(finishlabel);
-
-    emit_parser_epilog(as, rejectlabel);
-
     pool.embed();
 
     as.finalize();
 
     m_runtime.add(&m_func, &m_code);
+
+    m_entries.assign(grammar.get_machine_num() + 1, NULL);
+    m_entries[grammar.get_machine_id(grammar.get_root_id())] = m_func;
+    for (const auto& entry : entries)
+    {
+        m_entries[entry.first] = reinterpret_cast<EntryFunc>(reinterpret_cast<uint8_t *>(m_func) + m_code.getLabelOffset(entry.second));
+    }
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_entry(asmjit::X86Assembler& as, asmjit::Label& machinelabel, asmjit::Label& finishlabel, ReturnStateTable& returns, MyConstPool& pool)
+{
+    emit_parser_prolog(as, uses_extended_registers());
+
+    as.mov(CONTEXT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG1_STACK_OFFSET));
+    as.mov(INPUT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG2_STACK_OFFSET));
+    as.mov(OUTPUT_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG3_STACK_OFFSET));
+    as.mov(OUTPUT_BOUND_REG, OUTPUT_REG);
+    as.add(OUTPUT_BOUND_REG, asmjit::Imm(AST_BUF_SIZE));
+    as.mov(INPUT_BASE_REG, INPUT_REG);
+    if (m_options.refill_input)
+    {
+        //A zero bound forces a refill at the first check.
+        as.xor_(INPUT_BOUND_REG, INPUT_BOUND_REG);
+    }
+    if (m_options.explicit_stack)
+    {
+        as.mov(RSTACK_STATE_REG, asmjit::X86Mem(asmjit::x86::rsp, ARG4_STACK_OFFSET));
+        as.mov(RSTACK_REG, asmjit::X86Mem(RSTACK_STATE_REG, offsetof(ParserReturnStack, base)));
+        as.mov(RSTACK_BOUND_REG, asmjit::X86Mem(RSTACK_STATE_REG, offsetof(ParserReturnStack, bound)));
+    }
+
+    pool.load_charclass_filter(PATTERN_REG, m_skipfilter);
+
+    emit_invoke(as, machinelabel, returns);
+
+    //Terminate the last bank. A full bank always triggers request_page, so
+    //there is room for the terminator and the readers stop at it.
+    as.xor_(MARKER_REG, MARKER_REG);
+    as.movnti(asmjit::X86Mem(OUTPUT_REG, 0), MARKER_REG);
+    as.sfence();
+
+    as.jmp(finishlabel);
 }
 
 template<typename TCHAR>
@@ -313,7 +378,19 @@ void ChaserEM64T<TCHAR>::push_terminal(void *context, int id, const void *start,
 }
 
 template<typename TCHAR>
-void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine<TCHAR>& machine, std::unordered_map<Identifier, asmjit::Label>& machine_map, const CompositeATN<TCHAR>& catn, const Identifier& id, asmjit::Label& rejectlabel, MyConstPool& pool)
+asmjit::Label& ParserEM64T<TCHAR>::get_machine_label(asmjit::X86Assembler& as, const Grammar<TCHAR>& grammar, MachineCopies& copies, const Identifier& id, int mode)
+{
+    auto key = std::make_pair(mode, grammar.get_machine_id(id));
+    auto it = copies.labels.find(key);
+    if (it != copies.labels.end())
+        return it->second;
+
+    copies.pending.emplace_back(id, mode);
+    return copies.labels.emplace(key, as.newLabel()).first->second;
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const Grammar<TCHAR>& grammar, const ATNMachine<TCHAR>& machine, MachineCopies& copies, int mode, const CompositeATN<TCHAR>& catn, const Identifier& id, asmjit::Label& rejectlabel, asmjit::Label& refilllabel, ReturnStateTable& returns, MyConstPool& pool)
 {
     std::vector<asmjit::Label> statelabels;
 
@@ -324,7 +401,12 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
 
     asmjit::Label requestpage1_label = as.newLabel();
     asmjit::Label requestpage2_label = as.newLabel();
+    //Copies off the projection parse without writing any markers
+    bool reports = Projection<TCHAR>::reports(mode);
+
+    emit_refill_check(as, refilllabel);
 
+    if (reports)
     {
         //Write the start marker to the AST buffer.
         //Structure of the start marker (64 bits, Little Endian):
@@ -332,7 +414,7 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
         //+---+--------+----------------+
         //| 1 | ATN ID | Start Position |
         //+---+--------+----------------+
-        
+
         as.mov(MARKER_REG, INPUT_REG);
         as.sub(MARKER_REG, INPUT_BASE_REG);
         as.mov(ID_REG, machine.get_unique_id() | (1 << 15));
@@ -350,6 +432,19 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
 
         const ATNNode<TCHAR>& node = machine.get_node(i);
 
+        switch (node.type())
+        {
+        case ATNNodeType::LiteralTerminal:
+        case ATNNodeType::RegularTerminal:
+        case ATNNodeType::WhiteSpace:
+            emit_refill_check(as, refilllabel);
+            break;
+        }
+
+        //A rejected match discards the saved start along with the rest of the stack
+        if (node.is_captured() && reports)
+            as.push(INPUT_REG);
+
         switch (node.type())
         {
         case ATNNodeType::Blank:
@@ -358,8 +453,16 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
             MatchRoutineEM64T<TCHAR>::emit(as, pool, rejectlabel, node.get_literal());
             break;
         case ATNNodeType::Nonterminal:
-            as.call(machine_map[node.get_invoke()]);
+        {
+            int child_mode = m_projection.child_mode(mode, node.get_invoke());
+            asmjit::Label& childlabel = get_machine_label(as, grammar, copies, node.get_invoke(), child_mode);
+            //The refilling parser cannot scan ahead of the input it has been given
+            if (node.is_opaque() && !m_options.refill_input)
+                emit_opaque(as, node, grammar.get_machine_id(node.get_invoke()), Projection<TCHAR>::reports(child_mode), childlabel, rejectlabel, returns);
+            else
+                emit_invoke(as, childlabel, returns);
             break;
+        }
         case ATNNodeType::RegularTerminal:
             DFARoutineEM64T<TCHAR>::emit(as, rejectlabel, DFA<TCHAR>(node.get_nfa()), pool);
             break;
@@ -368,8 +471,15 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
             break;
         }
 
+        if (node.is_captured() && reports)
+            emit_marker_pair(as, CAPTURE_MACHINE_ID, rejectlabel);
+
         int outbound_num = node.get_transitions().size();
-        if (outbound_num == 0)
+        if (outbound_num == 0 && !reports)
+        {
+            emit_return(as, returns);
+        }
+        else if (outbound_num == 0)
         {
             //Write the end marker to the AST buffer.
             //Structure of the end marker:
@@ -387,7 +497,7 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
             as.add(OUTPUT_REG, 8);
             as.cmp(OUTPUT_REG, OUTPUT_BOUND_REG);
             as.je(requestpage2_label);
-            as.ret();
+            emit_return(as, returns);
         }
         else if (outbound_num == 1)
         {
@@ -406,60 +516,149 @@ void ParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine
         }
     }
 
-    as.bind(requestpage1_label);
+    if (reports)
     {
-        as.push(INPUT_REG);
-        as.push(INPUT_BASE_REG);
-        as.push(CONTEXT_REG);
-        as.push(STACK_BACKUP_REG);
-        as.movdqa(asmjit::x86::xmm15, PATTERN_REG);
-        as.mov(ARG1_REG, asmjit::X86Mem(asmjit::x86::rsp, 8));
-#if defined(CENTAURUS_BUILD_WINDOWS)
-        as.sub(asmjit::x86::rsp, 32);
-#endif
-        as.sfence();
-        as.call((uint64_t)request_page);
-#if defined(CENTAURUS_BUILD_WINDOWS)
-        as.add(asmjit::x86::rsp, 32);
-#endif
-        as.mov(OUTPUT_REG, asmjit::x86::rax);
-        as.mov(OUTPUT_BOUND_REG, OUTPUT_REG);
-        as.add(OUTPUT_BOUND_REG, AST_BUF_SIZE);
-        as.movdqa(PATTERN_REG, asmjit::x86::xmm15);
-        as.pop(STACK_BACKUP_REG);
-        as.pop(CONTEXT_REG);
-        as.pop(INPUT_BASE_REG);
-        as.pop(INPUT_REG);
-
+        as.bind(requestpage1_label);
+        emit_request_page(as, rejectlabel);
         as.jmp(statelabels[0]);
+
+        as.bind(requestpage2_label);
+        emit_request_page(as, rejectlabel);
+        emit_return(as, returns);
     }
-    as.bind(requestpage2_label);
-    {
-        as.push(INPUT_REG);
-        as.push(INPUT_BASE_REG);
-        as.push(CONTEXT_REG);
-        as.push(STACK_BACKUP_REG);
-        as.movdqa(asmjit::x86::xmm15, PATTERN_REG);
-        as.mov(ARG1_REG, asmjit::X86Mem(asmjit::x86::rsp, 8));
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_request_page(asmjit::X86Assembler& as, asmjit::Label& rejectlabel)
+{
+    //Switches OUTPUT_REG to a new bank. Registers other than RAX, RCX and
+    //the argument registers survive the call. A null bank means that the
+    //parse was cancelled, and the input is rejected.
+    as.push(INPUT_REG);
+    as.push(INPUT_BASE_REG);
+    as.push(CONTEXT_REG);
+    as.push(STACK_BACKUP_REG);
+    as.movdqa(asmjit::x86::xmm15, PATTERN_REG);
+    as.mov(ARG1_REG, asmjit::X86Mem(asmjit::x86::rsp, 8));
 #if defined(CENTAURUS_BUILD_WINDOWS)
-        as.sub(asmjit::x86::rsp, 32);
+    as.sub(asmjit::x86::rsp, 32);
 #endif
-        as.sfence();
-        as.call((uint64_t)request_page);
+    as.sfence();
+    as.call((uint64_t)request_page);
 #if defined(CENTAURUS_BUILD_WINDOWS)
-        as.add(asmjit::x86::rsp, 32);
+    as.add(asmjit::x86::rsp, 32);
 #endif
-        as.mov(OUTPUT_REG, asmjit::x86::rax);
-        as.mov(OUTPUT_BOUND_REG, OUTPUT_REG);
-        as.add(OUTPUT_BOUND_REG, AST_BUF_SIZE);
-        as.movdqa(PATTERN_REG, asmjit::x86::xmm15);
-        as.pop(STACK_BACKUP_REG);
-        as.pop(CONTEXT_REG);
-        as.pop(INPUT_BASE_REG);
-        as.pop(INPUT_REG);
+    as.mov(OUTPUT_REG, asmjit::x86::rax);
+    as.mov(OUTPUT_BOUND_REG, OUTPUT_REG);
+    as.add(OUTPUT_BOUND_REG, AST_BUF_SIZE);
+    as.movdqa(PATTERN_REG, asmjit::x86::xmm15);
+    as.pop(STACK_BACKUP_REG);
+    as.pop(CONTEXT_REG);
+    as.pop(INPUT_BASE_REG);
+    as.pop(INPUT_REG);
+    as.test(OUTPUT_REG, OUTPUT_REG);
+    as.jz(rejectlabel);
+}
 
-        as.ret();
-    }
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_marker_pair(asmjit::X86Assembler& as, int machine_id, asmjit::Label& rejectlabel)
+{
+    //Write the markers of a leaf whose start address is on the stack and
+    //whose end is INPUT_REG, such as a captured terminal, which uses the
+    //machine id reserved for captures. They are written as a pair, so they
+    //never straddle two banks:
+    //64  63         48                0
+    //+---+----------+-----------------+
+    //| 1 | ATN ID   | Start Position  |
+    //+---+----------+-----------------+
+    //| 0 | ATN ID   | End Position    |
+    //+---+----------+-----------------+
+    asmjit::Label fitlabel = as.newLabel();
+    asmjit::Label donelabel = as.newLabel();
+
+    as.pop(ID_REG);
+    as.sub(ID_REG, INPUT_BASE_REG);
+
+    //With one word left, terminate the bank there and move to the next one
+    as.lea(MARKER_REG, asmjit::X86Mem(OUTPUT_REG, 8));
+    as.cmp(MARKER_REG, OUTPUT_BOUND_REG);
+    as.jne(fitlabel);
+    as.xor_(MARKER_REG, MARKER_REG);
+    as.movnti(asmjit::X86Mem(OUTPUT_REG, 0), MARKER_REG);
+    emit_request_page(as, rejectlabel);
+    as.bind(fitlabel);
+
+    as.mov(MARKER_REG, machine_id | (1 << 15));
+    as.shl(MARKER_REG, 48);
+    as.or_(MARKER_REG, ID_REG);
+    as.movnti(asmjit::X86Mem(OUTPUT_REG, 0), MARKER_REG);
+    as.mov(MARKER_REG, INPUT_REG);
+    as.sub(MARKER_REG, INPUT_BASE_REG);
+    as.mov(ID_REG, machine_id);
+    as.shl(ID_REG, 48);
+    as.or_(MARKER_REG, ID_REG);
+    as.movnti(asmjit::X86Mem(OUTPUT_REG, 8), MARKER_REG);
+    as.add(OUTPUT_REG, 16);
+    as.cmp(OUTPUT_REG, OUTPUT_BOUND_REG);
+    as.jne(donelabel);
+    emit_request_page(as, rejectlabel);
+    as.bind(donelabel);
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_opaque(asmjit::X86Assembler& as, const ATNNode<TCHAR>& node, int machine_id, bool reports, asmjit::Label& machinelabel, asmjit::Label& rejectlabel, ReturnStateTable& returns)
+{
+    //Skip an opaque occurrence of a machine without running it, and write
+    //one leaf spanning the skipped text, whitespace included as the machine
+    //would, unless the machine is off the projection. Text that does not open with a bracket or a quote, and brackets
+    //that never close, go through the machine as usual, which also rejects
+    //malformed input.
+    asmjit::Label parselabel = as.newLabel();
+    asmjit::Label donelabel = as.newLabel();
+
+    m_opaque_syntaxes.emplace_back(new OpaqueSyntax<TCHAR>(node.get_opaque()));
+
+    as.push(INPUT_REG);
+    SkipRoutineEM64T<TCHAR>::emit(as);
+
+    as.push(CONTEXT_REG);
+    as.push(STACK_BACKUP_REG);
+    as.push(OUTPUT_REG);
+    as.push(OUTPUT_BOUND_REG);
+    as.sub(asmjit::x86::rsp, 16);
+    as.movdqu(asmjit::X86Mem(asmjit::x86::rsp, 0), PATTERN_REG);
+
+    as.mov(ARG1_REG, INPUT_REG);
+    as.mov(ARG2_REG, asmjit::Imm(reinterpret_cast<uint64_t>(m_opaque_syntaxes.back().get())));
+    emit_aligned_call(as, skip_opaque_region);
+
+    as.movdqu(PATTERN_REG, asmjit::X86Mem(asmjit::x86::rsp, 0));
+    as.add(asmjit::x86::rsp, 16);
+    as.pop(OUTPUT_BOUND_REG);
+    as.pop(OUTPUT_REG);
+    as.pop(STACK_BACKUP_REG);
+    as.pop(CONTEXT_REG);
+
+    as.test(asmjit::x86::rax, asmjit::x86::rax);
+    as.jz(parselabel);
+    as.mov(INPUT_REG, asmjit::x86::rax);
+    if (reports)
+        emit_marker_pair(as, machine_id, rejectlabel);
+    else
+        as.add(asmjit::x86::rsp, 8);
+    as.jmp(donelabel);
+
+    as.bind(parselabel);
+    as.pop(INPUT_REG);
+    emit_invoke(as, machinelabel, returns);
+
+    as.bind(donelabel);
+}
+
+template<typename TCHAR>
+const void *ParserEM64T<TCHAR>::skip_opaque_region(const void *input, const OpaqueSyntax<TCHAR> *syntax)
+{
+    return skip_opaque(static_cast<const TCHAR *>(input), *syntax);
 }
 
 template<typename TCHAR>
@@ -470,6 +669,142 @@ void *ParserEM64T<TCHAR>::request_page(void *context)
     return instance->feed_callback();
 }
 
+template<typename TCHAR>
+const void *ParserEM64T<TCHAR>::request_input(void *context, const void *position)
+{
+    BaseListener *instance = reinterpret_cast<BaseListener *>(context);
+
+    return instance->refill_callback(position);
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_refill_check(asmjit::X86Assembler& as, asmjit::Label& refilllabel)
+{
+    if (!m_options.refill_input)
+        return;
+
+    asmjit::Label continuelabel = as.newLabel();
+
+    as.cmp(INPUT_REG, INPUT_BOUND_REG);
+    as.jb(continuelabel);
+    as.call(refilllabel);
+    as.bind(continuelabel);
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_refill_routine(asmjit::X86Assembler& as, asmjit::Label& refilllabel)
+{
+    //Called from the refill checks with the machine scope registers live.
+    //Blocks until the input beyond INPUT_REG has been written and loads the new bound.
+    as.bind(refilllabel);
+
+    as.push(INPUT_REG);
+    as.push(CONTEXT_REG);
+    as.push(STACK_BACKUP_REG);
+    as.push(OUTPUT_REG);
+    as.push(OUTPUT_BOUND_REG);
+    as.sub(asmjit::x86::rsp, 16);
+    as.movdqu(asmjit::X86Mem(asmjit::x86::rsp, 0), PATTERN_REG);
+
+    as.mov(ARG2_REG, INPUT_REG);
+    as.mov(ARG1_REG, CONTEXT_REG);
+    emit_aligned_call(as, request_input);
+    as.mov(INPUT_BOUND_REG, asmjit::x86::rax);
+
+    as.movdqu(PATTERN_REG, asmjit::X86Mem(asmjit::x86::rsp, 0));
+    as.add(asmjit::x86::rsp, 16);
+    as.pop(OUTPUT_BOUND_REG);
+    as.pop(OUTPUT_REG);
+    as.pop(STACK_BACKUP_REG);
+    as.pop(CONTEXT_REG);
+    as.pop(INPUT_REG);
+
+    as.ret();
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_invoke(asmjit::X86Assembler& as, asmjit::Label& machinelabel, ReturnStateTable& returns)
+{
+    if (!m_options.explicit_stack)
+    {
+        as.call(machinelabel);
+        return;
+    }
+
+    //Push the index of the return state and enter the machine.
+    asmjit::Label continuelabel = as.newLabel();
+    asmjit::Label returnlabel = as.newLabel();
+
+    as.cmp(RSTACK_REG, RSTACK_BOUND_REG);
+    as.jb(continuelabel);
+    as.call(returns.grow);
+    as.bind(continuelabel);
+    as.mov(asmjit::x86::dword_ptr(RSTACK_REG), asmjit::Imm(returns.states.size()));
+    as.add(RSTACK_REG, 4);
+    as.jmp(machinelabel);
+    as.bind(returnlabel);
+
+    returns.states.push_back(returnlabel);
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_return(asmjit::X86Assembler& as, ReturnStateTable& returns)
+{
+    if (!m_options.explicit_stack)
+    {
+        as.ret();
+        return;
+    }
+
+    //Pop the index of the return state and jump through the table.
+    //RAX and RCX are free at the end of a machine.
+    as.sub(RSTACK_REG, 4);
+    as.mov(asmjit::x86::eax, asmjit::x86::dword_ptr(RSTACK_REG));
+    as.lea(asmjit::x86::rcx, asmjit::X86Mem(returns.table));
+    as.jmp(asmjit::x86::qword_ptr(asmjit::x86::rcx, asmjit::x86::rax, 3));
+}
+
+template<typename TCHAR>
+void ParserEM64T<TCHAR>::emit_return_stack_routines(asmjit::X86Assembler& as, asmjit::Label& rejectlabel, ReturnStateTable& returns)
+{
+    //Called from the invocations when the return stack is full.
+    //Rejects the input if the stack cannot grow any further.
+    as.bind(returns.grow);
+
+    as.push(INPUT_REG);
+    as.push(CONTEXT_REG);
+    as.push(STACK_BACKUP_REG);
+    as.push(OUTPUT_REG);
+    as.push(OUTPUT_BOUND_REG);
+    as.sub(asmjit::x86::rsp, 16);
+    as.movdqu(asmjit::X86Mem(asmjit::x86::rsp, 0), PATTERN_REG);
+
+    as.mov(ARG1_REG, RSTACK_STATE_REG);
+    as.mov(ARG2_REG, RSTACK_REG);
+    emit_aligned_call(as, ParserReturnStack::grow);
+    as.mov(RSTACK_REG, asmjit::x86::rax);
+
+    as.movdqu(PATTERN_REG, asmjit::X86Mem(asmjit::x86::rsp, 0));
+    as.add(asmjit::x86::rsp, 16);
+    as.pop(OUTPUT_BOUND_REG);
+    as.pop(OUTPUT_REG);
+    as.pop(STACK_BACKUP_REG);
+    as.pop(CONTEXT_REG);
+    as.pop(INPUT_REG);
+
+    as.test(RSTACK_REG, RSTACK_REG);
+    as.jz(rejectlabel);
+    as.mov(RSTACK_BOUND_REG, asmjit::X86Mem(RSTACK_STATE_REG, offsetof(ParserReturnStack, bound)));
+    as.ret();
+
+    //Addresses of the return states, indexed by the entries of the stack
+    as.bind(returns.table);
+    for (const auto& label : returns.states)
+    {
+        as.embedLabel(label);
+    }
+}
+
 template<typename TCHAR>
 void DryParserEM64T<TCHAR>::emit_machine(asmjit::X86Assembler& as, const ATNMachine<TCHAR>& machine, std::unordered_map<Identifier, asmjit::Label>& machine_map, const CompositeATN<TCHAR>& catn, const Identifier& id, asmjit::Label& rejectlabel, MyConstPool& pool)
 {
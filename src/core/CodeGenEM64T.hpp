@@ -1,10 +1,19 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "DFA.hpp"
 #include "LookaheadDFA.hpp"
 #include "asmjit/asmjit.h"
 #include "BaseListener.hpp"
 #include "CodeGenInterface.hpp"
+#include "Projection.hpp"
 
 namespace Centaurus
 {
@@ -69,25 +78,138 @@ public:
 	}
 };
 
+/*!
+ * @brief Return stack of a parser compiled with ParserOptions::explicit_stack
+ *
+ * Each active nonterminal invocation takes one 32-bit index into the table of
+ * return states of the parser. The parser calls grow() when the stack is full.
+ */
+struct ParserReturnStack
+{
+    static constexpr size_t INITIAL_CAPACITY = 4096;
+    uint32_t *base, *bound;
+    size_t limit;
+    ParserReturnStack(size_t limit)
+        : limit(limit)
+    {
+        size_t capacity = INITIAL_CAPACITY;
+        if (limit < capacity)
+            capacity = (limit > 0) ? limit : 1;
+        base = static_cast<uint32_t *>(malloc(capacity * sizeof(uint32_t)));
+        if (base == NULL)
+            throw std::bad_alloc();
+        bound = base + capacity;
+    }
+    ParserReturnStack(const ParserReturnStack&) = delete;
+    ParserReturnStack& operator=(const ParserReturnStack&) = delete;
+    ~ParserReturnStack()
+    {
+        free(base);
+    }
+    /*!
+     * @brief Doubles the capacity and returns the new top of the stack
+     *
+     * Returns NULL if the stack has reached its limit, and the parser rejects.
+     */
+    static uint32_t *grow(ParserReturnStack *stack, uint32_t *top)
+    {
+        size_t depth = top - stack->base;
+        size_t capacity = stack->bound - stack->base;
+        if (capacity >= stack->limit)
+            return NULL;
+        capacity = (capacity * 2 < stack->limit) ? capacity * 2 : stack->limit;
+        uint32_t *base = static_cast<uint32_t *>(realloc(stack->base, capacity * sizeof(uint32_t)));
+        if (base == NULL)
+            return NULL;
+        stack->base = base;
+        stack->bound = base + capacity;
+        return base + depth;
+    }
+};
+
 template<typename TCHAR>
 class ParserEM64T : public IParser
 {
     static constexpr int64_t AST_BUF_SIZE = 8 * 1024 * 1024;
+    //Labels shared by the machines in explicit stack mode
+    struct ReturnStateTable
+    {
+        asmjit::Label table, grow;
+        std::vector<asmjit::Label> states;
+    };
+    //Entry labels of the compiled copies of the machines, keyed by the
+    //projection mode and the machine id, and the copies yet to be emitted
+    struct MachineCopies
+    {
+        std::map<std::pair<int, int>, asmjit::Label> labels;
+        std::vector<std::pair<Identifier, int> > pending;
+    };
     asmjit::JitRuntime m_runtime;
     asmjit::CodeHolder m_code;
     static CharClass<TCHAR> m_skipfilter;
-    const void *(*m_func)(void *context, const void *input, void *output);
-    void emit_machine(asmjit::X86Assembler& as, const ATNMachine<TCHAR>& machine, std::unordered_map<Identifier, asmjit::Label>& machine_map, const CompositeATN<TCHAR>& catn, const Identifier& id, asmjit::Label& rejectlabel, MyConstPool& pool);
+    ParserOptions m_options;
+    Projection<TCHAR> m_projection;
+    //Delimiters of the opaque nonterminals, read by the compiled code
+    std::vector<std::unique_ptr<OpaqueSyntax<TCHAR> > > m_opaque_syntaxes;
+    typedef const void *(*EntryFunc)(void *context, const void *input, void *output, ParserReturnStack *stack);
+    //Entry of the root machine, which the other entries follow
+    EntryFunc m_func;
+    //Entries by machine id; null for the machines a projection parser cannot start from
+    std::vector<EntryFunc> m_entries;
+    asmjit::Label& get_machine_label(asmjit::X86Assembler& as, const Grammar<TCHAR>& grammar, MachineCopies& copies, const Identifier& id, int mode);
+    void emit_machine(asmjit::X86Assembler& as, const Grammar<TCHAR>& grammar, const ATNMachine<TCHAR>& machine, MachineCopies& copies, int mode, const CompositeATN<TCHAR>& catn, const Identifier& id, asmjit::Label& rejectlabel, asmjit::Label& refilllabel, ReturnStateTable& returns, MyConstPool& pool);
+    void emit_entry(asmjit::X86Assembler& as, asmjit::Label& machinelabel, asmjit::Label& finishlabel, ReturnStateTable& returns, MyConstPool& pool);
+    void emit_refill_check(asmjit::X86Assembler& as, asmjit::Label& refilllabel);
+    void emit_refill_routine(asmjit::X86Assembler& as, asmjit::Label& refilllabel);
+    void emit_invoke(asmjit::X86Assembler& as, asmjit::Label& machinelabel, ReturnStateTable& returns);
+    void emit_return(asmjit::X86Assembler& as, ReturnStateTable& returns);
+    void emit_return_stack_routines(asmjit::X86Assembler& as, asmjit::Label& rejectlabel, ReturnStateTable& returns);
+    void emit_request_page(asmjit::X86Assembler& as, asmjit::Label& rejectlabel);
+    void emit_marker_pair(asmjit::X86Assembler& as, int machine_id, asmjit::Label& rejectlabel);
+    void emit_opaque(asmjit::X86Assembler& as, const ATNNode<TCHAR>& node, int machine_id, bool reports, asmjit::Label& machinelabel, asmjit::Label& rejectlabel, ReturnStateTable& returns);
+    bool uses_extended_registers() const
+    {
+        return m_options.refill_input || m_options.explicit_stack;
+    }
     static void *request_page(void *context);
+    static const void *request_input(void *context, const void *position);
+    static const void *skip_opaque_region(const void *input, const OpaqueSyntax<TCHAR> *syntax);
+    const void *run(EntryFunc func, BaseListener *context, const void *input)
+    {
+        void *output = context->feed_callback();
+        //The parse was cancelled before it started
+        if (output == NULL)
+            return NULL;
+        if (!m_options.explicit_stack)
+            return func(context, input, output, NULL);
+
+        ParserReturnStack stack(m_options.max_nesting_depth);
+        return func(context, input, output, &stack);
+    }
 public:
     ParserEM64T() {}
-    ParserEM64T(const Grammar<TCHAR>& grammar, asmjit::Logger *logger = NULL, asmjit::ErrorHandler *errhandler = NULL);
-    void init(const Grammar<TCHAR>& grammar, asmjit::Logger *logger = NULL, asmjit::ErrorHandler *errhandler = NULL);
+    ParserEM64T(const Grammar<TCHAR>& grammar, asmjit::Logger *logger = NULL, asmjit::ErrorHandler *errhandler = NULL, const ParserOptions& options = ParserOptions());
+    void init(const Grammar<TCHAR>& grammar, asmjit::Logger *logger = NULL, asmjit::ErrorHandler *errhandler = NULL, const ParserOptions& options = ParserOptions());
     virtual ~ParserEM64T() {}
     const void *operator()(BaseListener *context, const void *input)
     {
-        void *output = context->feed_callback();
-        return m_func(context, input, output);
+        return run(m_func, context, input);
+    }
+    /*!
+     * @brief Parses a symbol of the machine at the input, as if the machine were the root
+     *
+     * Only the root can be started from if the parser was specialized for a
+     * projection.
+     */
+    virtual const void *parse_from(int machine_id, BaseListener *context, const void *input) override
+    {
+        if (machine_id <= 0 || machine_id >= (int)m_entries.size() || m_entries[machine_id] == NULL)
+            throw SimpleException("The parser cannot start from the machine");
+        return run(m_entries[machine_id], context, input);
+    }
+    virtual bool uses_native_stack() const override
+    {
+        return !m_options.explicit_stack;
     }
 };
 
@@ -1,16 +1,59 @@
 #pragma once
 
+#include <stddef.h>
+#include <string>
+
 #include "BaseListener.hpp"
 #include "Identifier.hpp"
+#include "Exception.hpp"
 
 namespace Centaurus
 {
+/*!
+ * @brief Code generation switches of the JIT parser
+ */
+struct ParserOptions
+{
+    //Call BaseListener::refill_callback whenever the input pointer crosses
+    //the bound returned by the previous call, for inputs that are still being
+    //written (e.g. decompressed on the fly)
+    bool refill_input;
+    //Keep the return states of nonterminal invocations on a growable heap
+    //stack instead of the native stack, so that the parser thread only needs
+    //a small stack whatever the nesting depth of the input
+    bool explicit_stack;
+    //Deepest nesting accepted in explicit stack mode; deeper inputs are rejected
+    size_t max_nesting_depth;
+    //Path query, such as "DblpRoot/Article/NonYearInfo[Text]", selecting the
+    //symbols the parser writes markers for (see Projection); empty for all
+    std::string projection;
+    ParserOptions()
+        : refill_input(false), explicit_stack(false), max_nesting_depth(64 * 1024 * 1024)
+    {
+    }
+};
 class IParser
 {
 public:
 	IParser() {}
 	virtual ~IParser() {}
 	virtual const void *operator()(BaseListener *context, const void *input) = 0;
+    /*!
+     * @brief Parses a symbol of the machine at the input instead of the root, writing the same markers
+     *
+     * Returns where the symbol ends, or null if the input is rejected.
+     */
+    virtual const void *parse_from(int machine_id, BaseListener *context, const void *input)
+    {
+        throw SimpleException("The parser only starts from the root");
+    }
+    /*!
+     * @brief Returns false if the parser recurses on a heap stack of its own
+     */
+    virtual bool uses_native_stack() const
+    {
+        return true;
+    }
 };
 
 typedef void *(*ChaserFunc)(void *context, const void *input);
@@ -98,8 +98,44 @@ static void call_abs(asmjit::X86Assembler& as, T addr, Ts... args)
 #endif
 }
 
-static void emit_parser_prolog(asmjit::X86Assembler& as)
+/*!
+ * @brief Calls a C function regardless of the alignment of RSP
+ *
+ * Arguments must already be in the argument registers. RAX is clobbered.
+ */
+template<typename T>
+static void emit_aligned_call(asmjit::X86Assembler& as, T addr)
 {
+    as.mov(asmjit::x86::rax, asmjit::x86::rsp);
+    as.and_(asmjit::x86::rsp, asmjit::Imm(-16));
+    as.push(asmjit::x86::rax);
+    as.sub(asmjit::x86::rsp, 8);
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    as.sub(asmjit::x86::rsp, 32);
+#endif
+    as.call(reinterpret_cast<uint64_t>(addr));
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    as.add(asmjit::x86::rsp, 32);
+#endif
+    as.add(asmjit::x86::rsp, 8);
+    as.pop(asmjit::x86::rsp);
+}
+
+/*!
+ * @brief Saves the registers clobbered by the parser
+ *
+ * With save_extended, R12-R15 are saved as well. They are pushed before the
+ * others so that ARG*_STACK_OFFSET stays the same.
+ */
+static void emit_parser_prolog(asmjit::X86Assembler& as, bool save_extended = false)
+{
+    if (save_extended)
+    {
+        as.push(asmjit::x86::r12);
+        as.push(asmjit::x86::r13);
+        as.push(asmjit::x86::r14);
+        as.push(asmjit::x86::r15);
+    }
     as.push(asmjit::x86::r9);
     as.push(asmjit::x86::r8);
     as.push(asmjit::x86::rbp);
@@ -113,7 +149,7 @@ static void emit_parser_prolog(asmjit::X86Assembler& as)
     as.mov(asmjit::x86::r9, asmjit::x86::rsp);
 }
 
-static void emit_parser_epilog(asmjit::X86Assembler& as, asmjit::Label& rejectlabel)
+static void emit_parser_epilog(asmjit::X86Assembler& as, asmjit::Label& rejectlabel, bool save_extended = false)
 {
     asmjit::Label acceptlabel = as.newLabel();
 
@@ -136,6 +172,14 @@ static void emit_parser_epilog(asmjit::X86Assembler& as, asmjit::Label& rejectla
     as.pop(asmjit::x86::r8);
     as.pop(asmjit::x86::r9);
 
+    if (save_extended)
+    {
+        as.pop(asmjit::x86::r15);
+        as.pop(asmjit::x86::r14);
+        as.pop(asmjit::x86::r13);
+        as.pop(asmjit::x86::r12);
+    }
+
     as.ret();
 }
 
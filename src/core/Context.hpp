@@ -1,35 +1,187 @@
 #pragma once
 
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <iterator>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
 #include "StageRunners.hpp"
+#include "InlineRunner.hpp"
+#include "Arena.hpp"
+#include "Aggregator.hpp"
+#include "TaskPool.hpp"
+#include "Cancellation.hpp"
+#include "RecordQueue.hpp"
+#include "RecordIndex.hpp"
+#include "CSTDump.hpp"
+#include "Incremental.hpp"
+#include "TextView.hpp"
+#include "Decode.hpp"
+#include "DecompressedInput.hpp"
+#include "Exception.hpp"
 
 namespace Centaurus
 {
-template<typename TCHAR>
+template<typename TCHAR, typename Value = void>
 class SymbolContext;
+template<typename TCHAR, typename Value = void>
+class SymbolBatch;
+//Called once per input of a batch, in input order, with the value of the root symbol
+using CppCompletionCallback = void (*)(int index, bool accepted, void *result, void *user);
+/*!
+ * @brief Types of the semantic values of a Context
+ *
+ * With Value = void, actions return pointers that are stored as raw 64-bit
+ * words, and a null pointer means no value. Otherwise the values are stored
+ * inline in the reduction stacks as Value.
+ */
+template<typename TCHAR, typename Value>
+struct ContextValueTraits
+{
+    typedef Value storage_type;
+    typedef Value result_type;
+    typedef Value (*callback_type)(const SymbolContext<TCHAR, Value>& ctx);
+    typedef void (*batch_callback_type)(const SymbolBatch<TCHAR, Value>& batch, Value *results);
+    typedef Value (*fold_init_type)();
+    typedef void (*fold_step_type)(Value& acc, const Value& value);
+    typedef void (*completion_type)(int index, bool accepted, const Value& result, void *user);
+    static result_type to_result(const storage_type& value)
+    {
+        return value;
+    }
+};
 template<typename TCHAR>
-using CppReductionCallback = void *(*)(const SymbolContext<TCHAR>& ctx);
-template<typename TCHAR>
+struct ContextValueTraits<TCHAR, void>
+{
+    typedef uint64_t storage_type;
+    typedef void *result_type;
+    typedef void *(*callback_type)(const SymbolContext<TCHAR>& ctx);
+    typedef void (*batch_callback_type)(const SymbolBatch<TCHAR>& batch, void **results);
+    typedef void *(*fold_init_type)();
+    typedef void (*fold_step_type)(void *&acc, void *value);
+    typedef CppCompletionCallback completion_type;
+    static result_type to_result(storage_type value)
+    {
+        return reinterpret_cast<void *>(value);
+    }
+};
+template<typename TCHAR, typename Value = void>
+using CppReductionCallback = typename ContextValueTraits<TCHAR, Value>::callback_type;
+template<typename TCHAR, typename Value = void>
+using CppBatchCallback = typename ContextValueTraits<TCHAR, Value>::batch_callback_type;
+//Extracts the key of a record for a RecordIndexBuilder
+template<typename TCHAR, typename Value = void>
+using CppIndexKey = uint64_t (*)(const SymbolContext<TCHAR, Value>& ctx);
+/*!
+ * @brief Folds the children of a symbol into an accumulator
+ *
+ * init creates an empty accumulator and accumulate adds the value of a
+ * child to it. merge appends a partial accumulator built by another worker
+ * from the children that follow, so it must give the same result as
+ * accumulating those children one by one.
+ */
+template<typename TCHAR, typename Value = void>
+struct CppFold
+{
+    typename ContextValueTraits<TCHAR, Value>::fold_init_type init;
+    typename ContextValueTraits<TCHAR, Value>::fold_step_type accumulate;
+    typename ContextValueTraits<TCHAR, Value>::fold_step_type merge;
+};
+namespace detail
+{
+/*!
+ * @brief Value of a deferred action, set by the thread running it
+ *
+ * It stands in the reduction stacks as its address tagged with
+ * DEFERRED_TAG, which actions never see. While actions are deferred, any
+ * other value with that bit set, such as a pointer to a character of the
+ * input, is stored as a ready DeferredValue too, so the tag is never
+ * mistaken for a value.
+ */
+struct DeferredValue
+{
+    std::atomic<bool> ready;
+    uint64_t value;
+    DeferredValue() : ready(false), value(0)
+    {
+    }
+};
+constexpr uint64_t DEFERRED_TAG = 1;
+/*!
+ * @brief Machine whose symbols are added to a RecordIndexBuilder as they are reduced
+ *
+ * Context::parse_appended() sets ends instead, which keeps the end of the
+ * last record reduced.
+ */
+template<typename TCHAR, typename Value>
+struct IndexHook
+{
+    //Never matches a symbol while no index is attached
+    int machine;
+    RecordIndexBuilder *builder;
+    CppIndexKey<TCHAR, Value> key;
+    Max<uint64_t> *ends;
+};
+}
+template<typename TCHAR, typename Value = void>
 struct ParseContext
 {
-    std::vector<CppReductionCallback<TCHAR> >& m_callbacks;
+    typedef ContextValueTraits<TCHAR, Value> traits_type;
+    std::vector<CppReductionCallback<TCHAR, Value> >& m_callbacks;
+    std::vector<CppBatchCallback<TCHAR, Value> >& m_batch_callbacks;
+    std::vector<CppFold<TCHAR, Value> >& m_folds;
     const void *m_window;
-    ParseContext(std::vector<CppReductionCallback<TCHAR> >& callbacks, const void *window)
-        : m_callbacks(callbacks), m_window(window)
+    typename traits_type::completion_type m_completion;
+    void *m_completion_user;
+    //Arena of the runner the actions are called from
+    Arena *m_arena;
+    //Visitor of a StaticContext
+    void *m_visitor;
+    //Index of the runner the actions are called from, for the shards of an Aggregator
+    int m_worker;
+    //Runs the deferred actions; null when they run in place
+    TaskPool *m_pool;
+    const std::vector<bool> *m_deferred;
+    //Token of the Context, tripped by SymbolContext::cancel()
+    CancellationToken *m_cancellation;
+    //Index being built, or null
+    const detail::IndexHook<TCHAR, Value> *m_index;
+    ParseContext(std::vector<CppReductionCallback<TCHAR, Value> >& callbacks, std::vector<CppBatchCallback<TCHAR, Value> >& batch_callbacks, std::vector<CppFold<TCHAR, Value> >& folds, const void *window, void *visitor = nullptr, int worker = 0)
+        : m_callbacks(callbacks), m_batch_callbacks(batch_callbacks), m_folds(folds), m_window(window), m_completion(nullptr), m_completion_user(nullptr), m_arena(nullptr), m_visitor(visitor), m_worker(worker), m_pool(nullptr), m_deferred(nullptr), m_cancellation(nullptr), m_index(nullptr)
     {
     }
 };
-template<typename TCHAR>
+template<typename TCHAR, typename Value>
 class SymbolContext
 {
-  const ParseContext<TCHAR>& context;
+  typedef typename ContextValueTraits<TCHAR, Value>::storage_type storage_type;
+  const ParseContext<TCHAR, Value>& context;
   const SymbolEntry& symbol;
-  const uint64_t * const values;
+  const storage_type * const values;
   const int num_values;
 public:
-  SymbolContext(const ParseContext<TCHAR>& context, const SymbolEntry& symbol, uint64_t *values, int num_values)
+  SymbolContext(const ParseContext<TCHAR, Value>& context, const SymbolEntry& symbol, storage_type *values, int num_values)
     : context(context), symbol(symbol), values(values), num_values(num_values)
   {
   }
+  /*!
+   * @brief Returns the text of the symbol without copying it
+   */
+  TextView<TCHAR> view() const
+  {
+    return TextView<TCHAR>(start(), end());
+  }
   std::basic_string<TCHAR> read() const
   {
     const TCHAR *p = reinterpret_cast<const TCHAR *>(context.m_window) + symbol.start;
@@ -51,29 +203,737 @@ public:
   {
     return num_values;
   }
-  template<typename T>
-  T *value(int i) const
+  /*!
+   * @brief Returns the index of the worker running the action, for Aggregator::add()
+   */
+  int worker() const
+  {
+    return context.m_worker;
+  }
+  /*!
+   * @brief Stops the parse, e.g. once enough records have been found
+   *
+   * The parser rejects the input at its next bank, and the symbols that are
+   * already in flight may still be reduced.
+   */
+  void cancel() const
+  {
+    context.m_cancellation->cancel();
+  }
+  /*!
+   * @brief Returns the number of terminals captured with @ directly under the symbol
+   */
+  int span_count() const
+  {
+    return static_cast<int>(symbol.num_spans);
+  }
+  /*!
+   * @brief Returns the text of the i-th captured terminal (1-based)
+   *
+   * The parser has already found the bounds of the terminal, so the action
+   * does not have to scan for them again.
+   */
+  TextView<TCHAR> span(int i) const
+  {
+    const TCHAR *window = reinterpret_cast<const TCHAR *>(context.m_window);
+    const TokenSpan& s = symbol.spans[i - 1];
+    return TextView<TCHAR>(window + s.start, window + s.end);
+  }
+  /*!
+   * @brief Decodes the text of the symbol as a decimal integer
+   *
+   * Surrounding whitespace is ignored. Returns false if the rest is not a
+   * single integer that fits in value.
+   */
+  template<typename T = TCHAR>
+  typename std::enable_if<std::is_same<T, char>::value, bool>::type to_int(int64_t& value) const
+  {
+    TextView<char> text = view().trim();
+    return decode_int(text.begin(), text.end(), value) == text.end();
+  }
+  /*!
+   * @brief Decodes the text of the symbol as a floating-point number
+   */
+  template<typename T = TCHAR>
+  typename std::enable_if<std::is_same<T, char>::value, bool>::type to_double(double& value) const
+  {
+    TextView<char> text = view().trim();
+    return decode_double(text.begin(), text.end(), value) == text.end();
+  }
+  /*!
+   * @brief Appends the contents of a quoted JSON string symbol to out, unescaped
+   */
+  template<typename T = TCHAR>
+  typename std::enable_if<std::is_same<T, char>::value, bool>::type unescape_json(std::string& out) const
+  {
+    TextView<char> text = view().trim();
+    if (text.size() < 2 || text[0] != '"' || text[text.size() - 1] != '"')
+      return false;
+    return Centaurus::unescape_json(text.begin() + 1, text.end() - 1, out);
+  }
+  /*!
+   * @brief Appends the text of the symbol to out with XML references decoded
+   */
+  template<typename T = TCHAR>
+  typename std::enable_if<std::is_same<T, char>::value, bool>::type decode_xml(std::string& out) const
+  {
+    return Centaurus::decode_xml(start(), end(), out);
+  }
+  /*!
+   * @brief Constructs a T in the arena of the worker running the action
+   *
+   * The object is freed in bulk with every other value of the input, when the
+   * Context finishes its next parse or is destroyed, unless the caller has
+   * taken the arena with Context::take_result_arena().
+   */
+  template<typename T, typename... Args>
+  T *alloc(Args&&... args) const
+  {
+    return context.m_arena->template create<T>(std::forward<Args>(args)...);
+  }
+  /*!
+   * @brief Returns the i-th child value (1-based) of an untyped Context
+   */
+  template<typename T, typename V = Value>
+  typename std::enable_if<std::is_void<V>::value, T *>::type value(int i) const
   {
     return reinterpret_cast<T*>( values[i - 1]);
   }
+  /*!
+   * @brief Returns the i-th child value (1-based) of a typed Context
+   */
+  template<typename V = Value>
+  typename std::enable_if<!std::is_void<Value>::value && std::is_same<V, Value>::value, const V&>::type value(int i) const
+  {
+    return values[i - 1];
+  }
 };
-template<typename TCHAR>
+/*!
+ * @brief Leaves of one machine reduced together by a batch action
+ *
+ * The symbols are indexed from 0 in input order. They have no children, so
+ * an action only looks at their text.
+ */
+template<typename TCHAR, typename Value>
+class SymbolBatch
+{
+  const ParseContext<TCHAR, Value>& context;
+  const SymbolEntry * const symbols;
+  const int num_symbols;
+public:
+  SymbolBatch(const ParseContext<TCHAR, Value>& context, const SymbolEntry *symbols, int num_symbols)
+    : context(context), symbols(symbols), num_symbols(num_symbols)
+  {
+  }
+  int size() const
+  {
+    return num_symbols;
+  }
+  int worker() const
+  {
+    return context.m_worker;
+  }
+  const TCHAR *start(int i) const
+  {
+    return reinterpret_cast<const TCHAR *>(context.m_window) + symbols[i].start;
+  }
+  const TCHAR *end(int i) const
+  {
+    return reinterpret_cast<const TCHAR *>(context.m_window) + symbols[i].end;
+  }
+  int len(int i) const
+  {
+    return symbols[i].end - symbols[i].start;
+  }
+  TextView<TCHAR> view(int i) const
+  {
+    return TextView<TCHAR>(start(i), end(i));
+  }
+  /*!
+   * @brief Returns the context of the i-th symbol, for its decoders and alloc()
+   */
+  SymbolContext<TCHAR, Value> operator[](int i) const
+  {
+    return SymbolContext<TCHAR, Value>(context, symbols[i], nullptr, 0);
+  }
+};
+template<typename TCHAR, typename Value = void, typename Visitor = void>
+class Session;
+template<typename TCHAR, typename Value, typename Visitor>
+class RecordStream;
+/*!
+ * @brief Compiles a grammar and runs C++ actions on its symbols
+ *
+ * Value is the type of the semantic values. With the default, actions return
+ * void * and values are usually heap-allocated. A trivially copyable Value of
+ * up to 16 bytes is instead passed by value through the reduction stages, so
+ * scalars need no allocation. In a typed Context, a symbol with an action
+ * always has a value and a symbol without one has none.
+ *
+ * With a Visitor, the actions are its members instead; see StaticContext.
+ */
+template<typename TCHAR, typename Value = void, typename Visitor = void>
 class Context
 {
+  friend class Session<TCHAR, Value, Visitor>;
+  friend class RecordStream<TCHAR, Value, Visitor>;
+public:
+  typedef ContextValueTraits<TCHAR, Value> traits_type;
+  typedef typename traits_type::storage_type storage_type;
+  typedef typename traits_type::result_type result_type;
+  typedef typename traits_type::completion_type completion_type;
+private:
+  /*!
+   * @brief Dispatches the reductions to the visitor with a switch over the machine ids
+   *
+   * The switch is generated from the grammar by "centaurus generate-ids",
+   * so the runners call the members of the visitor without an indirect call.
+   */
+  struct static_reduction_traits : ReductionTraits<storage_type>
+  {
+    static bool reduce(typename ReductionTraits<storage_type>::Listener listener, const SymbolEntry *symbol, storage_type *values, int num_values, storage_type& result, void *context)
+    {
+      static_assert(!std::is_void<Value>::value, "The visitor must define a non-void value_type");
+      auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+      SymbolContext<TCHAR, Value> rc(ctx, *symbol, values, num_values);
+      index_symbol(ctx, *symbol, rc);
+      return Visitor::grammar_type::reduce(*static_cast<Visitor *>(ctx.m_visitor), symbol->id, rc, result);
+    }
+  };
+  typedef typename std::conditional<std::is_void<Visitor>::value, ReductionTraits<storage_type>, static_reduction_traits>::type reduction_traits;
+
   Grammar<TCHAR> m_grammar;
+  ParserOptions m_options;
   ParserEM64T<TCHAR> m_parser;
-  std::vector<CppReductionCallback<TCHAR> > m_callbacks;
+  std::unique_ptr<ParserEM64T<TCHAR> > m_refill_parser;
+  std::vector<CppReductionCallback<TCHAR, Value> > m_callbacks;
+  std::vector<CppBatchCallback<TCHAR, Value> > m_batch_callbacks;
+  std::vector<CppFold<TCHAR, Value> > m_folds;
+  //Indexed by machine id; set for folds whose children may be merged in any order
+  std::vector<bool> m_commutative;
+  size_t m_input_size;
+  //Inputs shorter than this many bytes are parsed on the calling thread
+  size_t m_inline_threshold;
+  //Values allocated by the actions during the last parse
+  Arena m_arena;
+  Visitor *m_visitor;
+  std::vector<Aggregator *> m_aggregators;
+  //Indexed by machine id
+  std::vector<bool> m_deferred;
+  std::unique_ptr<TaskPool> m_pool;
+  int m_pool_size;
+  //Tripped by cancel() and by the actions; cleared when a parse starts
+  CancellationToken m_cancellation;
+  //Machine whose values go to m_record_queue while a RecordStream runs
+  int m_record_machine = 0;
+  RecordQueue<storage_type> *m_record_queue = nullptr;
+  detail::IndexHook<TCHAR, Value> m_index_hook = detail::IndexHook<TCHAR, Value>{ 0, nullptr, nullptr, nullptr };
+  //Parser starting from any machine, when m_parser is specialized for a projection
+  std::unique_ptr<ParserEM64T<TCHAR> > m_fragment_parser;
+  void reserve_aggregators(int workers)
+  {
+    for (auto aggregator : m_aggregators)
+      aggregator->reserve(workers);
+  }
+  /*!
+   * @brief Points the parse contexts at the pool, if any action is deferred
+   *
+   * The pool threads take the worker indices after those of the reduction
+   * workers.
+   */
+  template<typename Iterator>
+  void prepare_deferred(Iterator first, Iterator last, int workers)
+  {
+    TaskPool *pool = nullptr;
+    if (std::find(m_deferred.begin(), m_deferred.end(), true) != m_deferred.end())
+    {
+      if (!m_pool)
+        m_pool.reset(new TaskPool(m_pool_size));
+      pool = m_pool.get();
+      pool->set_worker_base(workers);
+    }
+    for (; first != last; ++first)
+    {
+      (*first)->m_pool = pool;
+      (*first)->m_deferred = &m_deferred;
+    }
+    reserve_aggregators(workers + (pool != nullptr ? pool->size() : 0));
+  }
+  /*!
+   * @brief Waits for the deferred actions of the last parse and keeps what they allocated
+   */
+  void finish_deferred()
+  {
+    if (!m_pool)
+      return;
+    Arena arena;
+    m_pool->wait(arena, 0);
+    m_pool->take_arenas(m_arena);
+    m_arena.splice(arena);
+  }
   static long CENTAURUS_CALLBACK callback(const SymbolEntry *symbol, uint64_t *values, int num_values, void *context)
   {
-    auto& ctx = *reinterpret_cast<ParseContext<TCHAR>*>(context);
-    SymbolContext<TCHAR> rc(ctx, *symbol, values, num_values);
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    if (ctx.m_pool != nullptr)
+    {
+      if ((*ctx.m_deferred)[symbol->id])
+        return defer(ctx, *symbol, values, num_values);
+      resolve_values(ctx, values, num_values);
+    }
+    SymbolContext<TCHAR, Value> rc(ctx, *symbol, values, num_values);
+    index_symbol(ctx, *symbol, rc);
     if (symbol->id < ctx.m_callbacks.size() &&
         ctx.m_callbacks[symbol->id] != nullptr)
-      return (long)ctx.m_callbacks[symbol->id](rc);
+    {
+      uint64_t result = reinterpret_cast<uint64_t>(ctx.m_callbacks[symbol->id](rc));
+      box_value(ctx, result);
+      return (long)result;
+    }
     return 0;
   }
+  static bool CENTAURUS_CALLBACK callback(const SymbolEntry *symbol, storage_type *values, int num_values, storage_type *result, void *context)
+  {
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    SymbolContext<TCHAR, Value> rc(ctx, *symbol, values, num_values);
+    index_symbol(ctx, *symbol, rc);
+    if (symbol->id < ctx.m_callbacks.size() &&
+        ctx.m_callbacks[symbol->id] != nullptr)
+    {
+      *result = ctx.m_callbacks[symbol->id](rc);
+      return true;
+    }
+    return false;
+  }
+  static void CENTAURUS_CALLBACK batch_callback(const SymbolEntry *symbols, int num_symbols, storage_type *results, void *context)
+  {
+    static_assert(sizeof(storage_type) == sizeof(result_type), "Results must be written in place");
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    SymbolBatch<TCHAR, Value> batch(ctx, symbols, num_symbols);
+    if (ctx.m_index != nullptr && ctx.m_index->machine == symbols[0].id)
+    {
+      for (int i = 0; i < num_symbols; i++)
+        index_symbol(ctx, symbols[i], batch[i]);
+    }
+    ctx.m_batch_callbacks[symbols[0].id](batch, reinterpret_cast<result_type *>(results));
+    if (ctx.m_pool != nullptr)
+    {
+      for (int i = 0; i < num_symbols; i++)
+        box_value(ctx, results[i]);
+    }
+  }
+  /*!
+   * @brief Adds the symbol to the index being built if it is of the indexed machine
+   */
+  static void index_symbol(const ParseContext<TCHAR, Value>& ctx, const SymbolEntry& symbol, const SymbolContext<TCHAR, Value>& rc)
+  {
+    const detail::IndexHook<TCHAR, Value> *hook = ctx.m_index;
+    if (hook == nullptr || hook->machine != symbol.id)
+      return;
+    if (hook->builder != nullptr)
+      hook->builder->add(ctx.m_worker, hook->key != nullptr ? hook->key(rc) : 0, symbol.start, symbol.end);
+    if (hook->ends != nullptr)
+      hook->ends->add(ctx.m_worker, symbol.end);
+  }
+  /*!
+   * @brief Replaces the deferred values among values with their results, waiting for them if needed
+   *
+   * While waiting, the thread runs queued deferred actions itself.
+   */
+  static void resolve_values(ParseContext<TCHAR, Value>& ctx, uint64_t *values, int num_values)
+  {
+    for (int i = 0; i < num_values; i++)
+    {
+      if ((values[i] & detail::DEFERRED_TAG) == 0)
+        continue;
+      auto *deferred = reinterpret_cast<detail::DeferredValue *>(values[i] & ~detail::DEFERRED_TAG);
+      while (!deferred->ready.load(std::memory_order_acquire))
+      {
+        if (!ctx.m_pool->run_one(*ctx.m_arena, ctx.m_worker))
+          std::this_thread::yield();
+      }
+      values[i] = deferred->value;
+    }
+  }
+  //Typed values cannot be deferred
+  template<typename T>
+  static void resolve_values(ParseContext<TCHAR, Value>& ctx, T *values, int num_values)
+  {
+  }
+  /*!
+   * @brief Stores a value with the tag bit set as a ready deferred value, while actions are deferred
+   *
+   * resolve_values() gives the value back unchanged.
+   */
+  static void box_value(ParseContext<TCHAR, Value>& ctx, uint64_t& value)
+  {
+    if (ctx.m_pool == nullptr || (value & detail::DEFERRED_TAG) == 0)
+      return;
+    auto *boxed = ctx.m_arena->template create<detail::DeferredValue>();
+    boxed->value = value;
+    boxed->ready.store(true, std::memory_order_relaxed);
+    value = reinterpret_cast<uintptr_t>(boxed) | detail::DEFERRED_TAG;
+  }
+  template<typename T>
+  static void box_value(ParseContext<TCHAR, Value>& ctx, T& value)
+  {
+  }
+  /*!
+   * @brief Submits the action of the symbol to the pool and returns the deferred value standing for it
+   *
+   * The symbol and its values live in the stacks of the runner, so they are
+   * copied into its arena first.
+   */
+  static long defer(ParseContext<TCHAR, Value>& ctx, const SymbolEntry& symbol, uint64_t *values, int num_values)
+  {
+    Arena& arena = *ctx.m_arena;
+    auto *deferred = arena.template create<detail::DeferredValue>();
+    uint64_t *args = static_cast<uint64_t *>(arena.allocate(std::max(num_values, 1) * sizeof(uint64_t), alignof(uint64_t)));
+    std::copy(values, values + num_values, args);
+    TokenSpan *spans = nullptr;
+    if (symbol.num_spans > 0)
+    {
+      spans = static_cast<TokenSpan *>(arena.allocate(symbol.num_spans * sizeof(TokenSpan), alignof(TokenSpan)));
+      std::copy(symbol.spans, symbol.spans + symbol.num_spans, spans);
+    }
+    SymbolEntry entry(symbol.id, symbol.start, symbol.end, spans, symbol.num_spans);
+    const void *window = ctx.m_window;
+    ParseContext<TCHAR, Value> *parent = &ctx;
+    ctx.m_pool->submit([=](Arena& task_arena, int worker) {
+      ParseContext<TCHAR, Value> task_ctx(parent->m_callbacks, parent->m_batch_callbacks, parent->m_folds, window, parent->m_visitor, worker);
+      task_ctx.m_arena = &task_arena;
+      task_ctx.m_pool = parent->m_pool;
+      task_ctx.m_deferred = parent->m_deferred;
+      resolve_values(task_ctx, args, num_values);
+      SymbolContext<TCHAR, Value> rc(task_ctx, entry, args, num_values);
+      deferred->value = reinterpret_cast<uint64_t>(task_ctx.m_callbacks[entry.id](rc));
+      deferred->ready.store(true, std::memory_order_release);
+    });
+    return static_cast<long>(reinterpret_cast<uintptr_t>(deferred) | detail::DEFERRED_TAG);
+  }
+  static void CENTAURUS_CALLBACK fold_callback(int id, FoldStep step, storage_type *acc, const storage_type *value, void *context)
+  {
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    const CppFold<TCHAR, Value>& fold = ctx.m_folds[id];
+    result_type& result = reinterpret_cast<result_type&>(*acc);
+    switch (step)
+    {
+    case FoldStep::Init:
+      result = fold.init();
+      break;
+    case FoldStep::Accumulate:
+      if (ctx.m_pool != nullptr)
+      {
+        storage_type child = *value;
+        resolve_values(ctx, &child, 1);
+        resolve_values(ctx, acc, 1);
+        fold.accumulate(result, reinterpret_cast<const result_type&>(child));
+        break;
+      }
+      fold.accumulate(result, reinterpret_cast<const result_type&>(*value));
+      break;
+    case FoldStep::Merge:
+      if (ctx.m_pool != nullptr)
+      {
+        storage_type partial = *value;
+        resolve_values(ctx, &partial, 1);
+        resolve_values(ctx, acc, 1);
+        fold.merge(result, reinterpret_cast<const result_type&>(partial));
+        break;
+      }
+      fold.merge(result, reinterpret_cast<const result_type&>(*value));
+      break;
+    }
+    //The accumulator is handed to the parent as a value
+    box_value(ctx, *acc);
+  }
+  /*!
+   * @brief Registers the actions with a reduction runner
+   *
+   * The runners of a session share pool, where commutative folds merge
+   * their partial accumulators.
+   */
+  template<typename Runner>
+  void register_listeners(Runner& runner, FoldPool<storage_type> *pool = nullptr)
+  {
+    runner.register_listener(callback);
+
+    std::vector<bool> batched(m_batch_callbacks.size());
+    for (size_t i = 0; i < batched.size(); i++)
+      batched[i] = m_batch_callbacks[i] != nullptr;
+    if (std::find(batched.begin(), batched.end(), true) != batched.end())
+      runner.register_batch_listener(batch_callback, batched);
+
+    std::vector<bool> folded(m_folds.size());
+    for (size_t i = 0; i < folded.size(); i++)
+      folded[i] = m_folds[i].init != nullptr;
+    if (std::find(folded.begin(), folded.end(), true) != folded.end())
+    {
+      std::vector<int> parents = m_grammar.get_parent_ids();
+      for (auto& parent : parents)
+      {
+        if (!folded[parent])
+          parent = 0;
+      }
+      runner.register_fold_listener(fold_callback, folded, parents);
+      if (pool != nullptr)
+        runner.register_fold_pool(pool, m_commutative);
+    }
+  }
+  static void CENTAURUS_CALLBACK input_callback(int input, const void *window, void *context)
+  {
+    reinterpret_cast<ParseContext<TCHAR, Value>*>(context)->m_window = window;
+  }
+  static void CENTAURUS_CALLBACK completion_callback(int input, bool accepted, uint64_t value, void *context)
+  {
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    if (ctx.m_completion != nullptr)
+      ctx.m_completion(input, accepted, reinterpret_cast<void *>(value), ctx.m_completion_user);
+  }
+  static void CENTAURUS_CALLBACK completion_callback(int input, bool accepted, const storage_type *value, void *context)
+  {
+    auto& ctx = *reinterpret_cast<ParseContext<TCHAR, Value>*>(context);
+    if (ctx.m_completion != nullptr)
+      ctx.m_completion(input, accepted, *value, ctx.m_completion_user);
+  }
+  IParser *get_parser(bool streaming)
+  {
+    if (!streaming)
+      return &m_parser;
+    if (!m_refill_parser)
+    {
+      ParserOptions options = m_options;
+      options.refill_input = true;
+      m_refill_parser.reset(new ParserEM64T<TCHAR>(m_grammar, NULL, NULL, options));
+    }
+    return m_refill_parser.get();
+  }
+  //Window of the runners of one pipeline, so that several coexist in a process
+  static int next_channel()
+  {
+    static std::atomic<int> counter(0);
+    return ++counter;
+  }
+  bool is_inline(const Input& input) const
+  {
+    return !input.is_streaming() && input.get_length() < m_inline_threshold;
+  }
+  static double measure(const std::function<void()>& fn, int repeat)
+  {
+    double best = HUGE_VAL;
+    for (int i = 0; i < repeat; i++)
+    {
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      auto end = std::chrono::steady_clock::now();
+      best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+  }
+  /*!
+   * @brief Parses the input on the calling thread with parser, from the machine entry or the root if 0
+   *
+   * A fragment parsed from another machine is not indexed. With
+   * expected_end, the fragment must end there.
+   */
+  result_type run_inline(IParser *parser, Input& input, Tape *tape, int entry, const void *expected_end)
+  {
+    m_cancellation.reset();
+    ParseContext<TCHAR, Value> context(m_callbacks, m_batch_callbacks, m_folds, input.get_buffer(), m_visitor);
+    context.m_cancellation = &m_cancellation;
+    context.m_index = (entry == 0) ? &m_index_hook : nullptr;
+    ParseContext<TCHAR, Value> *contexts[] = { &context };
+    prepare_deferred(contexts, contexts + 1, 1);
+    BasicInlineRunner<storage_type, reduction_traits> runner(input, parser, &context);
+
+    context.m_arena = &runner.get_arena();
+    register_listeners(runner);
+    runner.enable_tape(tape != nullptr);
+    runner.set_cancellation(&m_cancellation);
+    runner.set_record_queue(m_record_machine, m_record_queue);
+    runner.set_entry(entry);
+
+    bool accepted = runner.run();
+    storage_type result = runner.get_result();
+    if (accepted && context.m_pool != nullptr)
+      resolve_values(context, &result, 1);
+
+    m_arena = runner.take_result_arena();
+    finish_deferred();
+    if (!accepted)
+      throw SimpleException(m_cancellation.cancelled() ? "Parse cancelled" : "Input rejected by the parser");
+    if (expected_end != nullptr && runner.get_end() != expected_end)
+      throw SimpleException("The record does not match the index");
+
+    if (tape != nullptr)
+      *tape = runner.take_tape();
+    m_input_size = input.get_length();
+    return traits_type::to_result(result);
+  }
+  //Lines handed to a worker of parse_lines() at a time
+  static constexpr size_t LINE_BATCH = 256;
+  //Zero bytes after the copy of a line, which terminate it and absorb the 16-byte reads of the parser past its end
+  static constexpr size_t LINE_PADDING = 16;
+  /*!
+   * @brief Lines of an input shared by the workers of parse_lines()
+   */
+  struct LineJob
+  {
+    std::vector<std::pair<const TCHAR *, const TCHAR *> > lines;
+    //Results of the lines, kept for in-order delivery
+    std::vector<storage_type> values;
+    std::vector<char> accepted;
+    std::atomic<size_t> next_batch;
+    std::mutex mutex;
+    std::condition_variable batch_done;
+    std::vector<char> done;
+    //Thrown by an action; stops the other workers
+    std::exception_ptr error;
+    completion_type callback;
+    void *user;
+    bool ordered;
+  };
+  static const char *find_newline(const char *first, const char *last)
+  {
+    return detail::find_char(first, last, '\n');
+  }
+  template<typename T>
+  static const T *find_newline(const T *first, const T *last)
+  {
+    return std::find(first, last, static_cast<T>('\n'));
+  }
+  /*!
+   * @brief Collects the non-empty lines of the buffer, without their line breaks
+   */
+  static void split_lines(const TCHAR *first, const TCHAR *last, std::vector<std::pair<const TCHAR *, const TCHAR *> >& lines)
+  {
+    while (first != last)
+    {
+      const TCHAR *newline = find_newline(first, last);
+      const TCHAR *end = newline;
+      if (end != first && end[-1] == static_cast<TCHAR>('\r'))
+        end--;
+      if (end != first)
+        lines.emplace_back(first, end);
+      first = (newline == last) ? last : newline + 1;
+    }
+  }
+  /*!
+   * @brief Parses batches of lines of the job on the calling thread until there are none left
+   */
+  void parse_line_batches(const Input& input, LineJob& job, int worker, Arena& arena)
+  {
+    ParseContext<TCHAR, Value> context(m_callbacks, m_batch_callbacks, m_folds, input.get_buffer(), m_visitor, worker);
+    context.m_cancellation = &m_cancellation;
+    BasicInlineRunner<storage_type, reduction_traits> runner(input, &m_parser, &context);
+
+    context.m_arena = &runner.get_arena();
+    register_listeners(runner);
+    runner.set_cancellation(&m_cancellation);
+
+    const size_t batches = job.done.size();
+    size_t batch;
+    while ((batch = job.next_batch++) < batches)
+    {
+      //Once cancelled, the batches left are only marked done
+      if (!m_cancellation.cancelled())
+      {
+        try
+        {
+          parse_line_batch(job, batch, runner, context, arena);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(job.mutex);
+          if (!job.error)
+            job.error = std::current_exception();
+          m_cancellation.cancel();
+        }
+      }
+      std::lock_guard<std::mutex> lock(job.mutex);
+      job.done[batch] = 1;
+      job.batch_done.notify_all();
+    }
+  }
+  void parse_line_batch(LineJob& job, size_t batch, BasicInlineRunner<storage_type, reduction_traits>& runner, ParseContext<TCHAR, Value>& context, Arena& arena)
+  {
+    size_t last = std::min(job.lines.size(), (batch + 1) * LINE_BATCH);
+    for (size_t i = batch * LINE_BATCH; i < last; i++)
+    {
+      //The parser would go on into the next line after a line break, as it
+      //is whitespace, so it parses a terminated copy kept with the values
+      size_t length = (job.lines[i].second - job.lines[i].first) * sizeof(TCHAR);
+      char *copy = static_cast<char *>(arena.allocate(length + LINE_PADDING, 16));
+      std::memcpy(copy, job.lines[i].first, length);
+      std::memset(copy + length, 0, LINE_PADDING);
+      MemoryInput line(copy, length);
+      runner.set_input(line);
+      context.m_window = copy;
+
+      bool accepted = runner.run();
+      storage_type value = accepted ? runner.get_result() : storage_type();
+      Arena values = runner.take_result_arena();
+      arena.splice(values);
+      if (job.ordered)
+      {
+        job.values[i] = value;
+        job.accepted[i] = accepted;
+      }
+      else
+      {
+        job.callback(static_cast<int>(i), accepted, traits_type::to_result(value), job.user);
+      }
+    }
+  }
+  IParser *get_fragment_parser()
+  {
+    if (m_options.projection.empty())
+      return &m_parser;
+    if (!m_fragment_parser)
+    {
+      ParserOptions options = m_options;
+      options.projection.clear();
+      m_fragment_parser.reset(new ParserEM64T<TCHAR>(m_grammar, NULL, NULL, options));
+    }
+    return m_fragment_parser.get();
+  }
+  int find_machine(const std::string& name) const
+  {
+    for (const auto& p : m_grammar.get_machines())
+    {
+      if (p.first.narrow() == name)
+        return m_grammar.get_machine_id(p.first);
+    }
+    throw SimpleException("Unknown machine " + name);
+  }
+  /*!
+   * @brief Parses the input for a RecordStream, throwing SimpleException if it is rejected
+   */
+  void parse_records(Input& input, int worker_num)
+  {
+    if (is_inline(input))
+    {
+      parse_inline(input);
+      return;
+    }
+    Session<TCHAR, Value, Visitor> session(*this, worker_num);
+
+    session.parse(input, true);
+
+    m_input_size = session.get_input_size();
+  }
 public:
-    Context(const char *filename)
+    static constexpr size_t DEFAULT_INLINE_THRESHOLD = 64 * 1024;
+
+    /*!
+     * @brief Compiles the grammar
+     *
+     * With ParserOptions::explicit_stack, nesting depth is bounded by
+     * options.max_nesting_depth instead of the stack of the parser thread,
+     * which then needs only a small stack.
+     */
+    Context(const char *filename, const ParserOptions& options = ParserOptions())
+        : m_options(options), m_input_size(0), m_inline_threshold(DEFAULT_INLINE_THRESHOLD), m_visitor(nullptr),
+        m_pool_size(std::max(1u, std::thread::hardware_concurrency()))
     {
         /*std::wifstream grammar_file(filename, std::ios::in);
 
@@ -83,52 +943,969 @@ public:
 
         m_grammar.parse(filename);
 
-        m_parser.init(m_grammar);
+        m_parser.init(m_grammar, NULL, NULL, m_options);
 
         m_callbacks.resize(m_grammar.get_machine_num() + 1, nullptr);
+        m_batch_callbacks.resize(m_grammar.get_machine_num() + 1, nullptr);
+        m_folds.resize(m_grammar.get_machine_num() + 1, CppFold<TCHAR, Value>{ nullptr, nullptr, nullptr });
+        m_commutative.resize(m_grammar.get_machine_num() + 1, false);
+        m_deferred.resize(m_grammar.get_machine_num() + 1, false);
+    }
+    /*!
+     * @brief Compiles the grammar and reduces the symbols with the members of visitor
+     *
+     * The members are called from several workers at once. Throws
+     * SimpleException if Visitor::grammar_type was generated from another
+     * version of the grammar, whose machine ids may differ.
+     */
+    template<typename V = Visitor, typename = typename std::enable_if<!std::is_void<V>::value && std::is_same<V, Visitor>::value>::type>
+    Context(const char *filename, V& visitor, const ParserOptions& options = ParserOptions())
+        : Context(filename, options)
+    {
+        if (V::grammar_type::GRAMMAR_HASH != m_grammar.get_hash())
+            throw SimpleException("The ids of the visitor were generated from another grammar");
+        m_visitor = &visitor;
     }
+    /*!
+     * @brief Parses the file with worker_num reduction workers
+     *
+     * Files compressed with gzip or zstd are detected by their magic bytes and
+     * decompressed by a separate thread while they are being parsed.
+     */
     void parse(const char *input_path, int worker_num)
     {
-        int pid = get_current_pid();
+        std::unique_ptr<Input> input(open_input(input_path));
 
-        ParseContext<TCHAR> context{m_callbacks, nullptr};
+        parse(*input, worker_num);
+    }
+    /*!
+     * @brief Parses an input owned by the caller
+     *
+     * Inputs below the inline threshold are parsed on the calling thread
+     * without starting the pipeline. Either way, throws SimpleException if
+     * the input is rejected or the parse is cancelled.
+     */
+    void parse(Input& input, int worker_num)
+    {
+        if (is_inline(input))
+        {
+            parse_inline(input);
+            return;
+        }
+        Session<TCHAR, Value, Visitor> session(*this, worker_num);
 
-        std::vector<BaseRunner *> runners;
-        runners.push_back(new Stage1Runner{ input_path, &m_parser, 8 * 1024 * 1024, worker_num * 2 });
-        for (int i = 0; i < worker_num; i++)
+        session.parse(input);
+
+        m_input_size = session.get_input_size();
+    }
+    /*!
+     * @brief Parses the input on the calling thread and returns the value of the root symbol
+     *
+     * Throws SimpleException if the input is rejected. If tape is given, the
+     * CST of the input is laid out into it.
+     */
+    result_type parse_inline(Input& input, Tape *tape = nullptr)
+    {
+        return run_inline(&m_parser, input, tape, 0, nullptr);
+    }
+    /*!
+     * @brief Parses a symbol of the machine at the start of the input on the calling thread and returns its value
+     *
+     * This parses a fragment of a larger document, such as a single value
+     * or element, with the actions attached as usual. Throws
+     * SimpleException if the input is rejected.
+     */
+    result_type parse_fragment(Input& input, const Identifier& id)
+    {
+        return run_inline(get_fragment_parser(), input, nullptr, m_grammar.get_machine_id(id), nullptr);
+    }
+    /*!
+     * @brief Parses one record of an index on the calling thread and returns its value
+     *
+     * input must be the input the index was built from. Only the record and
+     * the symbols under it are reduced, by the actions attached as usual, so
+     * this costs time in the size of the record. Throws SimpleException if
+     * the input does not match the index.
+     */
+    result_type parse_record(Input& input, const RecordIndex& index, const RecordIndexEntry& entry)
+    {
+        if (input.is_streaming() || input.get_length() != index.input_length() ||
+            entry.start > entry.end || entry.end * sizeof(TCHAR) > input.get_length())
+            throw SimpleException("The input does not match the index");
+        const TCHAR *buffer = static_cast<const TCHAR *>(input.get_buffer());
+        MemoryInput record(reinterpret_cast<const char *>(buffer + entry.start), (entry.end - entry.start) * sizeof(TCHAR));
+
+        return run_inline(get_fragment_parser(), record, nullptr, find_machine(index.machine()), buffer + entry.end);
+    }
+    /*!
+     * @brief Parses the input and lays its CST out as a Tape
+     *
+     * The actions run as they do in parse(). The tape holds offsets into the
+     * input, so the input must outlive it for the text of the nodes to be
+     * read. Throws SimpleException if the input is rejected.
+     */
+    Tape parse_tape(Input& input, int worker_num)
+    {
+        Tape tape;
+        if (is_inline(input))
         {
-            Stage2Runner *st2 = new Stage2Runner{input_path, 8 * 1024 * 1024, worker_num * 2, pid, static_cast<void *>(&context) };
+            parse_inline(input, &tape);
+            return tape;
+        }
+        Session<TCHAR, Value, Visitor> session(*this, worker_num);
 
-            st2->register_listener(callback);
+        tape = session.parse_tape(input);
 
-            runners.push_back(st2);
+        m_input_size = session.get_input_size();
+        return tape;
+    }
+    /*!
+     * @brief Parses the files one after another without draining the pipeline in between
+     *
+     * callback is called from the Stage3 thread once per file, in order.
+     * Values allocated with SymbolContext::alloc() for a file are released
+     * after the next file completes, so the callback must copy out whatever
+     * it keeps.
+     */
+    void parse_batch(const std::vector<std::string>& input_paths, int worker_num, completion_type callback, void *user = nullptr)
+    {
+        Session<TCHAR, Value, Visitor> session(*this, worker_num);
+
+        session.parse_batch(input_paths, callback, user);
+    }
+    /*!
+     * @brief Parses each line of the input as a document of its own, on worker_num threads
+     *
+     * This is meant for inputs such as JSON Lines, whose lines are records
+     * that the root machine parses one at a time. The line breaks are found
+     * first, then the workers take the lines in batches, so the parsing
+     * scales with the workers. A trailing carriage return is not part of a
+     * line, and empty lines are skipped. callback receives the index of each
+     * line among the non-empty ones, whether it was accepted, and its value.
+     * If ordered, it is called on the calling thread in line order;
+     * otherwise it is called from the workers as soon as each line is
+     * parsed, so it must be thread-safe. The values stay valid until the
+     * next parse. Each line is parsed from a terminated copy, which stays
+     * valid as long as the values, so the actions never see the text of
+     * the next line. Lines are parsed on threads with the default stack, so
+     * deeply nested lines need ParserOptions::explicit_stack. No action may
+     * be deferred.
+     */
+    void parse_lines(Input& input, int worker_num, completion_type callback, void *user = nullptr, bool ordered = true)
+    {
+        if (input.is_streaming())
+            throw SimpleException("Lines can only be split in a complete input");
+        if (std::find(m_deferred.begin(), m_deferred.end(), true) != m_deferred.end())
+            throw SimpleException("Lines cannot be parsed in parallel with deferred actions");
+        worker_num = std::max(worker_num, 1);
+        m_cancellation.reset();
+
+        LineJob job;
+        const TCHAR *buffer = static_cast<const TCHAR *>(input.get_buffer());
+        split_lines(buffer, buffer + input.get_length() / sizeof(TCHAR), job.lines);
+        job.next_batch = 0;
+        job.done.assign((job.lines.size() + LINE_BATCH - 1) / LINE_BATCH, 0);
+        job.callback = callback;
+        job.user = user;
+        job.ordered = ordered;
+        if (ordered)
+        {
+            job.values.resize(job.lines.size());
+            job.accepted.resize(job.lines.size());
+        }
+        reserve_aggregators(worker_num);
+
+        std::vector<Arena> arenas(worker_num);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < worker_num; i++)
+        {
+            workers.emplace_back([this, &input, &job, &arenas, i]() { parse_line_batches(input, job, i, arenas[i]); });
+        }
+        //Thrown by the callback, after which the workers are stopped
+        std::exception_ptr error;
+        if (ordered)
+        {
+            try
+            {
+                for (size_t batch = 0; batch < job.done.size(); batch++)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(job.mutex);
+                        job.batch_done.wait(lock, [&]() { return job.done[batch] != 0; });
+                    }
+                    if (m_cancellation.cancelled())
+                        break;
+                    size_t last = std::min(job.lines.size(), (batch + 1) * LINE_BATCH);
+                    for (size_t i = batch * LINE_BATCH; i < last; i++)
+                        callback(static_cast<int>(i), job.accepted[i] != 0, traits_type::to_result(job.values[i]), user);
+                }
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+                m_cancellation.cancel();
+            }
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
         }
-        Stage3Runner *st3 = new Stage3Runner{ input_path, 8 * 1024 * 1024, worker_num * 2, pid, static_cast<void *>(&context) };
 
-        st3->register_listener(callback);
+        m_arena = Arena();
+        for (auto& arena : arenas)
+        {
+            m_arena.splice(arena);
+        }
+        m_input_size = input.get_length();
+        if (!error)
+            error = job.error;
+        if (error)
+            std::rethrow_exception(error);
+        if (m_cancellation.cancelled())
+            throw SimpleException("Parse cancelled");
+    }
+    /*!
+     * @brief Starts parsing the input on a separate thread and returns the values of the records as they are reduced
+     *
+     * The values of the symbols of the machine id are taken out of the tree
+     * and handed to the stream in input order, so they do not reach their
+     * parents. At most capacity of them wait in the stream; when it is full,
+     * the reduction stalls and so does the parser. The symbols of the machine
+     * must not nest, and no action may be deferred. The input and the context
+     * must not be used until the stream is destroyed, and the values it
+     * allocated stay valid until the next parse.
+     */
+    std::unique_ptr<RecordStream<TCHAR, Value, Visitor> > stream(Input& input, const Identifier& id, int worker_num, size_t capacity = 1024)
+    {
+        if (m_grammar.get_machines().count(id) == 0)
+            throw SimpleException("Unknown record machine " + id.narrow());
+        if (m_grammar.is_nesting(id))
+            throw SimpleException("Records of " + id.narrow() + " may nest");
+        if (std::find(m_deferred.begin(), m_deferred.end(), true) != m_deferred.end())
+            throw SimpleException("Records cannot be streamed with deferred actions");
+        return std::unique_ptr<RecordStream<TCHAR, Value, Visitor> >(new RecordStream<TCHAR, Value, Visitor>(*this, input, m_grammar.get_machine_id(id), worker_num, capacity));
+    }
+    /*!
+     * @brief Parses what was appended to the input since checkpoint and moves checkpoint past the last record reduced
+     *
+     * The root must be a repetition of the records of the machine id, such
+     * as the lines of a log, so that the input after a record parses as a
+     * document of its own. The actions run for the new records only; the
+     * root action, if any, sees them as its only children. A record still
+     * being written makes the parse rejected where it breaks off: the
+     * records before it are reduced all the same, the root action does not
+     * run, and the next call starts over at the end of the last record. For
+     * that, a record must end with a token that closes it, such as the
+     * closing brace of a JSON object, so that it cannot grow once it is
+     * reduced. If the input no longer matches the checkpoint, it is parsed
+     * from the beginning. Returns true if the whole of the new text was
+     * accepted.
+     */
+    bool parse_appended(Input& input, const Identifier& id, IncrementalCheckpoint& checkpoint, int worker_num)
+    {
+        if (m_grammar.get_machines().count(id) == 0)
+            throw SimpleException("Unknown record machine " + id.narrow());
+        int machine = m_grammar.get_machine_id(id);
+        if (m_grammar.get_parent_ids()[machine] != m_grammar.get_machine_id(m_grammar.get_root_id()) || m_grammar.is_nesting(id))
+            throw SimpleException("Records of " + id.narrow() + " must only occur directly under the root");
+        if (input.is_streaming())
+            throw SimpleException("An input parsed incrementally must be complete");
+        if (!checkpoint.machine().empty() && checkpoint.machine() != id.narrow())
+            throw SimpleException("The checkpoint was taken for records of " + checkpoint.machine());
+        const char *buffer = static_cast<const char *>(input.get_buffer());
+        if (!checkpoint.matches(buffer, input.get_length()))
+            checkpoint.reset();
+        m_input_size = input.get_length();
+        if (checkpoint.offset() == input.get_length())
+            return true;
 
-        runners.push_back(st3);
+        MemoryInput appended(buffer + checkpoint.offset(), input.get_length() - checkpoint.offset());
+        Max<uint64_t> ends;
+        detail::IndexHook<TCHAR, Value> index_hook = m_index_hook;
+        m_index_hook = detail::IndexHook<TCHAR, Value>{ machine, nullptr, nullptr, &ends };
+        attach_aggregator(ends);
+        bool accepted;
+        try
+        {
+            Session<TCHAR, Value, Visitor> session(*this, worker_num);
+            session.set_boundary_machine(machine);
 
-        context.m_window = st3->get_input();
+            session.parse_prefix(appended);
 
-        for (auto p : runners)
+            accepted = session.accepted();
+        }
+        catch (...)
         {
-            p->start();
+            //ends goes out of scope with the exception
+            m_aggregators.pop_back();
+            m_index_hook = index_hook;
+            throw;
         }
-        for (auto p : runners)
+        m_aggregators.pop_back();
+        m_index_hook = index_hook;
+
+        //Records are reduced in input order up to where the parse stopped
+        if (ends.value() != 0)
+            checkpoint.advance(id.narrow(), buffer, checkpoint.offset() + ends.value() * sizeof(TCHAR));
+        if (m_cancellation.cancelled())
+            throw SimpleException("Parse cancelled");
+        return accepted;
+    }
+    /*!
+     * @brief Parses the input without running the actions and returns the CST markers the parser wrote
+     *
+     * Write the dump to a file to replay it later, possibly with other
+     * actions attached, without parsing the input again.
+     */
+    CSTDump dump(Input& input)
+    {
+        m_cancellation.reset();
+        CSTDump dump(m_grammar.get_hash());
+        Stage1Runner runner{ input, get_parser(input.is_streaming()), 8 * 1024 * 1024, 2, true, false, next_channel() };
+        runner.set_cancellation(&m_cancellation);
+        runner.set_dump(&dump);
+
+        runner.start();
+        runner.wait();
+
+        m_input_size = input.wait();
+        const char *end = static_cast<const char *>(runner.get_result());
+        dump.finish(m_input_size, end != nullptr ? end - static_cast<const char *>(input.get_buffer()) : detail::CST_DUMP_REJECTED);
+        return dump;
+    }
+    /*!
+     * @brief Runs the actions over a dump of the input instead of parsing it, with worker_num reduction workers
+     *
+     * The actions see the same symbols as in parse(), so the reduction
+     * stages can be timed on their own. Throws SimpleException if the dump
+     * was taken with another grammar or from an input of another length.
+     */
+    void replay(Input& input, const CSTDump& dump, int worker_num)
+    {
+        if (dump.grammar_hash() != m_grammar.get_hash())
+            throw SimpleException("The CST dump was taken with another grammar");
+        if (input.is_streaming() || input.get_length() != dump.input_length())
+            throw SimpleException("The input does not match the CST dump");
+        Session<TCHAR, Value, Visitor> session(*this, worker_num);
+
+        session.replay(input, dump);
+
+        m_input_size = session.get_input_size();
+    }
+    /*!
+     * @brief Returns the length of the text parsed by the last call to parse()
+     */
+    size_t get_input_size() const
+    {
+        return m_input_size;
+    }
+    /*!
+     * @brief Stops the parse in flight, from any thread
+     *
+     * The parser rejects the input once it fills its current bank, the
+     * reduction workers finish the banks already handed to them, and the
+     * parse throws SimpleException("Parse cancelled"). In a batch, the
+     * remaining inputs are rejected as well. Has no effect on a parse that
+     * starts afterwards.
+     */
+    void cancel()
+    {
+        m_cancellation.cancel();
+    }
+    /*!
+     * @brief Returns true if the last parse was cancelled
+     */
+    bool cancelled() const
+    {
+        return m_cancellation.cancelled();
+    }
+    /*!
+     * @brief Takes the values allocated by the actions of the last parse
+     *
+     * They are otherwise released when the next parse finishes.
+     */
+    Arena take_result_arena()
+    {
+        return std::move(m_arena);
+    }
+    void set_inline_threshold(size_t threshold)
+    {
+        m_inline_threshold = threshold;
+    }
+    size_t get_inline_threshold() const
+    {
+        return m_inline_threshold;
+    }
+    /*!
+     * @brief Sets the inline threshold to where the pipeline starts paying off
+     *
+     * Each sample is parsed inline and through a session with worker_num
+     * workers. The threshold is placed between the largest sample still faster
+     * inline and the next larger one. If the largest sample is still faster
+     * inline, the threshold is placed just above it: nothing is known about
+     * larger inputs, which also need the deep stack of the Stage1 thread. The
+     * samples should be representative of the production inputs and span the
+     * expected size range.
+     */
+    size_t calibrate_inline_threshold(const std::vector<std::string>& sample_paths, int worker_num, int repeat = 5)
+    {
+        std::vector<std::pair<size_t, bool> > results;
+        Session<TCHAR, Value, Visitor> session(*this, worker_num);
+
+        for (const auto& path : sample_paths)
         {
-            p->wait();
+            MappedFileInput input(path.c_str());
+            if (input.get_buffer() == NULL)
+                throw SimpleException(std::string("Cannot open sample file ") + path);
+
+            double inline_time = measure([&]{ parse_inline(input); }, repeat);
+            double pipeline_time = measure([&]{ session.parse(input, true); }, repeat);
+
+            results.emplace_back(input.get_length(), inline_time <= pipeline_time);
         }
-        for (auto p : runners)
+        std::sort(results.begin(), results.end());
+
+        size_t threshold = 0;
+        for (size_t i = 0; i < results.size(); i++)
         {
-            delete p;
+            if (!results[i].second)
+                continue;
+            threshold = (i + 1 < results.size()) ? (results[i].first + results[i + 1].first) / 2 + 1 : results[i].first + 1;
         }
+        m_inline_threshold = threshold;
+        return threshold;
     }
-    void attach(const Identifier& id, CppReductionCallback<TCHAR> callback)
+    void attach(const Identifier& id, CppReductionCallback<TCHAR, Value> callback)
     {
         int index = m_grammar.get_machine_id(id);
 
         m_callbacks[index] = callback;
+        m_deferred[index] = false;
+    }
+    /*!
+     * @brief Attaches an action run on a separate thread pool
+     *
+     * The reduction worker only copies the symbol and its values and moves
+     * on; the action runs later on the pool, or on a thread that needs its
+     * value and runs it rather than wait. The parent actions receive its
+     * result like any other value, but a null result still counts as a
+     * value. Meant for expensive actions whose result is consumed much
+     * later, if at all. Batch parses run them in place. Only the untyped
+     * Context can defer actions.
+     */
+    void attach_deferred(const Identifier& id, CppReductionCallback<TCHAR, Value> callback)
+    {
+        static_assert(std::is_void<Value>::value, "Only pointer values can be deferred");
+        int index = m_grammar.get_machine_id(id);
+
+        if (m_index_hook.machine == index)
+            throw SimpleException("An indexed machine cannot be deferred");
+        m_callbacks[index] = callback;
+        m_deferred[index] = true;
+    }
+    /*!
+     * @brief Sets the number of threads running the deferred actions
+     *
+     * Defaults to the number of hardware threads.
+     */
+    void set_deferred_threads(int thread_num)
+    {
+        m_pool_size = thread_num;
+        m_pool.reset();
+    }
+    /*!
+     * @brief Attaches an action run on many leaves of the symbol at once
+     *
+     * Each reduction worker collects the occurrences of the symbol without
+     * children in a bank and passes them in one call, which writes one value
+     * per symbol into results. Tight loops over short terminals such as
+     * numbers then avoid a call per symbol. Occurrences with children still
+     * go to the action attached with attach().
+     */
+    void attach_batch(const Identifier& id, CppBatchCallback<TCHAR, Value> callback)
+    {
+        int index = m_grammar.get_machine_id(id);
+
+        m_batch_callbacks[index] = callback;
+    }
+    /*!
+     * @brief Folds the children of the symbol into an accumulator as they are reduced
+     *
+     * For long repetitions such as the records of a document, the children
+     * are not kept until the symbol is complete. Each worker folds the
+     * children it reduces into an accumulator, and the partial accumulators
+     * of consecutive banks are merged in order. The action attached with
+     * attach() then receives the accumulator as its only value; without one,
+     * the accumulator is the value of the symbol.
+     *
+     * A commutative fold does not care about the order of the children. Its
+     * workers pool their partial accumulators as soon as a bank is reduced,
+     * so Stage3 does not have to merge them in bank order; it merges those
+     * of the banks up to the end of each occurrence when it gets there. The
+     * occurrences may follow one another, like the record lists of several
+     * sections, but a machine that may nest cannot be folded commutatively.
+     */
+    void attach_fold(const Identifier& id, const CppFold<TCHAR, Value>& fold, bool commutative = false)
+    {
+        int index = m_grammar.get_machine_id(id);
+
+        if (commutative && m_grammar.is_nesting(id))
+            throw SimpleException("A commutative fold of " + id.narrow() + " cannot tell apart the occurrences nested in one another");
+
+        m_folds[index] = fold;
+        m_commutative[index] = commutative;
+    }
+    /*!
+     * @brief Adds the offsets of the symbols of the machine to builder during the following parses
+     *
+     * The workers add each symbol as they reduce it, so the index is built
+     * by the parse the actions run in anyway. key, if given, extracts the key
+     * the index is sorted by, e.g. with RecordIndex::hash_key() over a field
+     * of the record; otherwise the records are numbered in input order. One
+     * machine is indexed at a time, and it cannot be deferred. Write the
+     * index with builder.write(path, get_input_size()) once the parse returns.
+     */
+    void attach_index(const Identifier& id, RecordIndexBuilder& builder, CppIndexKey<TCHAR, Value> key = nullptr)
+    {
+        int index = m_grammar.get_machine_id(id);
+
+        if (m_deferred[index])
+            throw SimpleException("A deferred machine cannot be indexed");
+        builder.set_machine(id.narrow(), key != nullptr);
+        m_index_hook = detail::IndexHook<TCHAR, Value>{ index, &builder, key, nullptr };
+        attach_aggregator(builder);
+    }
+    /*!
+     * @brief Gives the aggregator a shard for every worker of the following parses
+     *
+     * The aggregator must outlive the parses; read it once a parse returns.
+     */
+    void attach_aggregator(Aggregator& aggregator)
+    {
+        m_aggregators.push_back(&aggregator);
+    }
+};
+/*!
+ * @brief Keeps the runners of a Context alive across many parses
+ *
+ * The shared window, the semaphore and the worker threads are created once;
+ * the threads are parked between inputs and the banks are reset before each
+ * parse. A session must not be used from several threads at once.
+ */
+template<typename TCHAR, typename Value, typename Visitor>
+class Session
+{
+    typedef Context<TCHAR, Value, Visitor> context_type;
+    typedef typename context_type::storage_type storage_type;
+    typedef typename context_type::completion_type completion_type;
+    typedef typename context_type::reduction_traits reduction_traits;
+
+    context_type& m_context;
+    //One per reduction runner, since they may work on different inputs of a batch
+    std::vector<std::unique_ptr<ParseContext<TCHAR, Value> > > m_parse_contexts;
+    Input m_idle_input;
+    Stage1Runner *m_stage1;
+    std::vector<BasicStage2Runner<storage_type, reduction_traits> *> m_stage2;
+    BasicStage3Runner<storage_type, reduction_traits> *m_stage3;
+    std::vector<BaseRunner *> m_runners;
+    FoldPool<storage_type> m_fold_pool;
+    size_t m_input_size;
+    void run(bool deferred)
+    {
+        m_context.m_cancellation.reset();
+        if (deferred)
+            m_context.prepare_deferred(m_parse_contexts.begin(), m_parse_contexts.end(), static_cast<int>(m_parse_contexts.size()));
+        else
+            m_context.reserve_aggregators(static_cast<int>(m_parse_contexts.size()));
+        m_stage1->reset();
+
+        for (auto p : m_runners)
+        {
+            p->resume();
+        }
+        for (auto p : m_runners)
+        {
+            p->wait();
+        }
+    }
+    void enable_tape(bool tape)
+    {
+        for (auto st2 : m_stage2)
+        {
+            st2->enable_tape(tape);
+        }
+        m_stage3->enable_tape(tape);
+    }
+    void set_record_queue(int machine_id, RecordQueue<storage_type> *queue)
+    {
+        for (auto st2 : m_stage2)
+        {
+            st2->set_record_queue(machine_id, queue);
+        }
+        m_stage3->set_record_queue(machine_id, queue);
+    }
+    void run_pipeline(Input& input, bool tape)
+    {
+        enable_tape(tape);
+        set_record_queue(m_context.m_record_machine, m_context.m_record_queue);
+        m_stage1->set_parser(m_context.get_parser(input.is_streaming()));
+        for (auto p : m_runners)
+        {
+            p->set_input(input);
+        }
+        for (auto& ctx : m_parse_contexts)
+        {
+            ctx->m_window = input.get_buffer();
+        }
+
+        run(true);
+
+        m_context.m_arena = m_stage3->take_result_arena();
+        m_context.finish_deferred();
+        for (auto p : m_runners)
+        {
+            p->set_input(m_idle_input);
+        }
+
+        //Throws if a compressed stream turned out to be corrupt
+        m_input_size = input.wait();
+    }
+public:
+    Session(context_type& context, int worker_num)
+        : m_context(context), m_input_size(0)
+    {
+        int pid = get_current_pid();
+        int channel = context_type::next_channel();
+
+        for (int i = 0; i < worker_num + 1; i++)
+        {
+            m_parse_contexts.emplace_back(new ParseContext<TCHAR, Value>{ context.m_callbacks, context.m_batch_callbacks, context.m_folds, nullptr, context.m_visitor, i });
+            m_parse_contexts.back()->m_cancellation = &context.m_cancellation;
+            m_parse_contexts.back()->m_index = &context.m_index_hook;
+        }
+
+        m_stage1 = new Stage1Runner{ m_idle_input, &context.m_parser, 8 * 1024 * 1024, worker_num * 2, false, false, channel };
+        m_stage1->set_cancellation(&context.m_cancellation);
+        m_runners.push_back(m_stage1);
+        for (int i = 0; i < worker_num; i++)
+        {
+            auto *st2 = new BasicStage2Runner<storage_type, reduction_traits>{ m_idle_input, 8 * 1024 * 1024, worker_num * 2, pid, static_cast<void *>(m_parse_contexts[i].get()), nullptr, channel };
+
+            m_parse_contexts[i]->m_arena = &st2->get_arena();
+
+            context.register_listeners(*st2, &m_fold_pool);
+            st2->register_input_listener(context_type::input_callback);
+
+            m_stage2.push_back(st2);
+            m_runners.push_back(st2);
+        }
+        m_stage3 = new BasicStage3Runner<storage_type, reduction_traits>{ m_idle_input, 8 * 1024 * 1024, worker_num * 2, pid, static_cast<void *>(m_parse_contexts[worker_num].get()), nullptr, channel };
+
+        m_parse_contexts[worker_num]->m_arena = &m_stage3->get_arena();
+        context.register_listeners(*m_stage3, &m_fold_pool);
+        m_stage3->register_input_listener(context_type::input_callback);
+        m_stage3->register_completion_listener(context_type::completion_callback);
+
+        m_runners.push_back(m_stage3);
+
+        for (auto p : m_runners)
+        {
+            p->park();
+        }
+    }
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    ~Session()
+    {
+        for (auto p : m_runners)
+        {
+            p->shutdown();
+        }
+        //Stage2/3 unmap the window before Stage1 unlinks it
+        for (auto it = m_runners.rbegin(); it != m_runners.rend(); ++it)
+        {
+            delete *it;
+        }
+    }
+    void parse(const char *input_path)
+    {
+        std::unique_ptr<Input> input(open_input(input_path));
+
+        parse(*input);
+    }
+    /*!
+     * @brief Parses the input, inline if it is below the threshold of the context
+     *
+     * Pass force_pipeline to always go through the runners. Throws
+     * SimpleException if the input is rejected or the parse is cancelled,
+     * whichever way it was parsed.
+     */
+    void parse(Input& input, bool force_pipeline = false)
+    {
+        if (!force_pipeline && m_context.is_inline(input))
+        {
+            m_context.parse_inline(input);
+            m_input_size = input.get_length();
+            return;
+        }
+        run_pipeline(input, false);
+        if (!accepted())
+            throw SimpleException(m_context.m_cancellation.cancelled() ? "Parse cancelled" : "Input rejected by the parser");
+    }
+    /*!
+     * @brief Parses the input through the runners, leaving it to accepted() to tell whether it was rejected
+     *
+     * The values reduced before the parse was rejected are kept, which
+     * Context::parse_appended() relies on.
+     */
+    void parse_prefix(Input& input)
+    {
+        run_pipeline(input, false);
+    }
+    /*!
+     * @brief Parses the input and lays its CST out as a Tape
+     *
+     * Each worker writes the nodes of the banks it reduces into a segment of
+     * its own, and Stage3 stitches the segments together in bank order.
+     * Throws SimpleException if the input is rejected.
+     */
+    Tape parse_tape(Input& input, bool force_pipeline = false)
+    {
+        Tape tape;
+        if (!force_pipeline && m_context.is_inline(input))
+        {
+            m_context.parse_inline(input, &tape);
+            m_input_size = input.get_length();
+            return tape;
+        }
+        run_pipeline(input, true);
+
+        tape = m_stage3->take_tape();
+        if (tape.empty())
+            throw SimpleException(m_context.m_cancellation.cancelled() ? "Parse cancelled" : "Input rejected by the parser");
+        return tape;
+    }
+    /*!
+     * @brief Reduces the records of the machine in the bank where a parse is rejected, or drops the bank if 0
+     *
+     * See BasicStage2Runner::set_boundary_machine().
+     */
+    void set_boundary_machine(int machine_id)
+    {
+        for (auto st2 : m_stage2)
+        {
+            st2->set_boundary_machine(machine_id);
+        }
+    }
+    /*!
+     * @brief Feeds the banks of a dump of the input to the reduction workers instead of parsing it
+     */
+    void replay(Input& input, const CSTDump& dump)
+    {
+        m_stage1->set_replay(&dump);
+
+        run_pipeline(input, false);
+
+        m_stage1->set_replay(nullptr);
+    }
+    /*!
+     * @brief Parses the inputs of the batch back to back
+     *
+     * Stage1 starts on the next input while Stage2/3 are still reducing the
+     * previous ones. callback is called from the Stage3 thread after each
+     * input, in batch order. The values an input allocated are released when
+     * the next input completes.
+     */
+    void parse_batch(Batch& batch, completion_type callback, void *user = nullptr)
+    {
+        enable_tape(false);
+        m_stage1->set_parser(m_context.get_parser(false), m_context.get_parser(true));
+        for (auto p : m_runners)
+        {
+            p->set_batch(&batch);
+        }
+        ParseContext<TCHAR, Value>& completion_context = *m_parse_contexts.back();
+        completion_context.m_completion = callback;
+        completion_context.m_completion_user = user;
+        for (auto& ctx : m_parse_contexts)
+        {
+            ctx->m_pool = nullptr;
+        }
+
+        run(false);
+
+        m_stage3->take_result_arena();
+        completion_context.m_completion = nullptr;
+        completion_context.m_completion_user = nullptr;
+        for (auto p : m_runners)
+        {
+            p->set_batch(nullptr);
+        }
+        m_stage1->set_input(m_idle_input);
+    }
+    void parse_batch(const std::vector<std::string>& input_paths, completion_type callback, void *user = nullptr)
+    {
+        FileBatch batch(input_paths);
+
+        parse_batch(batch, callback, user);
+    }
+    /*!
+     * @brief Returns the length of the text parsed by the last call to parse()
+     */
+    size_t get_input_size() const
+    {
+        return m_input_size;
+    }
+    /*!
+     * @brief Returns true if the parser accepted the last input parsed through the runners
+     */
+    bool accepted() const
+    {
+        return m_stage1->get_result() != nullptr;
+    }
+};
+/*!
+ * @brief Values of the records of an input, pulled while it is being parsed
+ *
+ * Created by Context::stream(). The parse runs on a thread of the stream,
+ * and next() waits for the following record. Destroying the stream before
+ * the end cancels the parse.
+ */
+template<typename TCHAR, typename Value, typename Visitor>
+class RecordStream
+{
+    typedef Context<TCHAR, Value, Visitor> context_type;
+    typedef typename context_type::storage_type storage_type;
+public:
+    typedef typename context_type::result_type result_type;
+    /*!
+     * @brief Input iterator over the remaining records
+     */
+    class iterator
+    {
+        RecordStream *m_stream;
+        result_type m_record;
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef result_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const result_type *pointer;
+        typedef const result_type& reference;
+        iterator()
+            : m_stream(nullptr), m_record()
+        {
+        }
+        explicit iterator(RecordStream *stream)
+            : m_stream(stream), m_record()
+        {
+            ++*this;
+        }
+        const result_type& operator*() const
+        {
+            return m_record;
+        }
+        iterator& operator++()
+        {
+            if (!m_stream->next(m_record))
+                m_stream = nullptr;
+            return *this;
+        }
+        bool operator==(const iterator& other) const
+        {
+            return m_stream == other.m_stream;
+        }
+        bool operator!=(const iterator& other) const
+        {
+            return m_stream != other.m_stream;
+        }
+    };
+private:
+    context_type& m_context;
+    RecordQueue<storage_type> m_queue;
+    std::thread m_thread;
+    //Thrown by the parse, rethrown by next() after the last record
+    std::exception_ptr m_error;
+    bool m_finished;
+    void finish()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
+        m_finished = true;
+    }
+public:
+    RecordStream(context_type& context, Input& input, int machine_id, int worker_num, size_t capacity)
+        : m_context(context), m_queue(capacity), m_finished(false)
+    {
+        m_context.m_record_machine = machine_id;
+        m_context.m_record_queue = &m_queue;
+        m_thread = std::thread([this, &input, worker_num]
+        {
+            try
+            {
+                m_context.parse_records(input, worker_num);
+            }
+            catch (...)
+            {
+                m_error = std::current_exception();
+            }
+            m_context.m_record_machine = 0;
+            m_context.m_record_queue = nullptr;
+            m_queue.close();
+        });
+    }
+    RecordStream(const RecordStream&) = delete;
+    RecordStream& operator=(const RecordStream&) = delete;
+    ~RecordStream()
+    {
+        if (!m_finished)
+        {
+            m_context.cancel();
+            m_queue.abandon();
+            finish();
+        }
+    }
+    /*!
+     * @brief Waits for the next record and returns false after the last one
+     *
+     * Throws SimpleException once the records are exhausted if the input
+     * was rejected; the records returned until then are valid.
+     */
+    bool next(result_type& record)
+    {
+        storage_type value;
+        if (m_queue.pop(value))
+        {
+            record = context_type::traits_type::to_result(value);
+            return true;
+        }
+        finish();
+        if (m_error)
+        {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+        return false;
+    }
+    iterator begin()
+    {
+        return iterator(this);
+    }
+    iterator end()
+    {
+        return iterator();
     }
 };
+/*!
+ * @brief Context whose actions are the members of Visitor
+ *
+ * Visitor::grammar_type is the struct generated from the grammar by
+ * "centaurus generate-ids", and Visitor::value_type the type of the values.
+ * A symbol is reduced by the member named after it, which takes a
+ * SymbolContext and returns a value_type; symbols without a member have no
+ * value. The dispatch is a switch compiled into the reduction runners, so
+ * small actions are inlined into them.
+ */
+template<typename TCHAR, typename Visitor>
+using StaticContext = Context<TCHAR, typename Visitor::value_type, Visitor>;
 }
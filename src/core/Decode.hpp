@@ -0,0 +1,471 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <emmintrin.h>
+#if defined(CENTAURUS_BUILD_WINDOWS)
+#include <intrin.h>
+#endif
+
+namespace Centaurus
+{
+namespace detail
+{
+inline bool is_digit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+inline int hex_value(char c)
+{
+    if (is_digit(c))
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+inline int count_trailing_zeros(uint32_t mask)
+{
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+/*!
+ * @brief Returns the first occurrence of c in [first, last), or last
+ *
+ * Compares 16 bytes at a time and never reads past last.
+ */
+inline const char *find_char(const char *first, const char *last, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; last - first >= 16; first += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0)
+            return first + count_trailing_zeros(mask);
+    }
+    for (; first != last; first++)
+    {
+        if (*first == c)
+            return first;
+    }
+    return last;
+}
+inline uint64_t load_eight_chars(const char *p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+inline bool is_eight_digits(uint64_t v)
+{
+    return ((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+/*!
+ * @brief Converts eight ASCII digits loaded little-endian into their value
+ */
+inline uint32_t parse_eight_digits(uint64_t v)
+{
+    const uint64_t mask = 0x000000FF000000FF;
+    const uint64_t mul1 = 0x000F424000000064;
+    const uint64_t mul2 = 0x0000271000000001;
+    v -= 0x3030303030303030;
+    v = (v * 10) + (v >> 8);
+    v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+    return static_cast<uint32_t>(v);
+}
+/*!
+ * @brief Appends the digits at p to value, eight at a time where possible
+ *
+ * count is increased by the number of digits read. Only the first 19 are
+ * accumulated, so value is meaningful only while count stays below 20.
+ */
+inline const char *accumulate_digits(const char *p, const char *last, uint64_t& value, int& count)
+{
+    while (last - p >= 8)
+    {
+        uint64_t chunk = load_eight_chars(p);
+        if (!is_eight_digits(chunk))
+            break;
+        if (count + 8 <= 19)
+            value = value * 100000000 + parse_eight_digits(chunk);
+        count += 8;
+        p += 8;
+    }
+    for (; p != last && is_digit(*p); p++, count++)
+    {
+        if (count < 19)
+            value = value * 10 + (*p - '0');
+    }
+    return p;
+}
+inline void append_utf8(std::string& out, uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        out += static_cast<char>(cp);
+    }
+    else if (cp < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000)
+    {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+#if defined(__SIZEOF_INT128__)
+/*!
+ * @brief Returns (q + f) * 2^exp2 rounded to nearest even, where 0 < q and
+ * 0 <= f < 1 is nonzero if and only if sticky is set
+ */
+inline double round_to_double(unsigned __int128 q, bool sticky, int exp2)
+{
+    uint64_t high = static_cast<uint64_t>(q >> 64);
+    int bits = high != 0 ? 128 - __builtin_clzll(high) : 64 - __builtin_clzll(static_cast<uint64_t>(q));
+    if (bits <= 53 && !sticky)
+        return std::ldexp(static_cast<double>(static_cast<uint64_t>(q)), exp2);
+    //Keep 53 bits plus a rounding bit
+    int shift = bits - 54;
+    uint64_t top;
+    if (shift >= 0)
+    {
+        top = static_cast<uint64_t>(q >> shift);
+        sticky = sticky || (q & ((static_cast<unsigned __int128>(1) << shift) - 1)) != 0;
+    }
+    else
+    {
+        top = static_cast<uint64_t>(q) << -shift;
+    }
+    uint64_t mantissa = top >> 1;
+    if ((top & 1) && (sticky || (mantissa & 1)))
+        mantissa++;
+    return std::ldexp(static_cast<double>(mantissa), exp2 + shift + 1);
+}
+#endif
+inline bool read_hex4(const char *p, const char *last, uint32_t& value)
+{
+    if (last - p < 4)
+        return false;
+    value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int d = hex_value(p[i]);
+        if (d < 0)
+            return false;
+        value = (value << 4) | d;
+    }
+    return true;
+}
+}
+
+/*!
+ * @brief Reads an unsigned decimal integer at the start of [first, last)
+ *
+ * Returns the end of the digits, or nullptr if there are none or the value
+ * does not fit.
+ */
+inline const char *decode_uint(const char *first, const char *last, uint64_t& value)
+{
+    uint64_t v = 0;
+    int count = 0;
+    const char *p = detail::accumulate_digits(first, last, v, count);
+    if (p == first)
+        return nullptr;
+    if (count > 19)
+    {
+        //Leading zeros or a value near the top of the range
+        v = 0;
+        for (const char *q = first; q != p; q++)
+        {
+            uint64_t d = *q - '0';
+            if (v > (UINT64_MAX - d) / 10)
+                return nullptr;
+            v = v * 10 + d;
+        }
+    }
+    value = v;
+    return p;
+}
+/*!
+ * @brief Reads an optionally negative decimal integer at the start of [first, last)
+ */
+inline const char *decode_int(const char *first, const char *last, int64_t& value)
+{
+    bool negative = first != last && *first == '-';
+    uint64_t magnitude;
+    const char *p = decode_uint(first + (negative ? 1 : 0), last, magnitude);
+    if (p == nullptr)
+        return nullptr;
+    if (magnitude > static_cast<uint64_t>(INT64_MAX) + (negative ? 1 : 0))
+        return nullptr;
+    value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return p;
+}
+/*!
+ * @brief Reads a decimal floating-point number at the start of [first, last)
+ *
+ * Accepts an optional minus sign, digits with an optional fraction and an
+ * optional exponent. Numbers with at most 19 significant digits whose value
+ * can be computed with one exact multiplication or division (the Clinger
+ * fast path) are converted directly. So are, where 128-bit integers are
+ * available, the longer mantissas of coordinates and the like, by exact
+ * integer division with the remainder deciding the rounding. The others go
+ * through strtod, so the result is always correctly rounded. Returns nullptr
+ * if there is no number.
+ */
+inline const char *decode_double(const char *first, const char *last, double& value)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    static const uint64_t int_powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000, 10000000000, 100000000000, 1000000000000,
+        10000000000000, 100000000000000, 1000000000000000
+    };
+    const uint64_t max_exact = (uint64_t)1 << 53;
+
+    const char *p = first;
+    bool negative = p != last && *p == '-';
+    if (negative)
+        p++;
+    uint64_t mantissa = 0;
+    int count = 0;
+    const char *int_first = p;
+    p = detail::accumulate_digits(p, last, mantissa, count);
+    bool has_digits = p != int_first;
+    int64_t exponent = 0;
+    if (p != last && *p == '.')
+    {
+        const char *frac_first = ++p;
+        p = detail::accumulate_digits(p, last, mantissa, count);
+        exponent = -(p - frac_first);
+        has_digits = has_digits || p != frac_first;
+    }
+    if (!has_digits)
+        return nullptr;
+    if (p != last && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool exp_negative = false;
+        if (q != last && (*q == '-' || *q == '+'))
+            exp_negative = *q++ == '-';
+        if (q != last && detail::is_digit(*q))
+        {
+            int64_t e = 0;
+            for (; q != last && detail::is_digit(*q); q++)
+            {
+                if (e < 100000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += exp_negative ? -e : e;
+            p = q;
+        }
+    }
+    if (count <= 19 && mantissa <= max_exact)
+    {
+        double d = static_cast<double>(mantissa);
+        if (exponent >= -22 && exponent <= 22)
+        {
+            d = (exponent < 0) ? d / powers[-exponent] : d * powers[exponent];
+            value = negative ? -d : d;
+            return p;
+        }
+        //Move the excess of the exponent into the mantissa while it stays exact
+        if (exponent > 22 && exponent <= 22 + 15 && mantissa <= max_exact / int_powers[exponent - 22])
+        {
+            d = static_cast<double>(mantissa * int_powers[exponent - 22]) * powers[22];
+            value = negative ? -d : d;
+            return p;
+        }
+    }
+#if defined(__SIZEOF_INT128__)
+    if (count <= 19 && mantissa != 0 && exponent >= -22 && exponent <= 19)
+    {
+        typedef unsigned __int128 uint128;
+        uint128 scale = int_powers[exponent < 0 ? (-exponent > 15 ? 15 : -exponent) : (exponent > 15 ? 15 : exponent)];
+        int64_t rest = (exponent < 0 ? -exponent : exponent) - 15;
+        for (; rest > 0; rest--)
+            scale *= 10;
+        double d;
+        if (exponent >= 0)
+        {
+            //Below 2^64 * 10^19, so exact in 128 bits
+            d = detail::round_to_double(static_cast<uint128>(mantissa) * scale, false, 0);
+        }
+        else
+        {
+            //Top bit of the numerator at bit 127 leaves 54 bits of quotient
+            int lz = __builtin_clzll(mantissa);
+            uint128 numerator = static_cast<uint128>(mantissa << lz) << 64;
+            uint128 quotient = numerator / scale;
+            d = detail::round_to_double(quotient, numerator % scale != 0, -64 - lz);
+        }
+        value = negative ? -d : d;
+        return p;
+    }
+#endif
+    //strtod needs a terminated copy that ends where the number does
+    char buffer[64];
+    std::string long_buffer;
+    const char *text = buffer;
+    size_t length = p - first;
+    if (length < sizeof(buffer))
+    {
+        std::memcpy(buffer, first, length);
+        buffer[length] = '\0';
+    }
+    else
+    {
+        long_buffer.assign(first, p);
+        text = long_buffer.c_str();
+    }
+    value = std::strtod(text, nullptr);
+    return p;
+}
+/*!
+ * @brief Appends the text between the quotes of a JSON string to out, unescaped
+ *
+ * \\uXXXX escapes, including surrogate pairs, are written as UTF-8. Returns
+ * false on an invalid escape sequence or a lone surrogate.
+ */
+inline bool unescape_json(const char *first, const char *last, std::string& out)
+{
+    out.reserve(out.size() + (last - first));
+    while (first != last)
+    {
+        const char *backslash = detail::find_char(first, last, '\\');
+        out.append(first, backslash);
+        if (backslash == last)
+            break;
+        first = backslash + 1;
+        if (first == last)
+            return false;
+        switch (*first++)
+        {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t cp;
+            if (!detail::read_hex4(first, last, cp))
+                return false;
+            first += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                uint32_t low;
+                if (last - first < 2 || first[0] != '\\' || first[1] != 'u' ||
+                    !detail::read_hex4(first + 2, last, low) || low < 0xDC00 || low > 0xDFFF)
+                    return false;
+                first += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (cp >= 0xDC00 && cp <= 0xDFFF)
+            {
+                return false;
+            }
+            detail::append_utf8(out, cp);
+        } break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+/*!
+ * @brief Appends XML character data to out with its references decoded
+ *
+ * The five predefined entities and numeric character references are
+ * replaced. Other entities need the DTD and are copied verbatim, as are
+ * malformed references; the function then returns false.
+ */
+inline bool decode_xml(const char *first, const char *last, std::string& out)
+{
+    bool complete = true;
+    out.reserve(out.size() + (last - first));
+    while (first != last)
+    {
+        const char *amp = detail::find_char(first, last, '&');
+        out.append(first, amp);
+        if (amp == last)
+            break;
+        first = amp + 1;
+        //Longest reference we decode is &#x10FFFF;
+        const char *bound = (last - first > 10) ? first + 10 : last;
+        const char *semicolon = std::find(first, bound, ';');
+        size_t length = semicolon - first;
+        bool decoded = semicolon != bound;
+        if (decoded)
+        {
+            if (length == 2 && first[0] == 'l' && first[1] == 't')
+                out += '<';
+            else if (length == 2 && first[0] == 'g' && first[1] == 't')
+                out += '>';
+            else if (length == 3 && std::memcmp(first, "amp", 3) == 0)
+                out += '&';
+            else if (length == 4 && std::memcmp(first, "quot", 4) == 0)
+                out += '"';
+            else if (length == 4 && std::memcmp(first, "apos", 4) == 0)
+                out += '\'';
+            else if (length >= 2 && first[0] == '#')
+            {
+                bool hex = first[1] == 'x';
+                const char *p = first + (hex ? 2 : 1);
+                uint32_t cp = 0;
+                decoded = p != semicolon;
+                for (; decoded && p != semicolon; p++)
+                {
+                    int d = hex ? detail::hex_value(*p) : (detail::is_digit(*p) ? *p - '0' : -1);
+                    decoded = d >= 0 && cp <= 0x10FFFF;
+                    cp = cp * (hex ? 16 : 10) + d;
+                }
+                decoded = decoded && cp != 0 && cp <= 0x10FFFF && !(cp >= 0xD800 && cp <= 0xDFFF);
+                if (decoded)
+                    detail::append_utf8(out, cp);
+            }
+            else
+            {
+                decoded = false;
+            }
+        }
+        if (decoded)
+        {
+            first = semicolon + 1;
+        }
+        else
+        {
+            out += '&';
+            complete = false;
+        }
+    }
+    return complete;
+}
+}
@@ -0,0 +1,357 @@
+#include "DecompressedInput.hpp"
+
+#include <string.h>
+#include <vector>
+#include <sstream>
+
+#include "Exception.hpp"
+
+#if defined(CENTAURUS_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(CENTAURUS_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace Centaurus
+{
+constexpr size_t DecompressedInput::DEFAULT_RESERVATION;
+constexpr size_t DecompressedInput::COMMIT_SIZE;
+constexpr size_t DecompressedInput::REFILL_GUARD;
+constexpr size_t DecompressedInput::READ_SIZE;
+constexpr size_t DecompressedInput::TAIL_PADDING;
+
+DecompressedInput::Format DecompressedInput::detect(const char *filename)
+{
+    unsigned char magic[4] = {0, 0, 0, 0};
+
+    std::FILE *file = std::fopen(filename, "rb");
+    if (file == NULL)
+        return Format::Plain;
+    size_t len = std::fread(magic, 1, sizeof(magic), file);
+    std::fclose(file);
+
+    if (len >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+        return Format::Gzip;
+    if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+        return Format::Zstd;
+    return Format::Plain;
+}
+
+bool DecompressedInput::is_supported(Format format)
+{
+    switch (format)
+    {
+    case Format::Plain:
+        return true;
+    case Format::Gzip:
+#if defined(CENTAURUS_HAVE_ZLIB)
+        return true;
+#else
+        return false;
+#endif
+    case Format::Zstd:
+#if defined(CENTAURUS_HAVE_ZSTD)
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+Input *open_input(const char *filename)
+{
+    DecompressedInput::Format format = DecompressedInput::detect(filename);
+
+    if (format == DecompressedInput::Format::Plain)
+    {
+        MappedFileInput *input = new MappedFileInput(filename);
+        if (input->get_buffer() == NULL)
+        {
+            delete input;
+            throw SimpleException(std::string("Cannot open input file ") + filename);
+        }
+        return input;
+    }
+    return new DecompressedInput(filename, format);
+}
+
+DecompressedInput::DecompressedInput(const char *filename, Format format, size_t reservation)
+    : m_file(NULL), m_format(format), m_window(NULL), m_reservation(reservation), m_committed(0),
+    m_available(0), m_stopping(false), m_complete(false), m_granted(0), m_overrun(false)
+{
+    if (!is_supported(format))
+        throw SimpleException("Centaurus was built without support for this compression format");
+
+    m_file = std::fopen(filename, "rb");
+    if (m_file == NULL)
+        throw SimpleException(std::string("Cannot open input file ") + filename);
+
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    m_window = (char *)VirtualAlloc(NULL, m_reservation, MEM_RESERVE, PAGE_NOACCESS);
+    if (m_window == NULL)
+#elif defined(CENTAURUS_BUILD_LINUX)
+    void *window = mmap(NULL, m_reservation, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    m_window = (window != MAP_FAILED) ? (char *)window : NULL;
+    if (m_window == NULL)
+#endif
+    {
+        std::fclose(m_file);
+        throw SimpleException("Cannot reserve address space for the decompressed input");
+    }
+    if (!commit(0))
+    {
+        std::fclose(m_file);
+        throw SimpleException("Cannot commit memory for the decompressed input");
+    }
+
+    m_buffer = m_window;
+    m_length = 0;
+
+    m_thread = std::thread(&DecompressedInput::run, this);
+}
+
+DecompressedInput::~DecompressedInput()
+{
+    m_stopping.store(true);
+    if (m_thread.joinable())
+        m_thread.join();
+    if (m_file != NULL)
+        std::fclose(m_file);
+#if defined(CENTAURUS_BUILD_WINDOWS)
+    VirtualFree(m_window, 0, MEM_RELEASE);
+#elif defined(CENTAURUS_BUILD_LINUX)
+    munmap(m_window, m_reservation);
+#endif
+}
+
+bool DecompressedInput::commit(size_t size)
+{
+    size_t target = size + TAIL_PADDING;
+
+    while (m_committed < target)
+    {
+        size_t chunk = COMMIT_SIZE;
+        if (m_committed + chunk > m_reservation)
+            return false;
+#if defined(CENTAURUS_BUILD_WINDOWS)
+        if (VirtualAlloc(m_window + m_committed, chunk, MEM_COMMIT, PAGE_READWRITE) == NULL)
+            return false;
+#elif defined(CENTAURUS_BUILD_LINUX)
+        if (mprotect(m_window + m_committed, chunk, PROT_READ | PROT_WRITE) != 0)
+            return false;
+#endif
+        m_committed += chunk;
+    }
+    return true;
+}
+
+size_t DecompressedInput::writable(size_t produced)
+{
+    //Keep at least one commit chunk of room ahead of the decompressor
+    if (!commit(produced + COMMIT_SIZE))
+        return 0;
+    return m_committed - produced - TAIL_PADDING;
+}
+
+void DecompressedInput::publish(size_t produced)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_available.store(produced, std::memory_order_release);
+    }
+    m_cond.notify_all();
+}
+
+void DecompressedInput::finish(size_t produced, const std::string& error)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_available.store(produced, std::memory_order_release);
+        m_length = produced;
+        m_error = error;
+        m_complete = true;
+    }
+    m_cond.notify_all();
+}
+
+const void *DecompressedInput::refill(const void *position) const
+{
+    size_t offset = (const char *)position - m_window;
+
+    //The last token reached text that may not have been written when it was
+    //read, so it may have been matched against the zero bytes instead
+    if (offset != 0 && offset >= m_granted)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_overrun = true;
+        return nullptr;
+    }
+    //Tokens starting below the bound are read from written text if they are
+    //no longer than REFILL_GUARD, so the outcome does not depend on how far
+    //the decompressor happens to be
+    size_t wanted = offset + 2 * REFILL_GUARD;
+    if (m_available.load(std::memory_order_acquire) < wanted)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [&]{ return m_complete || m_available.load(std::memory_order_relaxed) >= wanted; });
+        if (m_available.load(std::memory_order_relaxed) < wanted)
+        {
+            m_granted = SIZE_MAX;
+            return reinterpret_cast<const void *>(UINTPTR_MAX);
+        }
+    }
+    m_granted = wanted;
+    return m_window + offset + REFILL_GUARD;
+}
+
+size_t DecompressedInput::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [&]{ return m_complete; });
+    if (!m_error.empty())
+        throw SimpleException(m_error);
+    if (m_overrun)
+        throw SimpleException("A token of the decompressed input is longer than the refill guard");
+    return m_length;
+}
+
+void DecompressedInput::run()
+{
+    switch (m_format)
+    {
+    case Format::Gzip:
+        run_gzip();
+        break;
+    case Format::Zstd:
+        run_zstd();
+        break;
+    default:
+        finish(0, "Unsupported compression format");
+        break;
+    }
+}
+
+void DecompressedInput::run_gzip()
+{
+#if defined(CENTAURUS_HAVE_ZLIB)
+    std::vector<unsigned char> inbuf(READ_SIZE);
+    size_t produced = 0;
+    bool stream_end = false;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //Automatic zlib/gzip header detection
+    if (inflateInit2(&zs, 15 + 32) != Z_OK)
+    {
+        finish(0, "Cannot initialize the gzip decoder");
+        return;
+    }
+
+    std::string error;
+    while (!m_stopping.load(std::memory_order_relaxed))
+    {
+        if (zs.avail_in == 0)
+        {
+            size_t len = std::fread(inbuf.data(), 1, inbuf.size(), m_file);
+            if (len == 0)
+            {
+                if (!stream_end)
+                    error = "Truncated gzip stream";
+                break;
+            }
+            zs.next_in = inbuf.data();
+            zs.avail_in = len;
+        }
+        if (stream_end)
+        {
+            //Concatenated gzip members decode to the concatenation of their contents
+            inflateReset(&zs);
+            stream_end = false;
+        }
+        size_t room = writable(produced);
+        if (room == 0)
+        {
+            error = "Decompressed input exceeds the reserved address space";
+            break;
+        }
+        zs.next_out = (Bytef *)(m_window + produced);
+        zs.avail_out = room < UINT32_MAX ? room : UINT32_MAX;
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        produced = (char *)zs.next_out - m_window;
+        if (ret == Z_STREAM_END)
+        {
+            stream_end = true;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            error = std::string("Corrupt gzip stream: ") + (zs.msg != NULL ? zs.msg : "unknown error");
+            break;
+        }
+        publish(produced);
+    }
+    inflateEnd(&zs);
+    finish(produced, error);
+#else
+    finish(0, "Centaurus was built without zlib");
+#endif
+}
+
+void DecompressedInput::run_zstd()
+{
+#if defined(CENTAURUS_HAVE_ZSTD)
+    std::vector<unsigned char> inbuf(READ_SIZE);
+    size_t produced = 0;
+    size_t hint = 0;
+
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    if (ds == NULL || ZSTD_isError(ZSTD_initDStream(ds)))
+    {
+        ZSTD_freeDStream(ds);
+        finish(0, "Cannot initialize the zstd decoder");
+        return;
+    }
+
+    std::string error;
+    ZSTD_inBuffer in = {inbuf.data(), 0, 0};
+    while (!m_stopping.load(std::memory_order_relaxed))
+    {
+        if (in.pos == in.size)
+        {
+            size_t len = std::fread(inbuf.data(), 1, inbuf.size(), m_file);
+            if (len == 0)
+            {
+                //A nonzero hint means the last frame is incomplete
+                if (hint != 0)
+                    error = "Truncated zstd stream";
+                break;
+            }
+            in.size = len;
+            in.pos = 0;
+        }
+        size_t room = writable(produced);
+        if (room == 0)
+        {
+            error = "Decompressed input exceeds the reserved address space";
+            break;
+        }
+        ZSTD_outBuffer out = {m_window + produced, room, 0};
+
+        hint = ZSTD_decompressStream(ds, &out, &in);
+        produced += out.pos;
+        if (ZSTD_isError(hint))
+        {
+            error = std::string("Corrupt zstd stream: ") + ZSTD_getErrorName(hint);
+            break;
+        }
+        publish(produced);
+    }
+    ZSTD_freeDStream(ds);
+    finish(produced, error);
+#else
+    finish(0, "Centaurus was built without zstd");
+#endif
+}
+}
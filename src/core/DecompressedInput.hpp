@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Input.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Input decompressed by a background thread while the parser consumes it
+ *
+ * The decompressed text is written into a single contiguous address range
+ * reserved up front and committed chunk by chunk, so that offsets in the CST
+ * markers stay valid for the whole parse and the reduction stages can read the
+ * text window exactly as they do with a mapped file.
+ */
+class DecompressedInput : public Input
+{
+public:
+    enum class Format
+    {
+        Plain,
+        Gzip,
+        Zstd
+    };
+    //Address space reserved for the decompressed text
+    static constexpr size_t DEFAULT_RESERVATION = (size_t)64 * 1024 * 1024 * 1024;
+    //Granularity of committing memory to the reservation
+    static constexpr size_t COMMIT_SIZE = 4 * 1024 * 1024;
+    //Distance the parser may advance past a refill point without calling back.
+    //The text is written at least twice as far, so tokens up to this long
+    //always parse; a token that ends past the written text rejects the input
+    //and makes wait() throw, which every token twice as long does.
+    static constexpr size_t REFILL_GUARD = 1024 * 1024;
+private:
+    static constexpr size_t READ_SIZE = 1024 * 1024;
+    //Zero bytes kept after the written text for termination and SIMD overreads
+    static constexpr size_t TAIL_PADDING = 4096;
+
+    std::FILE *m_file;
+    Format m_format;
+    char *m_window;
+    size_t m_reservation, m_committed;
+    std::atomic<size_t> m_available;
+    std::atomic<bool> m_stopping;
+    bool m_complete;
+    std::string m_error;
+    //End of the text known to be written when the parser was last given a bound, SIZE_MAX once complete
+    mutable size_t m_granted;
+    //Set when the parser went past m_granted between two refills
+    mutable bool m_overrun;
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_cond;
+    std::thread m_thread;
+
+    void run();
+    void run_gzip();
+    void run_zstd();
+    bool commit(size_t size);
+    size_t writable(size_t produced);
+    void publish(size_t produced);
+    void finish(size_t produced, const std::string& error);
+public:
+    /*!
+     * @brief Detects the compression format of the file from its magic bytes
+     */
+    static Format detect(const char *filename);
+    /*!
+     * @brief Returns true if this build has a backend for the format
+     */
+    static bool is_supported(Format format);
+    DecompressedInput(const char *filename, Format format, size_t reservation = DEFAULT_RESERVATION);
+    DecompressedInput(const DecompressedInput&) = delete;
+    DecompressedInput& operator=(const DecompressedInput&) = delete;
+    virtual ~DecompressedInput();
+    virtual bool is_streaming() const override
+    {
+        return true;
+    }
+    virtual const void *refill(const void *position) const override;
+    /*!
+     * @brief Waits for the decompressor to finish and returns the text length
+     *
+     * Throws SimpleException if the compressed stream was corrupt or
+     * truncated, or if a token was longer than REFILL_GUARD.
+     */
+    virtual size_t wait() override;
+};
+/*!
+ * @brief Opens a file for parsing, decompressing it on the fly if needed
+ *
+ * Throws SimpleException if the file cannot be opened or is compressed in a
+ * format this build cannot read.
+ */
+Input *open_input(const char *filename);
+}
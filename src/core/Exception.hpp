@@ -1,6 +1,8 @@
 #pragma once
 
 #include <exception>
+#include <sstream>
+#include <string>
 
 namespace Centaurus
 {
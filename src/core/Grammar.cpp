@@ -1,6 +1,7 @@
 #include "CompositeATN.hpp"
 #include "LookaheadDFA.hpp"
 #include "Encoding.hpp"
+#include "BaseListener.hpp"
 
 namespace
 {
@@ -32,6 +33,56 @@ void Grammar<TCHAR>::print_catn(std::wostream& os, const Identifier& id) const
     catn[id].print(os, id.str());
 }
 template<typename TCHAR>
+void Grammar<TCHAR>::print_ids(std::wostream& os, const std::wstring& name) const
+{
+    //The struct is named after the grammar unless a name is given
+    std::wstring struct_name = !name.empty() ? name : !m_grammar_name.str().empty() ? m_grammar_name.str() : std::wstring(L"Grammar");
+
+    os << L"#pragma once" << std::endl << std::endl;
+    os << L"//Generated by \"centaurus generate-ids\". Do not edit." << std::endl << std::endl;
+    os << L"struct " << struct_name << std::endl << L"{" << std::endl;
+    os << L"    enum : int" << std::endl << L"    {" << std::endl;
+    for (const auto& id : m_identifiers)
+    {
+        os << L"        " << id << L" = " << get_machine_id(id) << L"," << std::endl;
+    }
+    os << L"    };" << std::endl;
+    os << L"    static constexpr int MACHINE_NUM = " << m_identifiers.size() << L";" << std::endl;
+    os << L"    //Checked against the grammar a StaticContext is built from" << std::endl;
+    os << L"    static constexpr unsigned long long GRAMMAR_HASH = " << get_hash() << L"ULL;" << std::endl;
+    os << L"    /*!" << std::endl;
+    os << L"     * @brief Calls the member of visitor named after the symbol with the given id" << std::endl;
+    os << L"     *" << std::endl;
+    os << L"     * Returns false if the visitor has no such member." << std::endl;
+    os << L"     */" << std::endl;
+    os << L"    template<typename Visitor, typename Context, typename Result>" << std::endl;
+    os << L"    static bool reduce(Visitor& visitor, int id, const Context& ctx, Result& result)" << std::endl;
+    os << L"    {" << std::endl;
+    os << L"        switch (id)" << std::endl << L"        {" << std::endl;
+    for (const auto& id : m_identifiers)
+    {
+        os << L"        case " << id << L": return reduce_" << id << L"(visitor, ctx, result, 0);" << std::endl;
+    }
+    os << L"        default: return false;" << std::endl;
+    os << L"        }" << std::endl << L"    }" << std::endl;
+    os << L"private:" << std::endl;
+    for (const auto& id : m_identifiers)
+    {
+        os << L"    template<typename Visitor, typename Context, typename Result>" << std::endl;
+        os << L"    static auto reduce_" << id << L"(Visitor& visitor, const Context& ctx, Result& result, int) -> decltype(result = visitor." << id << L"(ctx), true)" << std::endl;
+        os << L"    {" << std::endl;
+        os << L"        result = visitor." << id << L"(ctx);" << std::endl;
+        os << L"        return true;" << std::endl;
+        os << L"    }" << std::endl;
+        os << L"    template<typename Visitor, typename Context, typename Result>" << std::endl;
+        os << L"    static bool reduce_" << id << L"(Visitor&, const Context&, Result&, long)" << std::endl;
+        os << L"    {" << std::endl;
+        os << L"        return false;" << std::endl;
+        os << L"    }" << std::endl;
+    }
+    os << L"};" << std::endl;
+}
+template<typename TCHAR>
 void Grammar<TCHAR>::print_ldfa(std::wostream& os, const ATNPath& path) const
 {
     CompositeATN<TCHAR> catn(*this);
@@ -56,8 +107,9 @@ int Grammar<TCHAR>::parse(const char *filename, int machine_id)
         if (ch == L'\0')
             break;
 
-        if (machine_id >= 65536)
-            throw stream.toomany(65535);
+        //Markers hold 15-bit machine ids, the largest of which is reserved for captures
+        if (machine_id >= CAPTURE_MACHINE_ID)
+            throw stream.toomany(CAPTURE_MACHINE_ID - 1);
 
         Identifier id(stream);
 
@@ -27,6 +27,7 @@ public:
     virtual void print_dfa(std::wostream& ofs, const ATNPath& path, bool optimize_flag = false) const {}
     virtual void print_ldfa(std::wostream& ofs, const ATNPath& path) const {}
     virtual void print_catn(std::wostream& ofs, const Identifier& id) const {}
+    virtual void print_ids(std::wostream& ofs, const std::wstring& name) const {}
 
     virtual void optimize() {}
 	virtual bool verify() const { return true; }
@@ -71,7 +72,7 @@ public:
         optimize();
     }
     Grammar(Grammar&& old)
-        : m_networks(std::move(old.m_networks)), m_root_id(old.m_root_id)
+        : m_networks(std::move(old.m_networks)), m_identifiers(std::move(old.m_identifiers)), m_root_id(old.m_root_id), m_grammar_name(old.m_grammar_name)
     {
     }
     virtual ~Grammar()
@@ -134,6 +135,7 @@ public:
     }
     virtual void print_ldfa(std::wostream& os, const ATNPath& path) const override;
     virtual void print_catn(std::wostream& os, const Identifier& id) const override;
+    virtual void print_ids(std::wostream& os, const std::wstring& name) const override;
     const ATNMachine<TCHAR>& operator[](const Identifier& id) const
     {
         return m_networks.at(id);
@@ -165,6 +167,98 @@ public:
     const Identifier& lookup_id(int index) const
     {
         return m_identifiers.at(index);
+    }
+    /*!
+     * @brief Returns the id of the only machine invoking each machine, indexed by machine id
+     *
+     * Machines invoked from several machines, or from none, map to 0. So does
+     * the root machine, whose outermost symbol has no parent.
+     */
+    std::vector<int> get_parent_ids() const
+    {
+        std::vector<int> parents(m_networks.size() + 1, 0);
+        for (const auto& p : m_networks)
+        {
+            int parent = p.second.get_unique_id();
+            for (int i = 0; i < p.second.get_node_num(); i++)
+            {
+                const ATNNode<TCHAR>& node = p.second.get_node(i);
+                if (!node.is_nonterminal())
+                    continue;
+                int& slot = parents[get_machine_id(node.get_invoke())];
+                slot = (slot == 0 || slot == parent) ? parent : -1;
+            }
+        }
+        for (auto& parent : parents)
+        {
+            if (parent < 0)
+                parent = 0;
+        }
+        parents[get_machine_id(m_root_id)] = 0;
+        return parents;
+    }
+    /*!
+     * @brief Returns true if a symbol of the machine may occur inside another one
+     */
+    bool is_nesting(const Identifier& id) const
+    {
+        std::vector<bool> visited(m_networks.size() + 1, false);
+        std::vector<Identifier> pending{ id };
+        while (!pending.empty())
+        {
+            const ATNMachine<TCHAR>& machine = m_networks.at(pending.back());
+            pending.pop_back();
+            for (int i = 0; i < machine.get_node_num(); i++)
+            {
+                const ATNNode<TCHAR>& node = machine.get_node(i);
+                if (!node.is_nonterminal())
+                    continue;
+                if (node.get_invoke() == id)
+                    return true;
+                int index = get_machine_id(node.get_invoke());
+                if (!visited[index])
+                {
+                    visited[index] = true;
+                    pending.push_back(node.get_invoke());
+                }
+            }
+        }
+        return false;
+    }
+    /*!
+     * @brief Returns a hash of the machines, which tells whether CST markers were written for this grammar
+     */
+    uint64_t get_hash() const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        auto mix = [&hash](uint64_t value) {
+            hash ^= value;
+            hash *= 1099511628211ULL;
+        };
+        auto mix_id = [&](const Identifier& id) {
+            for (wchar_t ch : id.str())
+                mix(static_cast<uint64_t>(ch));
+            mix(0);
+        };
+        for (const Identifier& id : m_identifiers)
+        {
+            const ATNMachine<TCHAR>& machine = m_networks.at(id);
+            mix_id(id);
+            mix(machine.get_unique_id());
+            mix(machine.get_node_num());
+            for (const auto& node : machine)
+            {
+                mix(static_cast<uint64_t>(node.type()));
+                mix(node.is_captured() ? 1 : 0);
+                if (node.is_nonterminal())
+                    mix_id(node.get_invoke());
+                for (TCHAR ch : node.get_literal())
+                    mix(static_cast<uint64_t>(ch));
+                for (const auto& transition : node.get_transitions())
+                    mix(transition.dest());
+            }
+        }
+        return hash;
     }
 	virtual void enum_machines(EnumMachinesCallback callback) const override
 	{
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Exception.hpp"
+
+namespace Centaurus
+{
+namespace detail
+{
+/*!
+ * @brief Contents of a checkpoint file, followed by the name of the record machine
+ */
+struct IncrementalCheckpointHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t window;
+    uint64_t checksum;
+    uint64_t name_length;
+};
+constexpr char INCREMENTAL_CHECKPOINT_MAGIC[8] = { 'C', 'T', 'I', 'N', 'C', '\0', '\0', '\0' };
+constexpr uint32_t INCREMENTAL_CHECKPOINT_VERSION = 1;
+}
+/*!
+ * @brief Where Context::parse_appended() stopped in an input that only grows
+ *
+ * The offset is the end of the last record reduced, in bytes from the start
+ * of the input. A checksum of the bytes just before it tells whether the
+ * input still begins with what was parsed; if it does not, the next parse
+ * starts over from the beginning.
+ */
+class IncrementalCheckpoint
+{
+    std::string m_machine;
+    uint64_t m_offset;
+    uint64_t m_window;
+    uint64_t m_checksum;
+public:
+    //Bytes before the offset covered by the checksum
+    static constexpr uint64_t WINDOW_SIZE = 4096;
+
+    IncrementalCheckpoint()
+        : m_offset(0), m_window(0), m_checksum(checksum(nullptr, 0))
+    {
+    }
+    /*!
+     * @brief Loads the checkpoint saved at path, or starts from the beginning if there is no such file
+     *
+     * Throws SimpleException if the file is not a checkpoint.
+     */
+    explicit IncrementalCheckpoint(const char *path)
+        : IncrementalCheckpoint()
+    {
+        std::FILE *file = std::fopen(path, "rb");
+        if (file == NULL)
+            return;
+        detail::IncrementalCheckpointHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, detail::INCREMENTAL_CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == detail::INCREMENTAL_CHECKPOINT_VERSION && header.window <= header.offset;
+        if (ok)
+        {
+            m_machine.resize(header.name_length);
+            ok = std::fread(&m_machine[0], 1, m_machine.size(), file) == m_machine.size();
+        }
+        std::fclose(file);
+        if (!ok)
+            throw SimpleException(std::string("Invalid checkpoint file ") + path);
+        m_offset = header.offset;
+        m_window = header.window;
+        m_checksum = header.checksum;
+    }
+    void save(const char *path) const
+    {
+        detail::IncrementalCheckpointHeader header;
+        std::memcpy(header.magic, detail::INCREMENTAL_CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.version = detail::INCREMENTAL_CHECKPOINT_VERSION;
+        header.reserved = 0;
+        header.offset = m_offset;
+        header.window = m_window;
+        header.checksum = m_checksum;
+        header.name_length = m_machine.size();
+
+        std::FILE *file = std::fopen(path, "wb");
+        if (file == NULL)
+            throw SimpleException(std::string("Cannot create checkpoint file ") + path);
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(m_machine.data(), 1, m_machine.size(), file) == m_machine.size();
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok)
+            throw SimpleException(std::string("Cannot write checkpoint file ") + path);
+    }
+    /*!
+     * @brief Returns the name of the record machine, or an empty string before the first record
+     */
+    const std::string& machine() const
+    {
+        return m_machine;
+    }
+    uint64_t offset() const
+    {
+        return m_offset;
+    }
+    /*!
+     * @brief Returns true if the input of length bytes still holds the bytes checksummed before the offset
+     */
+    bool matches(const void *input, uint64_t length) const
+    {
+        if (length < m_offset)
+            return false;
+        return checksum(static_cast<const char *>(input) + (m_offset - m_window), m_window) == m_checksum;
+    }
+    /*!
+     * @brief Moves the checkpoint to offset bytes into the input, which must be the end of a record of machine
+     */
+    void advance(const std::string& machine, const void *input, uint64_t offset)
+    {
+        m_machine = machine;
+        m_offset = offset;
+        m_window = offset < WINDOW_SIZE ? offset : WINDOW_SIZE;
+        m_checksum = checksum(static_cast<const char *>(input) + (offset - m_window), m_window);
+    }
+    /*!
+     * @brief Goes back to the beginning of the input
+     */
+    void reset()
+    {
+        *this = IncrementalCheckpoint();
+    }
+    /*!
+     * @brief Hashes the bytes with FNV-1a
+     */
+    static uint64_t checksum(const void *data, uint64_t length)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint64_t i = 0; i < length; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Stage2RunnerNonRecursive.hpp"
+#include "CodeGenInterface.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Runs the parser and the reductions on the calling thread
+ *
+ * Meant for inputs that fit in a few banks, where the hand-off between the
+ * three stages costs more than the parse itself. The parser writes into a
+ * thread-local bank, and every bank is reduced into one set of stacks as soon
+ * as it is full, so no shared memory, semaphore or thread is involved.
+ * The parser runs on the caller's stack.
+ */
+template<typename SV, typename Traits = ReductionTraits<SV> >
+class BasicInlineRunner : public BasicNonRecursiveReductionRunner<SV, Traits>
+{
+  typedef BasicNonRecursiveReductionRunner<SV, Traits> Base;
+  using typename Base::semantic_value_type;
+  using Base::m_bank_size;
+  using Base::m_input_window;
+  using Base::m_tape_mode;
+  using Base::open_symbol;
+  using Base::push_span;
+  using Base::reduce_by_end_marker;
+  using Base::reduce_leaf_batches;
+  using Base::take_batched_leaf;
+  using Base::flush_records;
+  using Base::m_records;
+  using Base::m_arena;
+  IParser *m_parser;
+  //Machine the parser starts from, or 0 for the root
+  int m_entry;
+  uint64_t *m_bank;
+  std::unique_ptr<uint64_t[]> m_own_bank;
+  bool m_bank_filled;
+  std::vector<CSTMarker> m_starts;
+  std::vector<semantic_value_type> m_values;
+  std::vector<TokenSpan> m_spans;
+  std::vector<detail::StackEntryTag> m_tags;
+  const void *m_parse_result;
+  semantic_value_type m_result;
+  TapeSegment m_segment;
+  TapeBuilder m_tape_builder;
+  Tape m_tape;
+
+  struct ThreadBank
+  {
+    std::unique_ptr<uint64_t[]> bank;
+    bool in_use = false;
+  };
+  static ThreadBank& thread_bank()
+  {
+    static thread_local ThreadBank instance;
+    return instance;
+  }
+
+  void reduce_bank()
+  {
+    const size_t bank_end = m_bank_size / 8;
+    reduce_leaf_batches(m_bank, bank_end);
+    for (size_t i = 0; i < bank_end; i++) {
+      if (m_bank[i] == 0) break;
+      CSTMarker marker(m_bank[i]);
+      if (marker.is_span_marker()) {
+        push_span(marker, CSTMarker(m_bank[i + 1]), m_spans, m_tags);
+        i++;
+      } else if (marker.is_start_marker()) {
+        if (i + 1 < bank_end && take_batched_leaf(marker, CSTMarker(m_bank[i + 1]), m_starts, m_values, m_tags))
+          i++;
+        else
+          open_symbol(marker, m_starts, m_values, m_tags);
+      } else {
+        assert(marker.is_end_marker() && !m_starts.empty());
+        reduce_by_end_marker(marker, m_starts, m_values, m_spans, m_tags);
+      }
+    }
+    if (m_tape_mode) {
+      m_segment.clear();
+      m_segment.build(m_bank, bank_end);
+      m_tape_builder.append(m_segment);
+    }
+    flush_records(m_records);
+  }
+
+public:
+  BasicInlineRunner(const Input& input, IParser *parser, void *context = nullptr)
+    : Base(input, IPC_PAGESIZE, 1, get_current_pid(), context),
+    m_parser(parser), m_entry(0), m_bank(nullptr), m_bank_filled(false), m_parse_result(nullptr), m_result()
+  {
+    ThreadBank& tb = thread_bank();
+    if (tb.in_use) {
+      //An action started another inline parse on this thread
+      m_own_bank.reset(new uint64_t[m_bank_size / 8]);
+      m_bank = m_own_bank.get();
+    } else {
+      if (!tb.bank)
+        tb.bank.reset(new uint64_t[m_bank_size / 8]);
+      tb.in_use = true;
+      m_bank = tb.bank.get();
+    }
+  }
+  virtual ~BasicInlineRunner()
+  {
+    if (!m_own_bank)
+      thread_bank().in_use = false;
+  }
+  virtual void *feed_callback() override
+  {
+    //Makes the parser reject
+    if (this->is_cancelled())
+      return nullptr;
+    if (m_bank_filled)
+      reduce_bank();
+    m_bank_filled = true;
+    return m_bank;
+  }
+  /*!
+   * @brief Makes the following runs parse a symbol of the machine instead of the root; 0 for the root
+   */
+  void set_entry(int machine_id)
+  {
+    m_entry = machine_id;
+  }
+  /*!
+   * @brief Parses the input and returns true if it was accepted
+   */
+  bool run()
+  {
+    m_starts.clear();
+    m_values.clear();
+    m_spans.clear();
+    m_tags.clear();
+    m_records.clear();
+    m_arena.clear();
+    m_bank_filled = false;
+    m_result = semantic_value_type();
+    m_tape = Tape();
+    if (m_tape_mode)
+      m_tape_builder.reset(m_input_window);
+
+    if (m_entry != 0)
+      m_parse_result = m_parser->parse_from(m_entry, static_cast<BaseListener*>(this), m_input_window);
+    else
+      m_parse_result = (*m_parser)(static_cast<BaseListener*>(this), m_input_window);
+    if (m_parse_result == NULL)
+      return false;
+
+    reduce_bank();
+    assert(m_starts.empty());
+    m_result = m_values.empty() ? semantic_value_type() : m_values.front();
+    if (m_tape_mode)
+      m_tape = m_tape_builder.finish();
+    return true;
+  }
+  virtual void start() override
+  {
+    run();
+  }
+  virtual void wait() override
+  {
+  }
+  semantic_value_type get_result() const
+  {
+    return m_result;
+  }
+  /*!
+   * @brief Returns where the parser stopped in the last run, or null if it rejected the input
+   */
+  const void *get_end() const
+  {
+    return m_parse_result;
+  }
+  /*!
+   * @brief Hands over the values allocated by the actions of the last run
+   */
+  Arena take_result_arena()
+  {
+    return std::move(m_arena);
+  }
+  /*!
+   * @brief Hands over the tape of the last run, which is empty unless tapes are enabled and the input was accepted
+   */
+  Tape take_tape()
+  {
+    return std::move(m_tape);
+  }
+};
+
+typedef BasicInlineRunner<uint64_t> InlineRunner;
+}
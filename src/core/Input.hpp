@@ -7,8 +7,12 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace Centaurus
 {
 class Input
@@ -32,6 +36,36 @@ public:
     {
         return m_buffer;
     }
+    size_t get_length() const
+    {
+        return m_length;
+    }
+    /*!
+     * @brief Returns true if the buffer is still being filled while the parser runs
+     */
+    virtual bool is_streaming() const
+    {
+        return false;
+    }
+    /*!
+     * @brief Blocks until the input beyond the given position is available
+     *
+     * Returns the bound below which the parser may proceed without calling back.
+     * Fully materialized inputs never block and return the highest address.
+     * Returns null if the parser went past the text it was promised by the
+     * previous call, which makes the parse rejected.
+     */
+    virtual const void *refill(const void *position) const
+    {
+        return reinterpret_cast<const void *>(UINTPTR_MAX);
+    }
+    /*!
+     * @brief Waits until the whole input has been written and returns its length
+     */
+    virtual size_t wait()
+    {
+        return m_length;
+    }
 };
 class MemoryInput : public Input
 {
@@ -70,11 +104,17 @@ public:
 
         struct stat sb;
 
-        fstat(fd, &sb);
+        if (fd == -1 || fstat(fd, &sb) != 0)
+            return;
 
         m_length = sb.st_size;
 
         m_buffer = mmap(NULL, m_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_buffer == MAP_FAILED)
+        {
+            m_buffer = NULL;
+            m_length = 0;
+        }
 #endif
     }
     virtual ~MappedFileInput()
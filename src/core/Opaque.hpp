@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Decode.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Delimiters of a nonterminal occurrence the parser skips instead of parsing
+ *
+ * Written %('{}[]' '"\') before the nonterminal in the grammar: the first
+ * literal lists the bracket pairs, and the optional second one the quote
+ * character followed by the escape character. Brackets inside quotes are
+ * not counted.
+ */
+template<typename TCHAR>
+struct OpaqueSyntax
+{
+    //Characters, that is eight pairs
+    static constexpr size_t MAX_BRACKETS = 16;
+
+    //Opening and closing brackets, in pairs
+    std::basic_string<TCHAR> brackets;
+    //0 if the region has no strings or no escapes
+    TCHAR quote, escape;
+
+    OpaqueSyntax() : quote(0), escape(0) {}
+    bool empty() const
+    {
+        return brackets.empty();
+    }
+};
+namespace detail
+{
+/*!
+ * @brief Nesting counter over the special characters of an opaque region
+ */
+template<typename TCHAR>
+class OpaqueScanner
+{
+    const OpaqueSyntax<TCHAR>& m_syntax;
+    int m_depth;
+    bool m_in_string;
+    //Characters before it were consumed by an escape
+    const TCHAR *m_resume;
+public:
+    OpaqueScanner(const OpaqueSyntax<TCHAR>& syntax, const TCHAR *start)
+        : m_syntax(syntax), m_depth(0), m_in_string(false), m_resume(start)
+    {
+    }
+    /*!
+     * @brief Steps over the character at p
+     *
+     * Returns 1 once the region is closed by it, -1 if the input ends or a
+     * bracket closes nothing, and 0 otherwise. Characters that are not
+     * special may be stepped over or not.
+     */
+    int step(const TCHAR *p)
+    {
+        if (p < m_resume)
+            return 0;
+        TCHAR ch = *p;
+        if (ch == 0)
+            return -1;
+        if (m_in_string)
+        {
+            if (ch == m_syntax.escape)
+            {
+                //The terminating NUL is never escaped
+                if (p[1] == 0)
+                    return -1;
+                m_resume = p + 2;
+            }
+            else if (ch == m_syntax.quote)
+            {
+                m_in_string = false;
+                return (m_depth == 0) ? 1 : 0;
+            }
+            return 0;
+        }
+        if (ch == m_syntax.quote)
+        {
+            m_in_string = true;
+            return 0;
+        }
+        size_t index = m_syntax.brackets.find(ch);
+        if (index == std::basic_string<TCHAR>::npos)
+            return 0;
+        m_depth += (index % 2 == 0) ? 1 : -1;
+        if (m_depth < 0)
+            return -1;
+        return (m_depth == 0) ? 1 : 0;
+    }
+};
+/*!
+ * @brief Returns the mask of the bytes of the aligned block that are special in the region
+ */
+inline uint32_t opaque_block_mask(const char *block, const __m128i *specials, int num_specials)
+{
+    __m128i data = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+    __m128i hits = _mm_cmpeq_epi8(data, _mm_setzero_si128());
+    for (int i = 0; i < num_specials; i++)
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(data, specials[i]));
+    return _mm_movemask_epi8(hits);
+}
+}
+/*!
+ * @brief Returns the end of the opaque region starting at p, or NULL if there is none
+ *
+ * The region is a bracketed block or a quoted string. The text inside is
+ * not validated beyond the balance of the brackets. Single-byte input is
+ * scanned 16 bytes at a time with aligned loads, which never cross into the
+ * page after the terminating NUL.
+ */
+template<typename TCHAR>
+const TCHAR *skip_opaque(const TCHAR *p, const OpaqueSyntax<TCHAR>& syntax)
+{
+    if (*p == 0)
+        return NULL;
+    size_t index = syntax.brackets.find(*p);
+    bool opens = index != std::basic_string<TCHAR>::npos && index % 2 == 0;
+    if (!opens && *p != syntax.quote)
+        return NULL;
+    detail::OpaqueScanner<TCHAR> scanner(syntax, p);
+    if (sizeof(TCHAR) == 1)
+    {
+        __m128i specials[OpaqueSyntax<TCHAR>::MAX_BRACKETS + 2];
+        int num_specials = 0;
+        for (TCHAR ch : syntax.brackets)
+            specials[num_specials++] = _mm_set1_epi8(static_cast<char>(ch));
+        if (syntax.quote != 0)
+            specials[num_specials++] = _mm_set1_epi8(static_cast<char>(syntax.quote));
+        if (syntax.escape != 0)
+            specials[num_specials++] = _mm_set1_epi8(static_cast<char>(syntax.escape));
+
+        const char *block = reinterpret_cast<const char *>(reinterpret_cast<uintptr_t>(p) & ~static_cast<uintptr_t>(15));
+        uint32_t mask = detail::opaque_block_mask(block, specials, num_specials) & (~0u << (reinterpret_cast<const char *>(p) - block));
+        while (true)
+        {
+            for (; mask != 0; mask &= mask - 1)
+            {
+                const TCHAR *q = reinterpret_cast<const TCHAR *>(block + detail::count_trailing_zeros(mask));
+                int result = scanner.step(q);
+                if (result > 0)
+                    return q + 1;
+                if (result < 0)
+                    return NULL;
+            }
+            block += 16;
+            mask = detail::opaque_block_mask(block, specials, num_specials);
+        }
+    }
+    for (;; p++)
+    {
+        int result = scanner.step(p);
+        if (result > 0)
+            return p + 1;
+        if (result < 0)
+            return NULL;
+    }
+}
+}
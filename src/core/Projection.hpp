@@ -0,0 +1,178 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <locale>
+#include <codecvt>
+
+#include "Grammar.hpp"
+#include "Exception.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Path query that selects the symbols a specialized parser reports
+ *
+ * Written as slash-separated nonterminals, such as "DblpRoot/Article/NonYearInfo[Text]".
+ * Each step must be invoked directly by the one before it, and the first one
+ * is searched for below the root. The symbols on the path are reported, and so
+ * are all the symbols under the last step, or under its children listed in the
+ * brackets. Everything else is parsed without writing any markers.
+ *
+ * The compiled copy of a machine depends on where it is invoked from, which
+ * is tracked by a mode: the index of the path step, or one of the constants below.
+ */
+template<typename TCHAR>
+class Projection
+{
+    std::vector<Identifier> m_steps;
+    //Children of the last step whose subtrees are reported; empty for all of them
+    std::vector<Identifier> m_selected;
+    //Machines from which the first step can be invoked
+    std::unordered_set<Identifier> m_leads;
+
+    static bool invokes(const Grammar<TCHAR>& grammar, const Identifier& parent, const Identifier& child)
+    {
+        const ATNMachine<TCHAR>& machine = grammar[parent];
+        for (int i = 0; i < machine.get_node_num(); i++)
+        {
+            const ATNNode<TCHAR>& node = machine.get_node(i);
+            if (node.type() == ATNNodeType::Nonterminal && node.get_invoke() == child)
+                return true;
+        }
+        return false;
+    }
+    static Identifier read_step(const std::wstring& query, size_t& pos)
+    {
+        size_t start = pos;
+        while (pos < query.size() && Identifier::is_symbol_char(query[pos]))
+            pos++;
+        if (pos == start || !Identifier::is_symbol_leader(query[start]))
+            throw SimpleException("Projection: a nonterminal is expected at position " + std::to_string(start));
+        return Identifier(query.substr(start, pos - start));
+    }
+    void check_machine(const Grammar<TCHAR>& grammar, const Identifier& id) const
+    {
+        if (grammar.get_machines().count(id) == 0)
+            throw SimpleException("Projection: unknown nonterminal " + id.narrow());
+    }
+public:
+    //Reports the machine and everything under it
+    static constexpr int FULL = -1;
+    //Reports nothing at or under the machine
+    static constexpr int DRY = -2;
+    //Reports the machine on the way down to the first step
+    static constexpr int SEEK = -3;
+
+    /*!
+     * @brief Selects every symbol, which leaves the parser as it is
+     */
+    Projection()
+    {
+    }
+    /*!
+     * @brief Parses the query and checks it against the grammar
+     *
+     * Throws SimpleException if a step is not a nonterminal of the grammar or
+     * is not invoked by the step before it.
+     */
+    Projection(const Grammar<TCHAR>& grammar, const std::string& query)
+    {
+        if (query.empty())
+            return;
+        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converter;
+        std::wstring wide = converter.from_bytes(query);
+
+        size_t pos = 0;
+        while (true)
+        {
+            m_steps.push_back(read_step(wide, pos));
+            check_machine(grammar, m_steps.back());
+            if (m_steps.size() > 1 && !invokes(grammar, m_steps[m_steps.size() - 2], m_steps.back()))
+                throw SimpleException("Projection: " + m_steps[m_steps.size() - 2].narrow() + " does not invoke " + m_steps.back().narrow());
+            if (pos == wide.size())
+                break;
+            if (wide[pos] == L'[')
+            {
+                do
+                {
+                    pos++;
+                    m_selected.push_back(read_step(wide, pos));
+                    check_machine(grammar, m_selected.back());
+                    if (!invokes(grammar, m_steps.back(), m_selected.back()))
+                        throw SimpleException("Projection: " + m_steps.back().narrow() + " does not invoke " + m_selected.back().narrow());
+                } while (pos < wide.size() && wide[pos] == L',');
+                if (pos + 1 != wide.size() || wide[pos] != L']')
+                    throw SimpleException("Projection: the brackets must close the query");
+                break;
+            }
+            if (wide[pos] != L'/')
+                throw SimpleException("Projection: '/' is expected at position " + std::to_string(pos));
+            pos++;
+        }
+
+        //Walk the invocations backwards from the first step
+        std::vector<Identifier> pending{ m_steps.front() };
+        while (!pending.empty())
+        {
+            Identifier child = pending.back();
+            pending.pop_back();
+            for (const auto& p : grammar.get_machines())
+            {
+                if (m_leads.count(p.first) == 0 && invokes(grammar, p.first, child))
+                {
+                    m_leads.insert(p.first);
+                    pending.push_back(p.first);
+                }
+            }
+        }
+        if (!(m_steps.front() == grammar.get_root_id()) && m_leads.count(grammar.get_root_id()) == 0)
+            throw SimpleException("Projection: " + m_steps.front().narrow() + " is not reachable from the root");
+    }
+    bool empty() const
+    {
+        return m_steps.empty();
+    }
+    /*!
+     * @brief Returns the mode of the root machine
+     */
+    int root_mode(const Grammar<TCHAR>& grammar) const
+    {
+        if (m_steps.empty())
+            return FULL;
+        return (grammar.get_root_id() == m_steps.front()) ? 0 : SEEK;
+    }
+    /*!
+     * @brief Returns the mode of a machine invoked by one compiled in the given mode
+     */
+    int child_mode(int mode, const Identifier& child) const
+    {
+        if (mode == FULL || mode == DRY)
+            return mode;
+        if (mode == SEEK)
+        {
+            if (child == m_steps.front())
+                return 0;
+            return (m_leads.count(child) != 0) ? SEEK : DRY;
+        }
+        if (mode + 1 < static_cast<int>(m_steps.size()))
+            return (child == m_steps[mode + 1]) ? mode + 1 : DRY;
+        if (m_selected.empty())
+            return FULL;
+        for (const auto& id : m_selected)
+        {
+            if (id == child)
+                return FULL;
+        }
+        return DRY;
+    }
+    /*!
+     * @brief Returns true if machines compiled in the mode write markers
+     */
+    static bool reports(int mode)
+    {
+        return mode != DRY;
+    }
+};
+}
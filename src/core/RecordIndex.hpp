@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Aggregator.hpp"
+#include "Exception.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Location of one record in the indexed input, in characters from its start
+ */
+struct RecordIndexEntry
+{
+    //Key extracted by the action of the index, or the position of the record in the input
+    uint64_t key;
+    uint64_t start;
+    uint64_t end;
+};
+namespace detail
+{
+/*!
+ * @brief Header of an index file, followed by the name of the machine and the entries
+ *
+ * Everything is written in the byte order of the machine building the index.
+ */
+struct RecordIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t keyed;
+    uint64_t count;
+    //Length of the indexed input in bytes, checked before a record is parsed again
+    uint64_t input_length;
+    uint64_t name_length;
+};
+constexpr char RECORD_INDEX_MAGIC[8] = { 'C', 'T', 'R', 'I', 'D', 'X', '\0', '\0' };
+constexpr uint32_t RECORD_INDEX_VERSION = 1;
+}
+/*!
+ * @brief Collects the offsets of the records of one machine while the input is parsed
+ *
+ * Attached with Context::attach_index(), it receives every symbol of the
+ * machine from the worker that reduces it, so the index costs no extra pass
+ * over the input. write() then sorts the entries by key into an index file,
+ * which RecordIndex reads back.
+ */
+class RecordIndexBuilder : public Aggregator
+{
+    detail::Shards<std::vector<RecordIndexEntry> > m_shards;
+    std::string m_machine;
+    bool m_keyed;
+public:
+    RecordIndexBuilder() : m_keyed(false)
+    {
+    }
+    virtual void reserve(int workers) override
+    {
+        m_shards.reserve(workers);
+    }
+    virtual void clear() override
+    {
+        m_shards.clear();
+    }
+    /*!
+     * @brief Names the indexed machine; called by Context::attach_index()
+     */
+    void set_machine(const std::string& machine, bool keyed)
+    {
+        m_machine = machine;
+        m_keyed = keyed;
+    }
+    void add(int worker, uint64_t key, uint64_t start, uint64_t end)
+    {
+        m_shards[worker].push_back(RecordIndexEntry{ key, start, end });
+    }
+    /*!
+     * @brief Returns the entries sorted by key, or numbered in input order if there are no keys
+     */
+    std::vector<RecordIndexEntry> merge() const
+    {
+        std::vector<RecordIndexEntry> entries;
+        m_shards.for_each([&](const std::vector<RecordIndexEntry>& shard) {
+            entries.insert(entries.end(), shard.begin(), shard.end());
+        });
+        std::sort(entries.begin(), entries.end(), [](const RecordIndexEntry& a, const RecordIndexEntry& b) { return a.start < b.start; });
+        if (m_keyed)
+        {
+            std::stable_sort(entries.begin(), entries.end(), [](const RecordIndexEntry& a, const RecordIndexEntry& b) { return a.key < b.key; });
+        }
+        else
+        {
+            for (size_t i = 0; i < entries.size(); i++)
+                entries[i].key = i;
+        }
+        return entries;
+    }
+    /*!
+     * @brief Writes the index of an input of input_length bytes, as returned by Context::get_input_size()
+     */
+    void write(const char *path, uint64_t input_length) const
+    {
+        std::vector<RecordIndexEntry> entries = merge();
+
+        detail::RecordIndexHeader header;
+        std::memcpy(header.magic, detail::RECORD_INDEX_MAGIC, sizeof(header.magic));
+        header.version = detail::RECORD_INDEX_VERSION;
+        header.keyed = m_keyed ? 1 : 0;
+        header.count = entries.size();
+        header.input_length = input_length;
+        header.name_length = m_machine.size();
+
+        std::FILE *file = std::fopen(path, "wb");
+        if (file == NULL)
+            throw SimpleException(std::string("Cannot create index file ") + path);
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(m_machine.data(), 1, m_machine.size(), file) == m_machine.size() &&
+            std::fwrite(entries.data(), sizeof(RecordIndexEntry), entries.size(), file) == entries.size();
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok)
+            throw SimpleException(std::string("Cannot write index file ") + path);
+    }
+};
+/*!
+ * @brief Index file written by RecordIndexBuilder, loaded into memory
+ *
+ * A record found here is parsed again on its own with
+ * Context::parse_record(), which costs time in the size of the record
+ * rather than of the input.
+ */
+class RecordIndex
+{
+    std::vector<RecordIndexEntry> m_entries;
+    std::string m_machine;
+    bool m_keyed;
+    uint64_t m_input_length;
+public:
+    explicit RecordIndex(const char *path)
+    {
+        std::FILE *file = std::fopen(path, "rb");
+        if (file == NULL)
+            throw SimpleException(std::string("Cannot open index file ") + path);
+        detail::RecordIndexHeader header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::memcmp(header.magic, detail::RECORD_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == detail::RECORD_INDEX_VERSION;
+        if (ok)
+        {
+            m_machine.resize(header.name_length);
+            m_entries.resize(header.count);
+            ok = std::fread(&m_machine[0], 1, m_machine.size(), file) == m_machine.size() &&
+                std::fread(m_entries.data(), sizeof(RecordIndexEntry), m_entries.size(), file) == m_entries.size();
+        }
+        std::fclose(file);
+        if (!ok)
+            throw SimpleException(std::string("Invalid index file ") + path);
+        m_keyed = header.keyed != 0;
+        m_input_length = header.input_length;
+    }
+    /*!
+     * @brief Returns the name of the indexed machine
+     */
+    const std::string& machine() const
+    {
+        return m_machine;
+    }
+    /*!
+     * @brief Returns true if the entries are sorted by keys extracted by an action rather than numbered
+     */
+    bool keyed() const
+    {
+        return m_keyed;
+    }
+    uint64_t input_length() const
+    {
+        return m_input_length;
+    }
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+    /*!
+     * @brief Returns the i-th entry; without keys, the i-th record of the input
+     */
+    const RecordIndexEntry& operator[](size_t i) const
+    {
+        return m_entries[i];
+    }
+    /*!
+     * @brief Returns the entries with the key, which are several if keys collide
+     */
+    std::pair<const RecordIndexEntry *, const RecordIndexEntry *> find(uint64_t key) const
+    {
+        auto range = std::equal_range(m_entries.begin(), m_entries.end(), RecordIndexEntry{ key, 0, 0 },
+            [](const RecordIndexEntry& a, const RecordIndexEntry& b) { return a.key < b.key; });
+        const RecordIndexEntry *base = m_entries.data();
+        return std::make_pair(base + (range.first - m_entries.begin()), base + (range.second - m_entries.begin()));
+    }
+    /*!
+     * @brief Hashes a textual key into the 64-bit keys of an index (FNV-1a)
+     */
+    template<typename TCHAR>
+    static uint64_t hash_key(const TCHAR *first, const TCHAR *last)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (; first != last; ++first)
+        {
+            hash ^= static_cast<uint64_t>(static_cast<typename std::make_unsigned<TCHAR>::type>(*first));
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+}
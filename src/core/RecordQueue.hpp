@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace Centaurus
+{
+/*!
+ * @brief Bounded queue through which the reduction runners hand records to a consumer
+ *
+ * The runner that produces the records in input order blocks while the queue
+ * is full. It then holds its bank, so the parser runs out of banks and waits
+ * as well, and the input is parsed no faster than the records are consumed.
+ */
+template<typename T>
+class RecordQueue
+{
+    std::mutex m_mutex;
+    std::condition_variable m_not_full, m_not_empty;
+    std::deque<T> m_items;
+    size_t m_capacity;
+    //No more records will be pushed
+    bool m_closed;
+    //The consumer has gone away, and the records are dropped
+    bool m_abandoned;
+public:
+    explicit RecordQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1), m_closed(false), m_abandoned(false)
+    {
+    }
+    RecordQueue(const RecordQueue&) = delete;
+    RecordQueue& operator=(const RecordQueue&) = delete;
+    void push(const T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this]{ return m_items.size() < m_capacity || m_abandoned; });
+        if (m_abandoned)
+            return;
+        m_items.push_back(item);
+        m_not_empty.notify_one();
+    }
+    /*!
+     * @brief Takes the next record, waiting for it if needed
+     *
+     * Returns false once the queue is closed and empty.
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this]{ return !m_items.empty() || m_closed; });
+        if (m_items.empty())
+            return false;
+        item = m_items.front();
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+    /*!
+     * @brief Drops the queued records and every later one, releasing the producer
+     */
+    void abandon()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abandoned = true;
+        m_items.clear();
+        m_not_full.notify_all();
+    }
+};
+}
@@ -2,6 +2,7 @@
 
 #include "BaseRunner.hpp"
 #include "CodeGenInterface.hpp"
+#include "CSTDump.hpp"
 #include "PtrRange.hpp"
 
 #include <cstring>
@@ -12,12 +13,20 @@ namespace Centaurus
 class Stage1Runner : public BaseRunner
 {
   friend BaseRunner;
-  IParser *m_parser;
+  IParser *m_parser, *m_streaming_parser;
+  const Input *m_source;
   int m_current_bank, m_counter;
+  int m_input_index, m_sequence;
   const void *m_result;
+  //Set when the input could not be refilled, which rejects the parse at the next bank
+  bool m_refill_failed;
   const bool is_dry;
   const bool is_result_captured;
   std::vector<detail::ConstPtrRange<CSTMarker>> result_chunks_;
+  //Receives a copy of every bank written by the parser
+  CSTDump *m_dump;
+  //Banks fed to Stage2/3 in place of the parser's
+  const CSTDump *m_replay;
 
 private:
   void thread_runner_impl()
@@ -26,11 +35,68 @@ private:
     m_counter = 0;
     reset_banks();
 
-    m_result = (*m_parser)(static_cast<BaseListener*>(this), m_input_window);
+    if (m_replay != nullptr) {
+      replay_input();
+    } else if (m_batch == nullptr) {
+      parse_input(0);
+    } else {
+      //Move on to the next input as soon as the last bank is handed over,
+      //while Stage2/3 are still working on the preceding ones
+      for (int i = 0; i < m_batch->size(); i++) {
+        const Input& input = m_batch->open(i);
+        m_source = &input;
+        m_input_window = input.get_buffer();
+        m_input_size = input.get_length();
+        parse_input(i);
+        if (is_dry)
+          m_batch->close(i);
+      }
+    }
 
-    release_bank();
     signal_exit();
   }
+  void parse_input(int index)
+  {
+    IParser *parser = m_parser;
+    if (m_source != nullptr && m_source->is_streaming() && m_streaming_parser != nullptr)
+      parser = m_streaming_parser;
+
+    m_input_index = index;
+    m_sequence = 0;
+    m_refill_failed = false;
+
+    m_result = (*parser)(static_cast<BaseListener*>(this), m_input_window);
+
+    //The last token has no refill check after it
+    if (m_result != NULL && m_source != nullptr && m_source->is_streaming())
+      refill_callback(m_result);
+    if (m_refill_failed)
+      m_result = NULL;
+    release_bank(true);
+  }
+  void replay_input()
+  {
+    m_input_index = 0;
+    m_sequence = 0;
+    m_result = m_replay->accepted() ? static_cast<const char *>(m_input_window) + m_replay->end() : NULL;
+
+    for (size_t i = 0; i < m_replay->size(); i++) {
+      if (is_cancelled()) {
+        m_result = NULL;
+        break;
+      }
+      release_bank();
+      uint64_t *bank = static_cast<uint64_t *>(acquire_bank());
+      const std::vector<uint64_t>& markers = (*m_replay)[i];
+      std::memcpy(bank, markers.data(), markers.size() * sizeof(uint64_t));
+      if (markers.size() < m_bank_size / 8)
+        bank[markers.size()] = 0;
+    }
+    //The input still ends with a bank if the replay was cancelled before the first one
+    if (m_current_bank == -1)
+      *static_cast<uint64_t *>(acquire_bank()) = 0;
+    release_bank(true);
+  }
   void *acquire_bank()
   {
     WindowBankEntry *banks = (WindowBankEntry *)m_sub_window;
@@ -44,7 +110,7 @@ private:
       }
     }
   }
-  void release_bank()
+  void release_bank(bool last = false)
   {
     if (m_current_bank != -1) {
       if (is_result_captured) {
@@ -52,8 +118,14 @@ private:
         std::memcpy(chunk_ptr, static_cast<char*>(m_main_window) + m_bank_size * m_current_bank, m_bank_size);
         result_chunks_.emplace_back(reinterpret_cast<CSTMarker*>(chunk_ptr), m_bank_size / 8);
       }
+      if (m_dump != nullptr)
+        m_dump->add_bank(reinterpret_cast<uint64_t*>(static_cast<char*>(m_main_window) + m_bank_size * m_current_bank), m_bank_size / 8);
       WindowBankEntry *banks = (WindowBankEntry *)m_sub_window;
       banks[m_current_bank].number = m_counter++;
+      banks[m_current_bank].input = m_input_index;
+      banks[m_current_bank].sequence = m_sequence++;
+      banks[m_current_bank].last = last;
+      banks[m_current_bank].rejected = last && m_result == NULL;
       if (is_dry) {
         banks[m_current_bank].state.store(WindowBankState::Free); // skip Stages 2 & 3
       } else {
@@ -63,6 +135,19 @@ private:
       release_semaphore();
     }
   }
+  /*!
+   * @brief Returns the thread stack needed to run the parsers
+   *
+   * A small stack is enough unless a parser recurses on the native stack.
+   */
+  static size_t required_stack_size(IParser *parser, IParser *streaming_parser)
+  {
+    bool native = (parser != nullptr && parser->uses_native_stack()) ||
+      (streaming_parser != nullptr && streaming_parser->uses_native_stack());
+    if (native)
+      return STACK_SIZE;
+    return COMPACT_STACK_SIZE;
+  }
   void reset_banks()
   {
     WindowBankEntry *banks = (WindowBankEntry *)m_sub_window;
@@ -90,8 +175,22 @@ private:
 
 public:
   Stage1Runner(const char *filename, IParser *parser, size_t bank_size, int bank_num, bool is_dry=false, bool is_result_captured=false)
-    : BaseRunner(filename, bank_size, bank_num), m_parser(parser), is_dry(is_dry), is_result_captured(is_result_captured)
+    : BaseRunner(filename, bank_size, bank_num), m_parser(parser), m_streaming_parser(nullptr), m_source(nullptr), m_refill_failed(false), is_dry(is_dry), is_result_captured(is_result_captured), m_dump(nullptr), m_replay(nullptr)
+  {
+    m_stack_size = required_stack_size(parser, nullptr);
+    acquire_memory(true);
+    create_semaphore();
+  }
+  /*!
+   * @brief Parses an input owned by the caller
+   *
+   * If the input is streaming, the parser must have been compiled with
+   * ParserOptions::refill_input so that it waits for the text to arrive.
+   */
+  Stage1Runner(const Input& input, IParser *parser, size_t bank_size, int bank_num, bool is_dry=false, bool is_result_captured=false, int channel=0)
+    : BaseRunner(input, bank_size, bank_num, get_current_pid(), channel), m_parser(parser), m_streaming_parser(nullptr), m_source(&input), m_refill_failed(false), is_dry(is_dry), is_result_captured(is_result_captured), m_dump(nullptr), m_replay(nullptr)
   {
+    m_stack_size = required_stack_size(parser, nullptr);
     acquire_memory(true);
     create_semaphore();
   }
@@ -104,11 +203,88 @@ public:
   {
     _start<Stage1Runner>();
   }
+  virtual void park() override
+  {
+    _park<Stage1Runner>();
+  }
+  virtual void set_input(const Input& input) override
+  {
+    BaseRunner::set_input(input);
+    m_source = &input;
+  }
+  /*!
+   * @brief Sets the parser, and the one compiled for streaming inputs if any
+   */
+  void set_parser(IParser *parser, IParser *streaming_parser = nullptr)
+  {
+    size_t stack_size = required_stack_size(parser, streaming_parser);
+    //A parked thread keeps the stack it was started with
+    if (m_parked && stack_size > m_stack_size)
+      throw SimpleException("The parked Stage1 thread has too small a stack for this parser");
+    m_parser = parser;
+    m_streaming_parser = streaming_parser;
+    if (!m_parked)
+      m_stack_size = stack_size;
+  }
+  /*!
+   * @brief Copies the banks of the following runs into dump, or stops if null
+   */
+  void set_dump(CSTDump *dump)
+  {
+    m_dump = dump;
+  }
+  /*!
+   * @brief Makes the following runs feed the banks of dump to Stage2/3 instead of parsing, or parse again if null
+   *
+   * The input must be the one the dump was taken from.
+   */
+  void set_replay(const CSTDump *dump)
+  {
+    if (dump != nullptr) {
+      for (size_t i = 0; i < dump->size(); i++) {
+        if ((*dump)[i].size() * sizeof(uint64_t) > m_bank_size)
+          throw SimpleException("The CST dump was taken with larger banks");
+      }
+    }
+    m_replay = dump;
+  }
+  /*!
+   * @brief Prepares the window for another run
+   *
+   * Must be called while no runner of this window is running. Discards the
+   * wakeups left over from the exit signal of the previous run.
+   */
+  void reset()
+  {
+    reset_banks();
+    drain_semaphore();
+  }
   virtual void *feed_callback() override
   {
+    if (is_cancelled() || m_refill_failed) {
+      //End the input with a rejected bank, on which Stage2/3 drop it,
+      //and make the parser reject. The bank held is full; a fresh one
+      //is empty
+      if (m_current_bank == -1)
+        *static_cast<uint64_t *>(acquire_bank()) = 0;
+      m_result = NULL;
+      release_bank(true);
+      return nullptr;
+    }
     release_bank();
     return acquire_bank();
   }
+  virtual const void *refill_callback(const void *position) override
+  {
+    if (m_source == nullptr)
+      return BaseListener::refill_callback(position);
+    const void *bound = m_source->refill(position);
+    if (bound != nullptr)
+      return bound;
+    //The parser goes on to the end of its bank, which is then dropped
+    m_refill_failed = true;
+    return BaseListener::refill_callback(position);
+  }
   const void *get_result() const
   {
     return m_result;
@@ -1,13 +1,19 @@
 #pragma once
 
 #include "BaseRunner.hpp"
+#include "Arena.hpp"
+#include "Tape.hpp"
+#include "RecordQueue.hpp"
 
 #include <atomic>
 #include <vector>
+#include <map>
+#include <mutex>
 #include <tuple>
 #include <cassert>
 #include <iostream>
 #include <cstring>
+#include <type_traits>
 
 namespace Centaurus
 {
@@ -15,7 +21,11 @@ namespace Centaurus
 namespace detail
 {
 
+//Tags of n values are n, and tags of n captured spans are SPAN - n + 1.
+//FOLD tags a single accumulator of a folded machine.
 enum struct StackEntryTag : int {
+  SPAN = -3,
+  FOLD = -2,
   START_MARKER = -1,
   END_MARKER = 0,
   VALUE = 1,
@@ -26,36 +36,381 @@ constexpr inline bool isValueTag(StackEntryTag tag)
   return static_cast<int>(tag) >= static_cast<int>(detail::StackEntryTag::VALUE);
 }
 
+constexpr inline bool isSpanTag(StackEntryTag tag)
+{
+  return static_cast<int>(tag) <= static_cast<int>(detail::StackEntryTag::SPAN);
+}
+
+constexpr inline int spanCount(StackEntryTag tag)
+{
+  return static_cast<int>(detail::StackEntryTag::SPAN) - static_cast<int>(tag) + 1;
+}
+
+constexpr inline StackEntryTag spanTag(int n)
+{
+  return static_cast<StackEntryTag>(static_cast<int>(detail::StackEntryTag::SPAN) - n + 1);
 }
 
-class NonRecursiveReductionRunner : public BaseRunner
+}
+
+/*!
+ * @brief Steps of a fold listener
+ *
+ * Init creates an empty accumulator, Accumulate folds the value of a child
+ * into it, and Merge folds in a partial accumulator that another worker
+ * built from the following children.
+ */
+enum class FoldStep
 {
-  ReductionListener m_listener = nullptr;
+  Init,
+  Accumulate,
+  Merge,
+};
+
+/*!
+ * @brief Accumulators of commutative folds shared by the reduction runners
+ *
+ * Workers pool the partial accumulator of each bank as soon as the bank is
+ * reduced, in whatever order the banks finish, and Stage3 merges those of
+ * the banks up to the end of the folded symbol when it reaches the end. A
+ * bank only holds loose children of the symbol open at its start, so
+ * sibling occurrences of the symbol never share a bank's accumulator.
+ */
+template<typename SV>
+class FoldPool
+{
+  std::mutex m_mutex;
+  //Keyed by input, machine id and sequence number of the bank in the input
+  std::map<std::tuple<int, int, int>, SV> m_accs;
+public:
+  /*!
+   * @brief Pools acc as the partial accumulator of the machine for a bank of the input
+   */
+  void put(int input, int id, int sequence, const SV& acc)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_accs[std::make_tuple(input, id, sequence)] = acc;
+  }
+  /*!
+   * @brief Merges the accumulators of the machine pooled from the banks of the input up to sequence into dst with merge(dst, src), and removes them
+   */
+  template<typename Merge>
+  void take(int input, int id, int sequence, SV& dst, Merge merge)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto first = m_accs.lower_bound(std::make_tuple(input, id, 0));
+    auto last = m_accs.upper_bound(std::make_tuple(input, id, sequence));
+    for (auto it = first; it != last; ++it)
+      merge(dst, it->second);
+    m_accs.erase(first, last);
+  }
+  /*!
+   * @brief Drops what is left for the input, e.g. after it was rejected
+   */
+  void discard(int input)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_accs.erase(m_accs.lower_bound(std::make_tuple(input, 0, 0)), m_accs.lower_bound(std::make_tuple(input + 1, 0, 0)));
+  }
+};
+
+/*!
+ * @brief Listener types for the semantic values stored in the reduction stacks
+ *
+ * Values are stored inline in the stacks and in the Stage2/Stage3 hand-off,
+ * so SV must be trivially copyable. The listener stores the value of the
+ * symbol into result and returns false if the symbol has no value.
+ */
+template<typename SV>
+struct ReductionTraits
+{
+  static_assert(std::is_trivially_copyable<SV>::value, "Semantic values must be trivially copyable");
+  static_assert(sizeof(SV) <= 16, "Semantic values must not exceed 16 bytes");
+  typedef bool (CENTAURUS_CALLBACK * Listener)(const SymbolEntry *symbol, SV *values, int num_values, SV *result, void *context);
+  typedef void (CENTAURUS_CALLBACK * BatchListener)(const SymbolEntry *symbols, int num_symbols, SV *results, void *context);
+  typedef void (CENTAURUS_CALLBACK * FoldListener)(int id, FoldStep step, SV *acc, const SV *value, void *context);
+  typedef void (CENTAURUS_CALLBACK * Completion)(int input, bool accepted, const SV *value, void *context);
+  static bool reduce(Listener listener, const SymbolEntry *symbol, SV *values, int num_values, SV& result, void *context)
+  {
+    return listener(symbol, values, num_values, &result, context);
+  }
+  static void complete(Completion listener, int input, bool accepted, const SV& value, void *context)
+  {
+    listener(input, accepted, &value, context);
+  }
+  static Listener from_python(ReductionListener listener)
+  {
+    return nullptr;
+  }
+};
+/*!
+ * @brief Untyped values, where a zero value stands for no value
+ */
+template<>
+struct ReductionTraits<uint64_t>
+{
+  typedef ReductionListener Listener;
+  typedef void (CENTAURUS_CALLBACK * BatchListener)(const SymbolEntry *symbols, int num_symbols, uint64_t *results, void *context);
+  typedef void (CENTAURUS_CALLBACK * FoldListener)(int id, FoldStep step, uint64_t *acc, const uint64_t *value, void *context);
+  typedef CompletionListener Completion;
+  static bool reduce(Listener listener, const SymbolEntry *symbol, uint64_t *values, int num_values, uint64_t& result, void *context)
+  {
+    result = listener(symbol, values, num_values, context);
+    return result != 0;
+  }
+  static void complete(Completion listener, int input, bool accepted, uint64_t value, void *context)
+  {
+    listener(input, accepted, value, context);
+  }
+  static Listener from_python(ReductionListener listener)
+  {
+    return listener;
+  }
+};
+
+/*!
+ * @brief Base of the reduction runners
+ *
+ * Traits supplies the listener types and the reduce() called for every
+ * symbol. A Traits whose reduce() ignores the listener and calls the actions
+ * directly lets them inline into the reduction loop.
+ */
+template<typename SV, typename Traits = ReductionTraits<SV> >
+class BasicNonRecursiveReductionRunner : public BaseRunner
+{
+protected:
+  using semantic_value_type = SV;
+  using traits_type = Traits;
+private:
+  typename traits_type::Listener m_listener = nullptr;
   TransferListener m_xferlistener = nullptr;
+  InputListener m_input_listener = nullptr;
   void *m_listener_context;
 
   std::atomic<int>* reduction_counter;
 
+  typename traits_type::BatchListener m_batch_listener = nullptr;
+  //Indexed by machine id
+  std::vector<bool> m_batched;
+  /*!
+   * @brief Leaves of one batched machine found in the current bank
+   */
+  struct LeafBatch
+  {
+    std::vector<SymbolEntry> symbols;
+    std::vector<SV> results;
+    size_t next = 0;
+  };
+  std::vector<LeafBatch> m_leaf_batches;
+
+  bool is_batched(int id) const
+  {
+    return id < static_cast<int>(m_batched.size()) && m_batched[id];
+  }
+
+  typename traits_type::FoldListener m_fold_listener = nullptr;
+  //Indexed by machine id
+  std::vector<bool> m_folded;
+  //The folded machine that is the only possible parent of each machine, or 0
+  std::vector<int> m_fold_parents;
+
+  int fold_parent(int id) const
+  {
+    return id < static_cast<int>(m_fold_parents.size()) ? m_fold_parents[id] : 0;
+  }
+
+  FoldPool<SV> *m_fold_pool = nullptr;
+  //Indexed by machine id
+  std::vector<bool> m_commutative;
+  //Partial accumulators of commutative machines built from the current bank
+  std::vector<std::pair<int, SV> > m_pooled;
+
+  bool is_commutative(int id) const
+  {
+    return m_fold_pool != nullptr && id < static_cast<int>(m_commutative.size()) && m_commutative[id];
+  }
+  void merge_fold(int id, SV& dst, const SV& src)
+  {
+    m_fold_listener(id, FoldStep::Merge, &dst, &src, m_listener_context);
+  }
+
+  //Machine whose values are streamed as records instead of passed to the parent, or 0
+  int m_record_machine = 0;
+  RecordQueue<SV> *m_record_queue = nullptr;
+
 protected:
-  using semantic_value_type = uint64_t;
-  NonRecursiveReductionRunner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
+  //Allocations made by the actions run on this runner's thread
+  Arena m_arena;
+  //Records reduced by this runner and not yet handed to the queue
+  std::vector<SV> m_records;
+
+  BasicNonRecursiveReductionRunner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
     : BaseRunner(filename, bank_size, bank_num, master_pid), m_listener_context(context), reduction_counter(counter)
   {}
+  BasicNonRecursiveReductionRunner(const Input& input, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr, int channel = 0)
+    : BaseRunner(input, bank_size, bank_num, master_pid, channel), m_listener_context(context), reduction_counter(counter)
+  {}
 
   static void push_start_marker(const CSTMarker& marker, std::vector<CSTMarker>& starts, std::vector<detail::StackEntryTag>& tags)
   {
     tags.emplace_back(detail::StackEntryTag::START_MARKER);
     starts.emplace_back(marker);
   }
+  static void push_fold(const semantic_value_type& acc, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  {
+    tags.emplace_back(detail::StackEntryTag::FOLD);
+    values.emplace_back(acc);
+  }
+  bool is_folded(int id) const
+  {
+    return id < static_cast<int>(m_folded.size()) && m_folded[id];
+  }
+  /*!
+   * @brief Pushes a start marker, followed by a fresh accumulator if the machine is folded
+   *
+   * The children of a folded symbol are folded into the accumulator as they
+   * are reduced, so it stays the only value above the start marker.
+   */
+  void open_symbol(const CSTMarker& marker, std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  {
+    push_start_marker(marker, starts, tags);
+    if (is_folded(marker.get_machine_id())) {
+      semantic_value_type acc = semantic_value_type();
+      m_fold_listener(marker.get_machine_id(), FoldStep::Init, &acc, nullptr, m_listener_context);
+      push_fold(acc, values, tags);
+    }
+  }
+  /*!
+   * @brief Pushes the value of a reduced symbol, or folds it into the accumulator of its parent
+   *
+   * A symbol reduced outside of any open symbol belongs to a parent opened
+   * in an earlier bank. If that parent can only be a folded machine, the
+   * value goes into a partial accumulator, which Stage3 merges into the
+   * accumulator of the parent.
+   */
+  void push_child_value(int id, const semantic_value_type& val, const std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  {
+    if (m_fold_listener != nullptr) {
+      int parent = starts.empty() ? fold_parent(id) : starts.back().get_machine_id();
+      if (is_folded(parent)) {
+        if (starts.empty() && is_commutative(parent)) {
+          accumulate_pooled(parent, val);
+          return;
+        }
+        if (starts.empty() && (tags.empty() || tags.back() != detail::StackEntryTag::FOLD)) {
+          semantic_value_type acc = semantic_value_type();
+          m_fold_listener(parent, FoldStep::Init, &acc, nullptr, m_listener_context);
+          push_fold(acc, values, tags);
+        }
+        m_fold_listener(parent, FoldStep::Accumulate, &values.back(), &val, m_listener_context);
+        return;
+      }
+    }
+    push_value(val, values, tags);
+  }
+  /*!
+   * @brief Sets a record aside instead of pushing it, returning false if id is not the record machine
+   */
+  bool take_record(int id, const semantic_value_type& val)
+  {
+    if (id != m_record_machine)
+      return false;
+    m_records.push_back(val);
+    return true;
+  }
+  /*!
+   * @brief Hands the records over to the queue in order, blocking while it is full
+   */
+  void flush_records(std::vector<semantic_value_type>& records)
+  {
+    if (m_record_queue != nullptr) {
+      for (const auto& record : records)
+        m_record_queue->push(record);
+    }
+    records.clear();
+  }
+  /*!
+   * @brief Folds a child of a commutative symbol opened in an earlier bank into the partial accumulator of the bank
+   *
+   * Its order among the other children does not matter, so all of them in
+   * the bank share one partial accumulator, which flush_pooled() hands to
+   * the pool instead of to Stage3.
+   */
+  void accumulate_pooled(int id, const semantic_value_type& val)
+  {
+    auto it = m_pooled.begin();
+    while (it != m_pooled.end() && it->first != id)
+      ++it;
+    if (it == m_pooled.end()) {
+      m_pooled.emplace_back(id, semantic_value_type());
+      it = m_pooled.end() - 1;
+      m_fold_listener(id, FoldStep::Init, &it->second, nullptr, m_listener_context);
+    }
+    m_fold_listener(id, FoldStep::Accumulate, &it->second, &val, m_listener_context);
+  }
+  /*!
+   * @brief Hands the partial accumulators of the bank to the pool
+   */
+  void flush_pooled(int input, int sequence)
+  {
+    for (const auto& p : m_pooled)
+      m_fold_pool->put(input, p.first, sequence, p.second);
+    m_pooled.clear();
+  }
+  void discard_pooled(int input)
+  {
+    if (m_fold_pool != nullptr)
+      m_fold_pool->discard(input);
+  }
+  /*!
+   * @brief Merges what the workers pooled for a commutative symbol into its accumulator
+   *
+   * Called by Stage3 on the end marker of the symbol in the bank sequence,
+   * when every bank up to it has been reduced. The symbol does not nest,
+   * so what is left pooled from those banks is its own; the banks after it
+   * may already hold children of the next occurrence.
+   */
+  void take_pooled(int input, int sequence, const CSTMarker& marker, std::vector<semantic_value_type>& values)
+  {
+    int id = marker.get_machine_id();
+    if (is_commutative(id))
+      m_fold_pool->take(input, id, sequence, values.back(), [this, id](SV& dst, const SV& src) { merge_fold(id, dst, src); });
+  }
+  /*!
+   * @brief Folds a value from another bank into the accumulator of the innermost open symbol
+   *
+   * Returns false if that symbol is not folded.
+   */
+  bool fold_value(const semantic_value_type& val, const std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values)
+  {
+    if (m_fold_listener == nullptr || starts.empty() || !is_folded(starts.back().get_machine_id()))
+      return false;
+    m_fold_listener(starts.back().get_machine_id(), FoldStep::Accumulate, &values.back(), &val, m_listener_context);
+    return true;
+  }
+  /*!
+   * @brief Appends an accumulator from another bank
+   *
+   * Right after the start marker of a folded symbol it is the accumulator of
+   * that symbol; anywhere else it is a partial one, merged into the
+   * accumulator of the innermost open symbol.
+   */
+  void append_fold(const semantic_value_type& acc, const std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  {
+    assert(!starts.empty() && is_folded(starts.back().get_machine_id()));
+    if (tags.back() == detail::StackEntryTag::START_MARKER)
+      push_fold(acc, values, tags);
+    else
+      m_fold_listener(starts.back().get_machine_id(), FoldStep::Merge, &values.back(), &acc, m_listener_context);
+  }
   static void push_end_marker(const CSTMarker& marker, std::vector<CSTMarker>& ends, std::vector<detail::StackEntryTag>& tags)
   {
     tags.emplace_back(detail::StackEntryTag::END_MARKER);
     ends.emplace_back(marker);
   }
-  static void push_value(const semantic_value_type val, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  static void push_value(const semantic_value_type& val, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
   {
-    if (val == 0) return;
-    if (detail::isValueTag(tags.back())) {
+    if (!tags.empty() && detail::isValueTag(tags.back())) {
       tags.back() = static_cast<detail::StackEntryTag>(static_cast<int>(tags.back()) + 1);
     } else {
       tags.emplace_back(detail::StackEntryTag::VALUE);
@@ -66,23 +421,111 @@ protected:
     values.emplace_back(val);
 #endif
   }
-  void reduce_by_end_marker(const CSTMarker& marker, std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  /*!
+   * @brief Pushes the span of a captured terminal given its marker pair
+   */
+  static void push_span(const CSTMarker& start, const CSTMarker& end, std::vector<TokenSpan>& spans, std::vector<detail::StackEntryTag>& tags)
   {
-    assert(marker.get_machine_id() == starts.back().get_machine_id());
-    SymbolEntry sym(marker.get_machine_id(), starts.back().get_offset(), marker.get_offset());
-    int value_count = static_cast<int>(tags.back());
-    if (value_count < 1) {
-      value_count = 0;
+    assert(start.is_start_marker() && end.is_span_marker() && end.is_end_marker());
+    if (!tags.empty() && detail::isSpanTag(tags.back())) {
+      tags.back() = detail::spanTag(detail::spanCount(tags.back()) + 1);
     } else {
-      tags.pop_back();
+      tags.emplace_back(detail::StackEntryTag::SPAN);
     }
-    assert(tags.empty() || !detail::isValueTag(tags.back()));
+    spans.push_back(TokenSpan{static_cast<long>(start.get_offset()), static_cast<long>(end.get_offset())});
+  }
+  /*!
+   * @brief Runs the batch listener on the leaves of batched machines in a bank
+   *
+   * A leaf is a start marker immediately followed by its end marker. Their
+   * values are handed out in bank order by take_batched_leaf().
+   */
+  void reduce_leaf_batches(const uint64_t *src, size_t length)
+  {
+    if (m_batch_listener == nullptr)
+      return;
+    for (auto& batch : m_leaf_batches) {
+      batch.symbols.clear();
+      batch.next = 0;
+    }
+    for (size_t i = 0; i + 1 < length && src[i] != 0; i++) {
+      CSTMarker marker(src[i]);
+      if (marker.is_span_marker()) {
+        i++;
+        continue;
+      }
+      CSTMarker next(src[i + 1]);
+      if (marker.is_start_marker() && is_batched(marker.get_machine_id()) &&
+          next.is_end_marker() && next.get_machine_id() == marker.get_machine_id()) {
+        m_leaf_batches[marker.get_machine_id()].symbols.emplace_back(marker.get_machine_id(), marker.get_offset(), next.get_offset());
+        i++;
+      }
+    }
+    for (auto& batch : m_leaf_batches) {
+      if (batch.symbols.empty())
+        continue;
+      batch.results.resize(batch.symbols.size());
+      m_batch_listener(batch.symbols.data(), static_cast<int>(batch.symbols.size()), batch.results.data(), m_listener_context);
+      if (reduction_counter != nullptr) {
+        (*reduction_counter) += static_cast<int>(batch.symbols.size());
+      }
+    }
+  }
+  /*!
+   * @brief Pushes the batched value of the leaf starting at marker, if it is one
+   *
+   * Returns false if next is not the end of a batched leaf, in which case
+   * nothing is pushed.
+   */
+  bool take_batched_leaf(const CSTMarker& marker, const CSTMarker& next, const std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  {
+    if (m_batch_listener == nullptr || !is_batched(marker.get_machine_id()) ||
+        !next.is_end_marker() || next.get_machine_id() != marker.get_machine_id())
+      return false;
+    LeafBatch& batch = m_leaf_batches[marker.get_machine_id()];
+    assert(batch.next < batch.symbols.size() && batch.symbols[batch.next].start == static_cast<long>(marker.get_offset()));
+    const semantic_value_type& val = batch.results[batch.next++];
+    if (!take_record(marker.get_machine_id(), val))
+      push_child_value(marker.get_machine_id(), val, starts, values, tags);
+    return true;
+  }
+  void reduce_by_end_marker(const CSTMarker& marker, std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<TokenSpan>& spans, std::vector<detail::StackEntryTag>& tags)
+  {
+    assert(marker.get_machine_id() == starts.back().get_machine_id());
+    //Values and spans may interleave when a symbol captures terminals
+    int value_count = 0, span_count = 0;
+    for (; tags.back() != detail::StackEntryTag::START_MARKER; tags.pop_back()) {
+      if (detail::isSpanTag(tags.back())) {
+        span_count += detail::spanCount(tags.back());
+      } else if (tags.back() == detail::StackEntryTag::FOLD) {
+        value_count++;
+      } else {
+        assert(detail::isValueTag(tags.back()));
+        value_count += static_cast<int>(tags.back());
+      }
+    }
+    const TokenSpan *span_data = span_count > 0 ? spans.data() + (spans.size() - span_count) : nullptr;
+    SymbolEntry sym(marker.get_machine_id(), starts.back().get_offset(), marker.get_offset(), span_data, span_count);
+    semantic_value_type new_val;
+    bool has_value;
+    if (value_count == 0 && span_count == 0 && m_batch_listener != nullptr && is_batched(sym.id)) {
+      //A leaf whose markers were split between two banks
+      m_batch_listener(&sym, 1, &new_val, m_listener_context);
+      has_value = true;
+    } else {
 #if PYCENTAURUS
-    auto new_val = m_listener(&sym, values.data(), value_count, m_listener_context);
+    has_value = traits_type::reduce(m_listener, &sym, values.data(), value_count, new_val, m_listener_context);
 #else
-    auto new_val = m_listener(&sym, &values[values.size() - value_count], value_count, m_listener_context);
+    has_value = traits_type::reduce(m_listener, &sym, values.data() + (values.size() - value_count), value_count, new_val, m_listener_context);
+    if (!has_value && is_folded(sym.id)) {
+      //Without a finishing action the accumulator is the value
+      new_val = values.back();
+      has_value = true;
+    }
     values.resize(values.size() - value_count);
 #endif
+    }
+    spans.resize(spans.size() - span_count);
     if (reduction_counter != nullptr) {
       (*reduction_counter)++;
     }
@@ -90,40 +533,174 @@ protected:
     assert(tags.back() == detail::StackEntryTag::START_MARKER);
     tags.pop_back();
     starts.pop_back();
-    push_value(new_val, values, tags);
+    if (has_value && !take_record(sym.id, new_val))
+      push_child_value(sym.id, new_val, starts, values, tags);
 #if PYCENTAURUS
     values.front() = 0;
 #endif
   }
 
+  void *get_listener_context() const
+  {
+    return m_listener_context;
+  }
   void invoke_transfer_listener(int index, int new_index)
   {
     if (m_xferlistener != nullptr)
       m_xferlistener(index, new_index, m_listener_context);
   }
 
+  int m_current_input = -1;
+  //The runners also lay the symbols of each input out in a Tape
+  bool m_tape_mode = false;
+  /*!
+   * @brief Points the actions at the text of the input the bank belongs to
+   */
+  void switch_input(const WindowBankEntry& bank)
+  {
+    if (m_batch == nullptr || bank.input == m_current_input)
+      return;
+    m_current_input = bank.input;
+    m_input_window = m_batch->get(bank.input).get_buffer();
+    if (m_input_listener != nullptr)
+      m_input_listener(bank.input, m_input_window, m_listener_context);
+  }
+
 public:
+  /*!
+   * @brief Returns the arena the actions on this runner allocate from
+   */
+  Arena& get_arena()
+  {
+    return m_arena;
+  }
   virtual void register_python_listener(ReductionListener listener, TransferListener xferlistener) override
   {
-    m_listener = listener;
+    m_listener = traits_type::from_python(listener);
     m_xferlistener = xferlistener;
   }
-  void register_listener(ReductionListener listener)
+  void register_listener(typename traits_type::Listener listener)
   {
     m_listener = listener;
     m_xferlistener = nullptr;
   }
+  /*!
+   * @brief Reduces the leaves of the machines flagged in batched with one call per bank
+   *
+   * The listener receives every leaf of a machine found in a bank and writes
+   * one value per symbol into results, so every batched leaf has a value.
+   * Symbols of these machines that have children still go to the regular
+   * listener.
+   */
+  void register_batch_listener(typename traits_type::BatchListener listener, const std::vector<bool>& batched)
+  {
+    m_batch_listener = listener;
+    m_batched = batched;
+    m_leaf_batches.clear();
+    m_leaf_batches.resize(batched.size());
+  }
+  /*!
+   * @brief Folds the children of the machines flagged in folded as they are reduced
+   *
+   * A folded symbol keeps a single accumulator instead of the values of its
+   * children, and the regular listener receives it as the only value of the
+   * symbol. parents maps each machine to the folded machine that is its only
+   * possible parent, or to 0; children of those are folded into partial
+   * accumulators even when their parent was opened in an earlier bank.
+   */
+  void register_fold_listener(typename traits_type::FoldListener listener, const std::vector<bool>& folded, const std::vector<int>& parents)
+  {
+    m_fold_listener = listener;
+    m_folded = folded;
+    m_fold_parents = parents;
+  }
+  /*!
+   * @brief Lets the folds of the machines flagged in commutative merge their partial accumulators out of order
+   *
+   * The children of such a symbol that Stage2 finds outside any open symbol
+   * are handed to pool as soon as their bank is reduced, rather than passed
+   * to Stage3 in bank order. The symbol receives what was pooled from the
+   * banks up to its end, so this is meant for machines that do not nest,
+   * such as the list of the records of a document, and for folds that do
+   * not depend on the order of the children.
+   */
+  void register_fold_pool(FoldPool<SV> *pool, const std::vector<bool>& commutative)
+  {
+    m_fold_pool = pool;
+    m_commutative = commutative;
+  }
+  /*!
+   * @brief Makes the following runs also materialize the CST of each input as a Tape
+   *
+   * Stage2 writes the nodes of each bank into a segment as it reduces it,
+   * and Stage3 stitches the segments together in bank order. The actions
+   * run as usual.
+   */
+  void enable_tape(bool enable = true)
+  {
+    m_tape_mode = enable;
+  }
+  /*!
+   * @brief Streams the values of the machine into queue, in input order, instead of passing them to the parent
+   *
+   * The symbols of the machine must not nest. Stage2 sets the records of a
+   * bank aside and Stage3 pushes them once the records ending in the
+   * earlier banks have been reduced, so the queue fills in input order and
+   * a full queue stalls Stage3. Pass a null queue to stop streaming.
+   */
+  void set_record_queue(int machine_id, RecordQueue<SV> *queue)
+  {
+    m_record_machine = (queue != nullptr) ? machine_id : 0;
+    m_record_queue = queue;
+    m_records.clear();
+  }
+  /*!
+   * @brief Registers the listener told about the input window of each batch bank
+   */
+  void register_input_listener(InputListener listener)
+  {
+    m_input_listener = listener;
+  }
 };
 
-class Stage2Runner : public NonRecursiveReductionRunner
+typedef BasicNonRecursiveReductionRunner<uint64_t> NonRecursiveReductionRunner;
+
+template<typename SV, typename Traits = ReductionTraits<SV> >
+class BasicStage2Runner : public BasicNonRecursiveReductionRunner<SV, Traits>
 {
   friend BaseRunner;
+  typedef BasicNonRecursiveReductionRunner<SV, Traits> Base;
+  using typename Base::semantic_value_type;
+  using typename Base::WindowBankEntry;
+  using typename Base::WindowBankState;
+  using Base::m_sub_window;
+  using Base::m_main_window;
+  using Base::m_bank_size;
+  using Base::m_bank_num;
+  using Base::m_current_input;
+  using Base::m_tape_mode;
+  using Base::switch_input;
+  using Base::open_symbol;
+  using Base::push_end_marker;
+  using Base::push_span;
+  using Base::reduce_by_end_marker;
+  using Base::reduce_leaf_batches;
+  using Base::take_batched_leaf;
+  using Base::flush_pooled;
+  using Base::m_records;
+  using Base::invoke_transfer_listener;
+  using Base::wait_on_semaphore;
+  using Base::m_arena;
   int m_current_bank;
+  //Machine up to whose last symbol a rejected bank is still reduced, or 0 to drop the bank
+  int m_boundary_machine = 0;
 
 private:
   void thread_runner_impl()
   {
     m_current_bank = -1;
+    m_current_input = -1;
+    m_records.clear();
     while (true) {
       uint64_t *data = reinterpret_cast<uint64_t*>(acquire_bank());
       if (data == NULL) break;
@@ -136,25 +713,44 @@ private:
     auto ptr = new std::tuple<std::vector<CSTMarker>,
                               std::vector<CSTMarker>,
                               std::vector<semantic_value_type>,
-                              std::vector<detail::StackEntryTag>>;
+                              std::vector<TokenSpan>,
+                              std::vector<detail::StackEntryTag>,
+                              Arena,
+                              TapeSegment,
+                              std::vector<semantic_value_type> >;
     auto& starts = std::get<0>(*ptr);
     auto& ends   = std::get<1>(*ptr);
     auto& values = std::get<2>(*ptr);
-    auto& tags   = std::get<3>(*ptr);
+    auto& spans  = std::get<3>(*ptr);
+    auto& tags   = std::get<4>(*ptr);
 #if PYCENTAURUS
     values.emplace_back(0);
 #endif
-    for (int i = 0; i < m_bank_size / 8; i++) {
+    const WindowBankEntry& bank = reinterpret_cast<WindowBankEntry *>(m_sub_window)[m_current_bank];
+    switch_input(bank);
+    //The parser bailed out in the middle of this bank; Stage3 discards the input
+    const int bank_end = bank.rejected ? boundary_end(src) : m_bank_size / 8;
+    reduce_leaf_batches(src, bank_end);
+    for (int i = 0; i < bank_end; i++) {
       if (src[i] == 0) break;
       CSTMarker marker(src[i]);
-      if (marker.is_start_marker()) {
-        push_start_marker(marker, starts, tags);
+      if (marker.is_span_marker()) {
+        //The end marker of a capture always follows in the same bank
+#if !PYCENTAURUS
+        push_span(marker, CSTMarker(src[i + 1]), spans, tags);
+#endif
+        i++;
+      } else if (marker.is_start_marker()) {
+        if (i + 1 < bank_end && take_batched_leaf(marker, CSTMarker(src[i + 1]), starts, values, tags))
+          i++;
+        else
+          open_symbol(marker, starts, values, tags);
       } else if (starts.empty()) {
         assert(marker.is_end_marker());
         push_end_marker(marker, ends, tags);
       } else {
         assert(marker.is_end_marker());
-        reduce_by_end_marker(marker, starts, values, tags);
+        reduce_by_end_marker(marker, starts, values, spans, tags);
       }
     }
 #if PYCENTAURUS
@@ -172,10 +768,37 @@ private:
     std::memcpy(it, tags.data(), tags.size()*sizeof(detail::StackEntryTag));
     assert(reinterpret_cast<uint64_t*>(reinterpret_cast<detail::StackEntryTag*>(it) + tags.size()) < src + m_bank_size / 8);
 #else
+    if (m_tape_mode)
+      std::get<6>(*ptr).build(src, bank_end);
+    //Before the bank is released, so Stage3 finds everything up to it pooled
+    flush_pooled(bank.input, bank.sequence);
+    //The values allocated for this bank travel with it to Stage3
+    std::get<5>(*ptr).splice(m_arena);
+    //So do the records, which Stage3 streams in bank order
+    std::get<7>(*ptr).swap(m_records);
     *src = reinterpret_cast<uint64_t>(ptr);
 #endif
   }
 
+  /*!
+   * @brief Returns the length of the markers of a rejected bank up to the last end of the boundary machine
+   *
+   * The parser terminates the bank where it gave up, and those symbols were
+   * complete before it did.
+   */
+  int boundary_end(const uint64_t *src) const
+  {
+    int end = 0;
+    if (m_boundary_machine == 0)
+      return end;
+    for (int i = 0; i < static_cast<int>(m_bank_size / 8) && src[i] != 0; i++) {
+      CSTMarker marker(src[i]);
+      if (marker.is_end_marker() && marker.get_machine_id() == m_boundary_machine)
+        end = i + 1;
+    }
+    return end;
+  }
+
   void *acquire_bank()
   {
     wait_on_semaphore();
@@ -204,20 +827,42 @@ private:
   }
 
 public:
-  Stage2Runner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
-    : NonRecursiveReductionRunner(filename, bank_size, bank_num, master_pid, context, counter)
+  BasicStage2Runner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
+    : Base(filename, bank_size, bank_num, master_pid, context, counter)
   {
-    acquire_memory(false);
-    open_semaphore();
+    this->acquire_memory(false);
+    this->open_semaphore();
   }
-  virtual ~Stage2Runner()
+  BasicStage2Runner(const Input& input, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr, int channel = 0)
+    : Base(input, bank_size, bank_num, master_pid, context, counter, channel)
   {
-    close_semaphore(false);
-    release_memory(false);
+    this->acquire_memory(false);
+    this->open_semaphore();
+  }
+  virtual ~BasicStage2Runner()
+  {
+    this->close_semaphore(false);
+    this->release_memory(false);
   }
   virtual void start() override
   {
-    _start<Stage2Runner>();
+    this->template _start<BasicStage2Runner>();
+  }
+  virtual void park() override
+  {
+    this->template _park<BasicStage2Runner>();
+  }
+  /*!
+   * @brief Reduces a rejected bank up to the last symbol of the machine instead of dropping it, or stops if 0
+   *
+   * The symbols of the machine must not nest and their parent must be the
+   * root, so that nothing but the root is left open after the last one.
+   */
+  void set_boundary_machine(int machine_id)
+  {
+    m_boundary_machine = machine_id;
   }
 };
+
+typedef BasicStage2Runner<uint64_t> Stage2Runner;
 }
@@ -7,13 +7,46 @@
 namespace Centaurus
 {
 
-class Stage3Runner : public NonRecursiveReductionRunner
+template<typename SV, typename Traits = ReductionTraits<SV> >
+class BasicStage3Runner : public BasicNonRecursiveReductionRunner<SV, Traits>
 {
   friend BaseRunner;
+  typedef BasicNonRecursiveReductionRunner<SV, Traits> Base;
+  using typename Base::semantic_value_type;
+  using typename Base::traits_type;
+  using typename Base::WindowBankEntry;
+  using typename Base::WindowBankState;
+  using Base::m_sub_window;
+  using Base::m_main_window;
+  using Base::m_bank_size;
+  using Base::m_bank_num;
+  using Base::m_batch;
+  using Base::m_current_input;
+  using Base::m_input_window;
+  using Base::m_tape_mode;
+  using Base::switch_input;
+  using Base::push_start_marker;
+  using Base::fold_value;
+  using Base::append_fold;
+  using Base::take_pooled;
+  using Base::reduce_by_end_marker;
+  using Base::invoke_transfer_listener;
+  using Base::get_listener_context;
+  using Base::m_arena;
+  using Base::discard_pooled;
+  using Base::flush_records;
+  using Base::m_records;
   int m_current_bank;
   int m_counter;
   const uint64_t *m_current_window;
   int m_window_position;
+  typename traits_type::Completion m_completion_listener = nullptr;
+  semantic_value_type m_result;
+  //Arena of the last completed input
+  Arena m_result_arena;
+  TapeBuilder m_tape_builder;
+  //Tape of the last completed input
+  Tape m_tape;
 
 private:
   void thread_runner_impl()
@@ -22,17 +55,36 @@ private:
     m_counter = 0;
     m_current_window = NULL;
     m_window_position = 0;
+    m_current_input = -1;
+    m_result = semantic_value_type();
+    m_records.clear();
 
-    reduce();
+    while (reduce());
 
     release_bank();
   }
 
-  semantic_value_type reduce()
+  const WindowBankEntry& current_bank_entry() const
   {
+    return reinterpret_cast<const WindowBankEntry *>(m_sub_window)[m_current_bank];
+  }
+
+  /*!
+   * @brief Reduces the banks of one input up to the one marked last
+   *
+   * Returns false once Stage1 has signaled the end of the run.
+   */
+  bool reduce()
+  {
+    void *first_bank = acquire_bank();
+    if (first_bank == nullptr)
+      return false;
+    const int input = current_bank_entry().input;
+    bool last = current_bank_entry().last;
+    bool rejected = current_bank_entry().rejected;
+    switch_input(current_bank_entry());
 #if PYCENTAURUS
-    auto bank_ptr = reinterpret_cast<uint64_t*>(acquire_bank());
-    assert(bank_ptr != nullptr);
+    auto bank_ptr = reinterpret_cast<uint64_t*>(first_bank);
     std::vector<CSTMarker> starts(*bank_ptr++, CSTMarker(0));
     std::memcpy(starts.data(), bank_ptr, starts.size()*sizeof(CSTMarker));
     bank_ptr += starts.size();
@@ -44,22 +96,36 @@ private:
     bank_ptr += values.size();
     std::vector<detail::StackEntryTag> tags(*bank_ptr++);
     std::memcpy(tags.data(), bank_ptr, tags.size()*sizeof(detail::StackEntryTag));
+    //Python actions do not see captures, so Stage2 drops them
+    std::vector<TokenSpan> spans;
 #else
     auto bank_base_ptr = reinterpret_cast<std::tuple<std::vector<CSTMarker>,
                                                      std::vector<CSTMarker>,
                                                      std::vector<semantic_value_type>,
-                                                     std::vector<detail::StackEntryTag>>**>(acquire_bank());
-    assert(bank_base_ptr != nullptr);
+                                                     std::vector<TokenSpan>,
+                                                     std::vector<detail::StackEntryTag>,
+                                                     Arena,
+                                                     TapeSegment,
+                                                     std::vector<semantic_value_type> >**>(first_bank);
     auto& stack_tuple_base = **bank_base_ptr;
     auto& starts = std::get<0>(stack_tuple_base);
     auto& ends   = std::get<1>(stack_tuple_base);
     auto& values = std::get<2>(stack_tuple_base);
-    auto& tags   = std::get<3>(stack_tuple_base);
+    auto& spans  = std::get<3>(stack_tuple_base);
+    auto& tags   = std::get<4>(stack_tuple_base);
+    m_arena.splice(std::get<5>(stack_tuple_base));
+    if (m_tape_mode) {
+      m_tape_builder.reset(m_input_window);
+      m_tape_builder.append(std::get<6>(stack_tuple_base));
+    }
+    flush_records(std::get<7>(stack_tuple_base));
 #endif
     release_bank();
 
     void *current_bank;
-    while ((current_bank = acquire_bank()) != nullptr) {
+    while (!last && (current_bank = acquire_bank()) != nullptr) {
+      last = current_bank_entry().last;
+      rejected = current_bank_entry().rejected;
 #if PYCENTAURUS
       auto bank_ptr = reinterpret_cast<uint64_t*>(current_bank);
       detail::ConstPtrRange<CSTMarker> starts_next(reinterpret_cast<CSTMarker*>(bank_ptr + 1), bank_ptr[0]);
@@ -69,16 +135,22 @@ private:
       detail::ConstPtrRange<semantic_value_type> values_next(bank_ptr + 1, bank_ptr[0]);
       bank_ptr += values_next.size() + 1;
       detail::ConstPtrRange<detail::StackEntryTag> tags_next(reinterpret_cast<detail::StackEntryTag*>(bank_ptr + 1), bank_ptr[0]);
+      std::vector<TokenSpan> spans_next;
 #else
-      auto& stack_tuple = **reinterpret_cast<std::decay<decltype(stack_tuple_base)>::type**>(current_bank);
+      auto& stack_tuple = **reinterpret_cast<typename std::decay<decltype(stack_tuple_base)>::type**>(current_bank);
       auto& starts_next = std::get<0>(stack_tuple);
       auto& ends_next   = std::get<1>(stack_tuple);
       auto& values_next = std::get<2>(stack_tuple);
-      auto& tags_next   = std::get<3>(stack_tuple);
+      auto& spans_next  = std::get<3>(stack_tuple);
+      auto& tags_next   = std::get<4>(stack_tuple);
+      m_arena.splice(std::get<5>(stack_tuple));
+      if (m_tape_mode)
+        m_tape_builder.append(std::get<6>(stack_tuple));
 #endif
       auto starts_next_it = starts_next.begin();
       auto ends_next_it   = ends_next.begin();
       auto values_next_it = values_next.begin();
+      auto spans_next_it  = spans_next.begin();
       for (auto cur_tag : tags_next) {
         switch (cur_tag) {
         case detail::StackEntryTag::START_MARKER:
@@ -86,39 +158,77 @@ private:
           break;
         case detail::StackEntryTag::END_MARKER: {
           assert(!starts.empty());
-          reduce_by_end_marker(*ends_next_it++, starts, values, tags);
+          take_pooled(input, current_bank_entry().sequence, *ends_next_it, values);
+          reduce_by_end_marker(*ends_next_it++, starts, values, spans, tags);
         } break;
+        case detail::StackEntryTag::FOLD:
+          append_fold(*values_next_it++, starts, values, tags);
+          break;
         default:
+          if (detail::isSpanTag(cur_tag)) {
+            append_spans(spans_next_it, detail::spanCount(cur_tag), spans, tags);
+            break;
+          }
           assert(detail::isValueTag(cur_tag));
-          append_value(values_next_it, static_cast<int>(cur_tag), values, tags);
+          append_value(values_next_it, static_cast<int>(cur_tag), starts, values, tags);
           break;
         }
       }
       assert(starts_next_it == starts_next.end());
       assert(ends_next_it == ends_next.end());
+      assert(spans_next_it == spans_next.end());
 #if !PYCENTAURUS
       assert(values_next_it == values_next.end());
 #endif
 #if !PYCENTAURUS
+      //A record reduced here started in an earlier bank, so it precedes those inside the bank
+      flush_records(m_records);
+      flush_records(std::get<7>(stack_tuple));
       delete &stack_tuple;
 #endif
       release_bank();
     }
-    assert(starts.empty());
-    assert(ends.empty());
-    assert(values.size() <= 1);
-    assert(tags.size() <= 1);
-
-    auto result = (values.empty()) ? 0 : std::move(values.front());
+    semantic_value_type result = semantic_value_type();
+    if (!rejected) {
+      assert(starts.empty());
+      assert(ends.empty());
+      assert(spans.empty());
+      assert(values.size() <= 1);
+      assert(tags.size() <= 1);
+      result = (values.empty()) ? semantic_value_type() : values.front();
+    }
 #if !PYCENTAURUS
     delete &stack_tuple_base;
 #endif
-    return result;
+    complete(input, !rejected, result);
+    return true;
+  }
+  void complete(int input, bool accepted, const semantic_value_type& result)
+  {
+    m_result = result;
+    //Releases the values of the previous input
+    m_result_arena = std::move(m_arena);
+    discard_pooled(input);
+    if (m_batch != nullptr)
+      accepted = m_batch->close(input) && accepted;
+    //A rejected input leaves symbols open
+    m_tape = (m_tape_mode && accepted) ? m_tape_builder.finish() : Tape();
+    if (m_completion_listener != nullptr)
+      traits_type::complete(m_completion_listener, input, accepted, result, get_listener_context());
   }
   template <typename Iterator>
-  static void append_value(Iterator& values_next_it, int n, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
+  void append_value(Iterator& values_next_it, int n, const std::vector<CSTMarker>& starts, std::vector<semantic_value_type>& values, std::vector<detail::StackEntryTag>& tags)
   {
-    if (detail::isValueTag(tags.back())) {
+#if !PYCENTAURUS
+    //The children of a folded symbol opened in an earlier bank
+    if (fold_value(*values_next_it, starts, values)) {
+      values_next_it++;
+      for (int i = 1; i < n; i++)
+        fold_value(*values_next_it++, starts, values);
+      return;
+    }
+#endif
+    if (!tags.empty() && detail::isValueTag(tags.back())) {
       tags.back() = static_cast<detail::StackEntryTag>(static_cast<int>(tags.back()) + n);
     } else {
       tags.emplace_back(static_cast<detail::StackEntryTag>(n));
@@ -131,6 +241,18 @@ private:
     }
 #endif
   }
+  template <typename Iterator>
+  static void append_spans(Iterator& spans_next_it, int n, std::vector<TokenSpan>& spans, std::vector<detail::StackEntryTag>& tags)
+  {
+    if (!tags.empty() && detail::isSpanTag(tags.back())) {
+      tags.back() = detail::spanTag(detail::spanCount(tags.back()) + n);
+    } else {
+      tags.emplace_back(detail::spanTag(n));
+    }
+    for (int i = 0; i < n; i++) {
+      spans.push_back(*spans_next_it++);
+    }
+  }
 
   void *acquire_bank()
   {
@@ -162,18 +284,57 @@ private:
   }
 
 public:
-  Stage3Runner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
-    : NonRecursiveReductionRunner(filename, bank_size, bank_num, master_pid, context, counter)
+  BasicStage3Runner(const char *filename, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr)
+    : Base(filename, bank_size, bank_num, master_pid, context, counter)
   {
-    acquire_memory(false);
+    this->acquire_memory(false);
   }
-  virtual ~Stage3Runner()
+  BasicStage3Runner(const Input& input, size_t bank_size, int bank_num, int master_pid, void *context = nullptr, std::atomic<int> *counter = nullptr, int channel = 0)
+    : Base(input, bank_size, bank_num, master_pid, context, counter, channel)
   {
-    release_memory(false);
+    this->acquire_memory(false);
+  }
+  virtual ~BasicStage3Runner()
+  {
+    this->release_memory(false);
   }
   virtual void start() override
   {
-    _start<Stage3Runner>();
+    this->template _start<BasicStage3Runner>();
+  }
+  virtual void park() override
+  {
+    this->template _park<BasicStage3Runner>();
+  }
+  /*!
+   * @brief Registers the listener called after the last bank of each input
+   */
+  void register_completion_listener(typename traits_type::Completion listener)
+  {
+    m_completion_listener = listener;
+  }
+  /*!
+   * @brief Returns the value of the root symbol of the last input
+   */
+  semantic_value_type get_result() const
+  {
+    return m_result;
+  }
+  /*!
+   * @brief Hands over the values allocated while reducing the last input
+   */
+  Arena take_result_arena()
+  {
+    return std::move(m_result_arena);
+  }
+  /*!
+   * @brief Hands over the tape of the last input, which is empty if it was rejected or tapes are not enabled
+   */
+  Tape take_tape()
+  {
+    return std::move(m_tape);
   }
 };
+
+typedef BasicStage3Runner<uint64_t> Stage3Runner;
 }
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "BaseRunner.hpp"
+#include "TextView.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Node of a Tape: a symbol with its machine id, bounds and subtree size
+ *
+ * 16 bytes. The length is stored in 32 bits; the end of a longer symbol is
+ * kept aside by the tape.
+ */
+class TapeNode
+{
+    uint64_t m_head;
+    uint32_t m_length;
+    uint32_t m_size;
+    static constexpr uint64_t OFFSET_MASK = ((uint64_t)1 << 48) - 1;
+public:
+    static constexpr uint32_t LONG_LENGTH = UINT32_MAX;
+
+    TapeNode(int id, uint64_t start)
+        : m_head(((uint64_t)id << 48) | start), m_length(0), m_size(1)
+    {
+    }
+    int id() const
+    {
+        return static_cast<int>(m_head >> 48);
+    }
+    uint64_t start() const
+    {
+        return m_head & OFFSET_MASK;
+    }
+    uint32_t length() const
+    {
+        return m_length;
+    }
+    /*!
+     * @brief Returns the number of nodes in the subtree, including this one
+     */
+    uint32_t size() const
+    {
+        return m_size;
+    }
+    /*!
+     * @brief Sets the end of the node; returns false if it is too long to be stored inline
+     */
+    bool close(uint64_t end, uint64_t size)
+    {
+        assert(size <= UINT32_MAX);
+        m_size = static_cast<uint32_t>(size);
+        uint64_t length = end - start();
+        m_length = (length < LONG_LENGTH) ? static_cast<uint32_t>(length) : LONG_LENGTH;
+        return length < LONG_LENGTH;
+    }
+};
+/*!
+ * @brief Nodes of one bank, written by the Stage2 worker that reduced it
+ *
+ * The nodes are in pre-order. Nodes opened in the bank and closed in a later
+ * one are listed in opens, and the end markers of nodes opened in earlier
+ * banks in closes, along with the number of nodes of the segment that
+ * precede them.
+ */
+struct TapeSegment
+{
+    std::vector<TapeNode> nodes;
+    std::vector<std::pair<uint64_t, size_t> > closes;
+    std::vector<size_t> opens;
+    //Local index and end of the nodes too long for TapeNode
+    std::vector<std::pair<size_t, uint64_t> > long_ends;
+
+    void clear()
+    {
+        nodes.clear();
+        closes.clear();
+        opens.clear();
+        long_ends.clear();
+    }
+    /*!
+     * @brief Appends the nodes of the markers in a bank, up to the first 0 word
+     */
+    void build(const uint64_t *src, size_t length)
+    {
+        for (size_t i = 0; i < length && src[i] != 0; i++)
+        {
+            CSTMarker marker(src[i]);
+            if (marker.is_span_marker())
+            {
+                i++;
+            }
+            else if (marker.is_start_marker())
+            {
+                opens.push_back(nodes.size());
+                nodes.emplace_back(marker.get_machine_id(), marker.get_offset());
+            }
+            else if (opens.empty())
+            {
+                closes.emplace_back(marker.get_offset(), nodes.size());
+            }
+            else
+            {
+                size_t index = opens.back();
+                opens.pop_back();
+                if (!nodes[index].close(marker.get_offset(), nodes.size() - index))
+                    long_ends.emplace_back(index, marker.get_offset());
+            }
+        }
+    }
+};
+class TapeCursor;
+/*!
+ * @brief CST of an input laid out as one contiguous array of nodes in pre-order
+ *
+ * The children of a node follow it, and its next sibling comes after its
+ * whole subtree, so a subtree is skipped in constant time. The tape refers
+ * to the text through offsets into the input, which must outlive it for
+ * the text of the nodes to be read.
+ */
+class Tape
+{
+    friend class TapeCursor;
+    friend class TapeBuilder;
+    std::vector<TapeNode> m_nodes;
+    std::unordered_map<size_t, uint64_t> m_long_ends;
+    const void *m_window;
+public:
+    Tape() : m_window(nullptr)
+    {
+    }
+    size_t size() const
+    {
+        return m_nodes.size();
+    }
+    bool empty() const
+    {
+        return m_nodes.empty();
+    }
+    const TapeNode& operator[](size_t index) const
+    {
+        return m_nodes[index];
+    }
+    uint64_t end(size_t index) const
+    {
+        const TapeNode& node = m_nodes[index];
+        return (node.length() != TapeNode::LONG_LENGTH) ? node.start() + node.length() : m_long_ends.at(index);
+    }
+    const void *get_window() const
+    {
+        return m_window;
+    }
+    /*!
+     * @brief Returns a cursor on the root symbol
+     */
+    TapeCursor root() const;
+};
+/*!
+ * @brief Position in a Tape, bounded by the subtree of the parent
+ */
+class TapeCursor
+{
+    const Tape *m_tape;
+    size_t m_index, m_bound;
+public:
+    TapeCursor(const Tape& tape, size_t index, size_t bound)
+        : m_tape(&tape), m_index(index), m_bound(bound)
+    {
+    }
+    /*!
+     * @brief False once the cursor has moved past the last sibling
+     */
+    bool valid() const
+    {
+        return m_index < m_bound;
+    }
+    size_t index() const
+    {
+        return m_index;
+    }
+    int id() const
+    {
+        return (*m_tape)[m_index].id();
+    }
+    uint64_t start() const
+    {
+        return (*m_tape)[m_index].start();
+    }
+    uint64_t end() const
+    {
+        return m_tape->end(m_index);
+    }
+    /*!
+     * @brief Returns the number of nodes in the subtree, including this one
+     */
+    size_t subtree_size() const
+    {
+        return (*m_tape)[m_index].size();
+    }
+    bool has_children() const
+    {
+        return subtree_size() > 1;
+    }
+    /*!
+     * @brief Returns a cursor on the first child, which is invalid if there is none
+     */
+    TapeCursor first_child() const
+    {
+        return TapeCursor(*m_tape, m_index + 1, m_index + subtree_size());
+    }
+    /*!
+     * @brief Moves to the next sibling, skipping the subtree of the current node
+     */
+    void next()
+    {
+        m_index += subtree_size();
+    }
+    TapeCursor next_sibling() const
+    {
+        TapeCursor cursor(*this);
+        cursor.next();
+        return cursor;
+    }
+    /*!
+     * @brief Returns the text of the node in the input the tape was built from
+     */
+    template<typename TCHAR>
+    TextView<TCHAR> view() const
+    {
+        const TCHAR *window = static_cast<const TCHAR *>(m_tape->get_window());
+        return TextView<TCHAR>(window + start(), window + end());
+    }
+};
+inline TapeCursor Tape::root() const
+{
+    return TapeCursor(*this, 0, m_nodes.empty() ? 0 : m_nodes[0].size());
+}
+/*!
+ * @brief Stitches the segments of the banks of an input into a Tape, in bank order
+ */
+class TapeBuilder
+{
+    Tape m_tape;
+    //Global indices of the nodes whose end has not been seen yet
+    std::vector<size_t> m_open;
+public:
+    void reset(const void *window)
+    {
+        m_tape = Tape();
+        m_tape.m_window = window;
+        m_open.clear();
+    }
+    void append(const TapeSegment& segment)
+    {
+        std::vector<TapeNode>& nodes = m_tape.m_nodes;
+        size_t base = nodes.size();
+        //All of them precede the nodes the segment leaves open
+        for (const auto& close : segment.closes)
+        {
+            assert(!m_open.empty());
+            size_t index = m_open.back();
+            m_open.pop_back();
+            if (!nodes[index].close(close.first, base + close.second - index))
+                m_tape.m_long_ends[index] = close.first;
+        }
+        nodes.insert(nodes.end(), segment.nodes.begin(), segment.nodes.end());
+        for (const auto& p : segment.long_ends)
+            m_tape.m_long_ends[base + p.first] = p.second;
+        for (size_t index : segment.opens)
+            m_open.push_back(base + index);
+    }
+    /*!
+     * @brief Returns the tape, which is complete if every node has been closed
+     */
+    Tape finish()
+    {
+        assert(m_open.empty());
+        m_open.clear();
+        return std::move(m_tape);
+    }
+};
+}
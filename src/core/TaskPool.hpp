@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arena.hpp"
+
+namespace Centaurus
+{
+/*!
+ * @brief Work-stealing thread pool for actions taken off the reduction workers
+ *
+ * Each thread has a queue of its own and an arena for what the tasks
+ * allocate. Tasks submitted from outside the pool are dealt round-robin over
+ * the queues; a thread runs its own queue newest first and steals the
+ * oldest task of another queue when its own is empty. A thread waiting for
+ * a task can run queued tasks in the meantime with run_one(), so waiting
+ * never deadlocks the pool.
+ */
+class TaskPool
+{
+public:
+    //Called with the arena and the worker index of the thread running the task
+    typedef std::function<void(Arena& arena, int worker)> Task;
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        Arena arena;
+    };
+    std::vector<std::unique_ptr<Queue> > m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_idle;
+    //Submitted and not yet finished
+    std::atomic<int> m_pending;
+    //Waiting in the queues
+    std::atomic<int> m_queued;
+    std::atomic<unsigned> m_next_queue;
+    std::atomic<int> m_worker_base;
+    bool m_stopping;
+
+    bool pop(int index, Task& task, bool steal)
+    {
+        Queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        m_queued--;
+        if (steal)
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        return true;
+    }
+    bool take(int home, Task& task)
+    {
+        int n = static_cast<int>(m_queues.size());
+        if (home >= 0 && pop(home, task, false))
+            return true;
+        int start = (home >= 0) ? home + 1 : static_cast<int>(m_next_queue.load() % n);
+        for (int i = 0; i < n; i++)
+        {
+            int victim = (start + i) % n;
+            if (victim != home && pop(victim, task, true))
+                return true;
+        }
+        return false;
+    }
+    void finish()
+    {
+        if (--m_pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_idle.notify_all();
+        }
+    }
+    void thread_main(int index)
+    {
+        Queue& queue = *m_queues[index];
+        Task task;
+        while (true)
+        {
+            if (take(index, task))
+            {
+                task(queue.arena, m_worker_base + index);
+                task = nullptr;
+                finish();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_wakeup.wait(lock, [this]{ return m_stopping || m_queued > 0; });
+            if (m_stopping)
+                return;
+        }
+    }
+public:
+    explicit TaskPool(int thread_num)
+        : m_pending(0), m_queued(0), m_next_queue(0), m_worker_base(0), m_stopping(false)
+    {
+        if (thread_num < 1)
+            thread_num = 1;
+        for (int i = 0; i < thread_num; i++)
+            m_queues.emplace_back(new Queue());
+        for (int i = 0; i < thread_num; i++)
+            m_threads.emplace_back(&TaskPool::thread_main, this, i);
+    }
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+    ~TaskPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_stopping = true;
+            m_wakeup.notify_all();
+        }
+        for (auto& t : m_threads)
+            t.join();
+    }
+    int size() const
+    {
+        return static_cast<int>(m_threads.size());
+    }
+    /*!
+     * @brief Sets the worker index of the first pool thread
+     *
+     * The pool threads take the indices after those of the reduction workers,
+     * so their Aggregator shards do not collide.
+     */
+    void set_worker_base(int base)
+    {
+        m_worker_base = base;
+    }
+    void submit(Task task)
+    {
+        m_pending++;
+        Queue& queue = *m_queues[m_next_queue++ % m_queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+            m_queued++;
+        }
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_wakeup.notify_one();
+    }
+    /*!
+     * @brief Runs one queued task on the calling thread, if there is one
+     */
+    bool run_one(Arena& arena, int worker)
+    {
+        Task task;
+        if (!take(-1, task))
+            return false;
+        task(arena, worker);
+        finish();
+        return true;
+    }
+    /*!
+     * @brief Runs queued tasks on the calling thread until every submitted task has finished
+     */
+    void wait(Arena& arena, int worker)
+    {
+        while (m_pending > 0)
+        {
+            if (run_one(arena, worker))
+                continue;
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_idle.wait_for(lock, std::chrono::milliseconds(1), [this]{ return m_pending == 0 || m_queued > 0; });
+        }
+    }
+    /*!
+     * @brief Moves what the tasks allocated on the pool threads into arena
+     *
+     * Only while no task is running.
+     */
+    void take_arenas(Arena& arena)
+    {
+        for (auto& queue : m_queues)
+            arena.splice(queue->arena);
+    }
+};
+}
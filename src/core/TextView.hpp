@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Centaurus
+{
+/*!
+ * @brief Non-owning view of a range of the input text
+ *
+ * Valid only as long as the input it points into, which for a symbol passed
+ * to an action means until the parse returns.
+ */
+template<typename TCHAR>
+class TextView
+{
+    const TCHAR *m_first, *m_last;
+public:
+    TextView() : m_first(nullptr), m_last(nullptr) {}
+    TextView(const TCHAR *first, const TCHAR *last) : m_first(first), m_last(last) {}
+    TextView(const TCHAR *first, size_t length) : m_first(first), m_last(first + length) {}
+    const TCHAR *data() const
+    {
+        return m_first;
+    }
+    const TCHAR *begin() const
+    {
+        return m_first;
+    }
+    const TCHAR *end() const
+    {
+        return m_last;
+    }
+    size_t size() const
+    {
+        return m_last - m_first;
+    }
+    bool empty() const
+    {
+        return m_first == m_last;
+    }
+    TCHAR operator[](size_t i) const
+    {
+        return m_first[i];
+    }
+    /*!
+     * @brief Returns the view of count characters from pos, clamped to the end
+     */
+    TextView substr(size_t pos, size_t count = SIZE_MAX) const
+    {
+        size_t n = size();
+        if (pos > n)
+            pos = n;
+        if (count > n - pos)
+            count = n - pos;
+        return TextView(m_first + pos, count);
+    }
+    /*!
+     * @brief Drops leading and trailing spaces, tabs and line breaks
+     */
+    TextView trim() const
+    {
+        const TCHAR *first = m_first, *last = m_last;
+        while (first != last && is_space(*first))
+            first++;
+        while (last != first && is_space(last[-1]))
+            last--;
+        return TextView(first, last);
+    }
+    std::basic_string<TCHAR> str() const
+    {
+        return std::basic_string<TCHAR>(m_first, m_last);
+    }
+    bool equals(const TCHAR *s, size_t length) const
+    {
+        return size() == length && std::char_traits<TCHAR>::compare(m_first, s, length) == 0;
+    }
+    bool operator==(const std::basic_string<TCHAR>& s) const
+    {
+        return equals(s.data(), s.size());
+    }
+    bool operator!=(const std::basic_string<TCHAR>& s) const
+    {
+        return !equals(s.data(), s.size());
+    }
+    bool operator==(const TCHAR *s) const
+    {
+        return equals(s, std::char_traits<TCHAR>::length(s));
+    }
+    bool operator!=(const TCHAR *s) const
+    {
+        return !(*this == s);
+    }
+    bool operator==(const TextView& v) const
+    {
+        return equals(v.data(), v.size());
+    }
+    bool operator!=(const TextView& v) const
+    {
+        return !equals(v.data(), v.size());
+    }
+private:
+    static bool is_space(TCHAR c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+};
+}
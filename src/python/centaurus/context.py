@@ -14,7 +14,7 @@ class Stage1Worker(object):
         self.parser = Parser(self.context.grammar)
         self.runner = None
         self.core_affinity=core_affinity
-    def parse(self, path):
+    def parse(self, path, record_id=0):
         self.runner = Stage1Runner(path, self.parser, self.context.bank_size, self.context.bank_num)
         self.runner.start()
     def start(self):
@@ -43,8 +43,8 @@ class SubprocessWorker:
     def stop(self):
         self.cmd_queue.put(('stop', None))
         self.proc.join()
-    def parse(self, path):
-        self.cmd_queue.put(('parse', path))
+    def parse(self, path, record_id=0):
+        self.cmd_queue.put(('parse', (path, record_id)))
     def attach(self, listener):
         self.listener = listener
     def set_core_affinity(self, core_affinity):
@@ -61,28 +61,34 @@ class SubprocessWorker:
             if cmd == 'stop':
                 break
             elif cmd == 'parse':
-                self.parse_impl(arg)
+                self.parse_impl(*arg)
 
 class Stage2Worker(SubprocessWorker):
-    def parse_impl(self, path):
+    def parse_impl(self, path, record_id):
         runner = Stage2Runner(path, self.context.bank_size, self.context.bank_num, self.master_pid)
-        adapter = Stage2ListenerAdapter(self.context.grammar, self.listener, self.context.channels, runner.get_window())
+        adapter = Stage2ListenerAdapter(self.context.grammar, self.listener, self.context.channels, runner.get_window(), record_id)
         runner.attach(adapter.reduction_callback, adapter.transfer_callback)
         runner.start()
         runner.wait()
 
 class Stage3Worker(SubprocessWorker):
-    def parse_impl(self, path):
+    def parse_impl(self, path, record_id):
         runner = Stage3Runner(path, self.context.bank_size, self.context.bank_num, self.master_pid)
-        adapter = Stage3ListenerAdapter(self.context.grammar, self.listener, self.context.channels, runner.get_window())
+        sink = self.context.record_queue if record_id else None
+        adapter = Stage3ListenerAdapter(self.context.grammar, self.listener, self.context.channels, runner.get_window(), record_id, sink)
         runner.attach(adapter.reduction_callback, adapter.transfer_callback)
         runner.start()
         runner.wait()
+        if sink is not None:
+            adapter.flush_records()
+            sink.put(None)
         assert len(adapter.values) <= 1
         self.context.drain.put(adapter.values[0] if adapter.values else None)
 
 class Context(object):
     bank_size = 8 * 1024 * 1024
+    #Records waiting for the consumer of records() before Stage3 stalls
+    record_capacity = 1024
     def __init__(self, grammar_path):
         self.grammar = Grammar(grammar_path)
         self.drain = mp.Queue()
@@ -90,6 +96,7 @@ class Context(object):
     def start(self, num_workers=1):
         self.bank_num = num_workers * 2
         self.channels = tuple(mp.Queue() for _ in range(self.bank_num))
+        self.record_queue = mp.Queue(self.record_capacity)
         self.parallel_workers = tuple(Stage2Worker(self) for _ in range(num_workers))
         for w in itertools.chain(self.serial_workers, self.parallel_workers):
             w.attach(self.listener)
@@ -98,9 +105,29 @@ class Context(object):
         for w in itertools.chain(self.serial_workers, self.parallel_workers):
             w.parse(path)
         return self.drain.get()
+    def records(self, path, machine_name):
+        """Yields the values of the symbols of machine_name in input order while the file is parsed.
+
+        They are not passed to the parent symbols. The symbols must not nest."""
+        record_id = self.grammar.get_machine_id(machine_name)
+        for w in itertools.chain(self.serial_workers, self.parallel_workers):
+            w.parse(path, record_id)
+        done = False
+        try:
+            while True:
+                record = self.record_queue.get()
+                if record is None:
+                    done = True
+                    break
+                yield record
+        finally:
+            #NOTE: the workers finish the file even if the consumer stops early
+            while not done:
+                done = self.record_queue.get() is None
+            self.drain.get()
     def stop(self):
         for w in itertools.chain(self.serial_workers, self.parallel_workers):
             w.stop()
-        del self.bank_num, self.channels, self.parallel_workers
+        del self.bank_num, self.channels, self.record_queue, self.parallel_workers
     def attach(self, listener):
         self.listener = listener
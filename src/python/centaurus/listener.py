@@ -15,10 +15,11 @@ class GrammarException(Exception):
 class BaseListenerAdapter(object):
     default_handler_name = 'defaultact'
 
-    def __init__(self, grammar, handler, channels, window):
+    def __init__(self, grammar, handler, channels, window, record_id=0):
         self.grammar = grammar
         self.window = window
         self.channels = channels
+        self.record_id = record_id #NOTE: values of this machine are streamed instead of passed to the parent
         self.handlers = [None] #NOTE: padding for 1-based symbol.id
         for index in range(1, grammar.get_machine_num() + 1):
             handler_name = 'parse' + grammar.get_machine_name(index)
@@ -36,6 +37,9 @@ class BaseListenerAdapter(object):
         del self.values[len(self.values) - argc:]
         if lhs_value is None:
             return 0
+        elif symbol.id == self.record_id:
+            self.take_record(lhs_value)
+            return 0
         else:
             self.values.append(lhs_value)
             return 1
@@ -54,9 +58,10 @@ class BaseListenerAdapter(object):
         return (self.values[i] for i in range(len(self.values) - self.argc, len(self.values)))
 
 class Stage2ListenerAdapter(BaseListenerAdapter):
-    def __init__(self, grammar, handler, channels, window):
-        super(Stage2ListenerAdapter, self).__init__(grammar, handler, channels, window)
+    def __init__(self, grammar, handler, channels, window, record_id=0):
+        super(Stage2ListenerAdapter, self).__init__(grammar, handler, channels, window, record_id)
         self.values = None
+        self.records = None
         self.page_index = -1
         self.run_time = 0.0
 
@@ -73,18 +78,25 @@ class Stage2ListenerAdapter(BaseListenerAdapter):
             end_time = time.time()
             self.run_time += end_time - self.start_time
             logger.debug("Stage2 cumulative runtime = %f[s]" % (self.run_time,))
-            self.channels[index].put(self.values)
+            self.channels[index].put((self.values, self.records))
             self.values = None
+            self.records = None
         else:
             self.page_index = new_index
             self.values = []
+            self.records = []
             self.start_time = time.time()
 
+    def take_record(self, value):
+        self.records.append(value)
+
 class Stage3ListenerAdapter(BaseListenerAdapter):
-    def __init__(self, grammar, handler, channels, window):
-        super(Stage3ListenerAdapter, self).__init__(grammar, handler, channels, window)
+    def __init__(self, grammar, handler, channels, window, record_id=0, sink=None):
+        super(Stage3ListenerAdapter, self).__init__(grammar, handler, channels, window, record_id)
         self.valueiters = collections.deque()
         self.values = None
+        self.sink = sink
+        self.page_records = []
         self.start_time = time.time()
         self.run_time = 0.0
 
@@ -105,8 +117,20 @@ class Stage3ListenerAdapter(BaseListenerAdapter):
             logger.debug(traceback.format_exc())
             sys.exit()
 
+    def take_record(self, value):
+        #NOTE: a record reduced here started on an earlier page, so it precedes those inside the current page
+        self.sink.put(value)
+
+    def flush_records(self):
+        for value in self.page_records:
+            self.sink.put(value)
+        self.page_records = []
+
     def transfer_callback(self, index, new_index):
-        values = self.channels[index].get()
+        values, records = self.channels[index].get()
+        if self.sink is not None:
+            self.flush_records()
+            self.page_records = records
         if self.values is None:
             self.values = values
         else:
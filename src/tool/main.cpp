@@ -47,9 +47,10 @@ int main(int argc, char *argv[])
 		GenerateNFA,
 		GenerateLDFA,
 		GenerateDFA,
+		GenerateIds,
 		VerifyGrammar
 	} mode;
-    std::string output_path, grammar_path, atn_path, machine_name, pattern_string;
+    std::string output_path, grammar_path, atn_path, machine_name, pattern_string, struct_name;
     int max_depth = 3;
 	bool help_flag = false, optimize_flag = false;
 
@@ -150,6 +151,21 @@ int main(int argc, char *argv[])
                 ),
                 clipp::option("--optimize").set(optimize_flag, true)
             ),
+            (
+                clipp::command("generate-ids").set(mode, GenerateIds),
+                (
+                    clipp::in_sequence
+                    (
+                        clipp::required("-g", "--grammar-file").set(source, GrammarFileSource),
+                        clipp::value("grammar file", grammar_path)
+                    ),
+                    clipp::in_sequence
+                    (
+                        clipp::option("-n", "--name"),
+                        clipp::value("struct name", struct_name)
+                    ).doc("Name of the generated struct (defaults to the grammar name)")
+                )
+            ).doc("Generate a C++ header with the machine ids and the dispatch of a StaticContext"),
 			(
 				clipp::command("verify-grammar").set(mode, VerifyGrammar),
 				clipp::in_sequence
@@ -205,6 +221,9 @@ int main(int argc, char *argv[])
                 case GenerateDFA:
                     grammar->print_dfa(output_stream, ATNPath(enc.mbstowcs(atn_path)), optimize_flag);
                     return 0;
+                case GenerateIds:
+                    grammar->print_ids(output_stream, enc.mbstowcs(struct_name));
+                    return 0;
                 case VerifyGrammar:
                     if (!grammar->verify())
                     {
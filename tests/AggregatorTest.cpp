@@ -0,0 +1,64 @@
+#include "CppUnitTest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Aggregator.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	TEST_CLASS(AggregatorTest)
+	{
+	public:
+		TEST_METHOD(ShardedAggregation1)
+		{
+			const int workers = 4;
+			Counter counter;
+			Min<int> min;
+			Max<int> max;
+			Histogram<std::string> histogram;
+			GroupBy<int, long> sums;
+			counter.reserve(workers);
+			min.reserve(workers);
+			max.reserve(workers);
+			histogram.reserve(workers);
+			sums.reserve(workers);
+
+			std::vector<std::thread> threads;
+			for (int w = 0; w < workers; w++)
+			{
+				threads.emplace_back([&, w]() {
+					for (int i = 0; i < 100000; i++)
+					{
+						int v = w * 100000 + i;
+						counter.add(w);
+						min.add(w, v);
+						max.add(w, v);
+						histogram.add(w, (v % 2 == 0) ? "even" : "odd");
+						sums.add(w, v % 10, v);
+					}
+				});
+			}
+			for (auto& t : threads)
+				t.join();
+
+			Assert::IsTrue(counter.total() == 400000);
+			Assert::AreEqual(0, min.value());
+			Assert::AreEqual(399999, max.value());
+			auto counts = histogram.merge();
+			Assert::IsTrue(counts["even"] == 200000 && counts["odd"] == 200000);
+			auto totals = sums.merge();
+			long all = 0;
+			for (const auto& p : totals)
+				all += p.second;
+			Assert::IsTrue(totals.size() == 10 && all == 399999L * 400000 / 2);
+
+			counter.clear();
+			Assert::IsTrue(counter.total() == 0);
+		}
+	};
+}
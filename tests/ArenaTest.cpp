@@ -0,0 +1,53 @@
+#include "CppUnitTest.h"
+
+#include <string>
+
+#include "Arena.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	struct CountedObject
+	{
+		int& counter;
+		std::string label;
+		CountedObject(int& counter, const char *label) : counter(counter), label(label)
+		{
+			counter++;
+		}
+		~CountedObject()
+		{
+			counter--;
+		}
+	};
+
+	TEST_CLASS(ArenaTest)
+	{
+	public:
+		TEST_METHOD(SpliceAndClear1)
+		{
+			int live = 0;
+			Arena worker, result;
+
+			for (int i = 0; i < 10000; i++)
+				worker.create<CountedObject>(live, "node");
+			//Large allocations get a chunk of their own
+			char *large = static_cast<char *>(worker.allocate(1024 * 1024, 64));
+			Assert::IsTrue(((uintptr_t)large & 63) == 0);
+			large[1024 * 1024 - 1] = 0;
+
+			CountedObject *root = result.create<CountedObject>(live, "root");
+			result.splice(worker);
+			Assert::IsTrue(worker.empty());
+			Assert::AreEqual(10001, live);
+			Assert::IsTrue(root->label == "root");
+
+			Arena taken(std::move(result));
+			Assert::IsTrue(result.empty());
+			taken.clear();
+			Assert::AreEqual(0, live);
+		}
+	};
+}
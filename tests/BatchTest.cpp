@@ -0,0 +1,104 @@
+#include "CppUnitTest.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Context.hpp"
+#include "TempFile.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long batch_file_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	static long batch_file_object(const SymbolContext<char, long>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : 0;
+	}
+
+	static long batch_file_list(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		return sum;
+	}
+
+	struct BatchCompletion
+	{
+		int index;
+		bool accepted;
+		long value;
+	};
+
+	static void collect_completion(int index, bool accepted, const long& value, void *user)
+	{
+		static_cast<std::vector<BatchCompletion> *>(user)->push_back(BatchCompletion{ index, accepted, value });
+	}
+
+	TEST_CLASS(BatchTest)
+	{
+		static void write_file(const char *path, const std::string& text)
+		{
+			std::FILE *file = std::fopen(path, "wb");
+			std::fwrite(text.data(), 1, text.size(), file);
+			std::fclose(file);
+		}
+		static std::string make_list(long count)
+		{
+			std::string text = "[";
+			for (long i = 0; i < count; i++)
+				text += std::to_string(i) + (i + 1 < count ? ", " : "");
+			return text + "]";
+		}
+	public:
+		TEST_METHOD(ParseBatchFiles1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach(L"Number", batch_file_number);
+			context.attach(L"Object", batch_file_object);
+			context.attach(L"List", batch_file_list);
+
+			TempFile small("ParseBatchFiles1.small.json");
+			TempFile large("ParseBatchFiles1.large.json");
+			TempFile truncated("ParseBatchFiles1.truncated.json");
+			write_file(small.path(), make_list(10));
+			//Spans several banks, so the next file is parsed while it is reduced
+			const long count = 2000000;
+			write_file(large.path(), make_list(count));
+			write_file(truncated.path(), "[1, 2, 3");
+
+			const std::vector<std::string> paths = {
+				large.path(),
+				small.path(),
+				"ParseBatchFiles1.missing.json",
+				truncated.path(),
+				large.path(),
+				small.path()
+			};
+			const bool accepted[] = { true, true, false, false, true, true };
+			const long values[] = { count * (count - 1) / 2, 45, 0, 0, count * (count - 1) / 2, 45 };
+
+			std::vector<BatchCompletion> completions;
+			context.parse_batch(paths, 4, collect_completion, &completions);
+
+			//One completion per file, in batch order
+			Assert::AreEqual(paths.size(), completions.size());
+			for (size_t i = 0; i < completions.size(); i++)
+			{
+				Assert::AreEqual(static_cast<int>(i), completions[i].index);
+				Assert::AreEqual(accepted[i], completions[i].accepted);
+				if (accepted[i])
+					Assert::AreEqual(values[i], completions[i].value);
+			}
+		}
+	};
+}
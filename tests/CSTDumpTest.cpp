@@ -0,0 +1,81 @@
+#include "CppUnitTest.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#include "CSTDump.hpp"
+#include "TempFile.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	TEST_CLASS(CSTDumpTest)
+	{
+		static std::string load_error(const char *path, size_t bank_size = detail::CST_DUMP_BANK_SIZE)
+		{
+			try
+			{
+				CSTDump dump(path, bank_size);
+			}
+			catch (const SimpleException& ex)
+			{
+				return ex.what();
+			}
+			return "";
+		}
+	public:
+		TEST_METHOD(CSTDumpFile1)
+		{
+			const char *path = "CSTDumpFile1.cst";
+			uint64_t bank1[] = { (1ULL << 63) | (1ULL << 48), (1ULL << 63) | (2ULL << 48) | 1, (2ULL << 48) | 4, 0, 42 };
+			uint64_t bank2[] = { (1ULL << 48) | 5, 0 };
+			CSTDump dump(0x1234);
+			dump.add_bank(bank1, 5);
+			dump.add_bank(bank2, 2);
+			//A full bank has no terminator
+			dump.add_bank(bank1, 3);
+			dump.finish(5, 5);
+			dump.write(path);
+
+			CSTDump loaded(path);
+			Assert::AreEqual((uint64_t)0x1234, loaded.grammar_hash());
+			Assert::AreEqual((uint64_t)5, loaded.input_length());
+			Assert::IsTrue(loaded.accepted());
+			Assert::AreEqual((size_t)3, loaded.size());
+			Assert::AreEqual((size_t)3, loaded[0].size());
+			Assert::AreEqual(bank1[2], loaded[0][2]);
+			Assert::AreEqual((size_t)1, loaded[1].size());
+			Assert::AreEqual(bank2[0], loaded[1][0]);
+			Assert::AreEqual((size_t)3, loaded[2].size());
+
+			dump.finish(5, detail::CST_DUMP_REJECTED);
+			dump.write(path);
+			Assert::IsFalse(CSTDump(path).accepted());
+			std::remove(path);
+		}
+		TEST_METHOD(CSTDumpInvalid1)
+		{
+			TempFile file("CSTDumpInvalid1.cst");
+			uint64_t bank[] = { (1ULL << 63) | (1ULL << 48), (1ULL << 63) | (2ULL << 48) | 1, (2ULL << 48) | 4, (1ULL << 48) | 5 };
+			CSTDump dump(0x1234);
+			dump.add_bank(bank, 4);
+			dump.finish(5, 5);
+			dump.write(file.path());
+			Assert::AreEqual((size_t)4, CSTDump(file.path())[0].size());
+
+			//A segment longer than a bank
+			Assert::IsTrue(load_error(file.path(), 3 * sizeof(uint64_t)) == "Invalid CST dump CSTDumpInvalid1.cst");
+			//A marker past the end of the input
+			dump.finish(4, 4);
+			dump.write(file.path());
+			Assert::IsTrue(load_error(file.path()) == "Invalid CST dump CSTDumpInvalid1.cst");
+			//The end of the parse past the end of the input
+			dump.finish(5, 6);
+			dump.write(file.path());
+			Assert::IsTrue(load_error(file.path()) == "Invalid CST dump CSTDumpInvalid1.cst");
+		}
+	};
+}
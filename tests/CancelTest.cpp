@@ -0,0 +1,149 @@
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::atomic<long> cancel_items;
+	static long cancel_at = -1;
+	static long cancel_root = -1;
+
+	static long cancel_item(const SymbolContext<char, long>& ctx)
+	{
+		if (++cancel_items == cancel_at)
+			ctx.cancel();
+		return 1;
+	}
+
+	static long cancel_count(const SymbolContext<char, long>& ctx)
+	{
+		cancel_root = ctx.count();
+		return 0;
+	}
+
+	TEST_CLASS(CancelTest)
+	{
+		std::string m_text;
+
+		void make_items(long count)
+		{
+			m_text.clear();
+			for (long i = 0; i < count; i++)
+				m_text += "1 ";
+		}
+	public:
+		TEST_METHOD(RejectedAnySize1)
+		{
+			//Below and above the inline threshold
+			Context<char, long> context("../../grammars/json.cgr");
+			const long counts[] = { 10, 100000 };
+			for (long count : counts)
+			{
+				std::string text = "[";
+				for (long i = 0; i < count; i++)
+					text += "1, ";
+				MemoryInput input(text.data(), text.size());
+				Assert::AreEqual(count < 1000, text.size() < context.get_inline_threshold());
+
+				bool thrown = false;
+				try
+				{
+					context.parse(input, 4);
+				}
+				catch (const SimpleException& ex)
+				{
+					thrown = std::string(ex.what()) == "Input rejected by the parser";
+				}
+				Assert::IsTrue(thrown);
+				Assert::IsFalse(context.cancelled());
+			}
+		}
+		TEST_METHOD(CancelFromAction1)
+		{
+			//Each Item writes two markers, so this takes eight 8 MiB banks,
+			//four times as many as the session with one worker has
+			const long count = 4000000;
+			make_items(count);
+			Context<char, long> context("../../grammars/items.cgr");
+			context.attach(L"Item", cancel_item);
+			context.attach(L"Root", cancel_count);
+			MemoryInput input(m_text.data(), m_text.size());
+
+			Session<char, long> session(context, 1);
+			for (int round = 0; round < 2; round++)
+			{
+				cancel_items = 0;
+				cancel_at = 1000;
+				cancel_root = -1;
+				bool thrown = false;
+				try
+				{
+					session.parse(input, true);
+				}
+				catch (const SimpleException& ex)
+				{
+					thrown = std::string(ex.what()) == "Parse cancelled";
+				}
+				Assert::IsTrue(thrown);
+				Assert::IsTrue(context.cancelled());
+				Assert::AreEqual(-1L, cancel_root);
+				Assert::IsTrue(cancel_items.load() < count);
+
+				//The same runners parse the whole input afterwards
+				cancel_items = 0;
+				cancel_at = -1;
+				session.parse(input, true);
+				Assert::IsFalse(context.cancelled());
+				Assert::AreEqual(count, cancel_root);
+				Assert::AreEqual(count, cancel_items.load());
+			}
+		}
+		TEST_METHOD(CancelInline1)
+		{
+			//The inline runner reduces a bank when the next one is requested,
+			//so the parser rejects at the third bank
+			const long count = 1200000;
+			make_items(count);
+			Context<char, long> context("../../grammars/items.cgr");
+			context.attach(L"Item", cancel_item);
+			context.attach(L"Root", cancel_count);
+			MemoryInput input(m_text.data(), m_text.size());
+
+			for (int round = 0; round < 2; round++)
+			{
+				cancel_items = 0;
+				cancel_at = 1000;
+				cancel_root = -1;
+				bool thrown = false;
+				try
+				{
+					context.parse_inline(input);
+				}
+				catch (const SimpleException& ex)
+				{
+					thrown = std::string(ex.what()) == "Parse cancelled";
+				}
+				Assert::IsTrue(thrown);
+				Assert::AreEqual(-1L, cancel_root);
+
+				cancel_items = 0;
+				cancel_at = -1;
+				context.parse_inline(input);
+				Assert::AreEqual(count, cancel_root);
+			}
+
+			//A cancel before the parse starts is forgotten
+			context.cancel();
+			cancel_items = 0;
+			context.parse_inline(input);
+			Assert::IsFalse(context.cancelled());
+			Assert::AreEqual(count, cancel_items.load());
+		}
+	};
+}
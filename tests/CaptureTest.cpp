@@ -0,0 +1,60 @@
+#include "CppUnitTest.h"
+
+#include "CodeGenEM64T.hpp"
+#include "CATNLoader.hpp"
+#include "InlineRunner.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	struct CaptureCount
+	{
+		const char *input;
+		int spans;
+		int mismatches;
+	};
+
+	static long CENTAURUS_CALLBACK count_captures(const SymbolEntry *symbol, uint64_t *values, int num_values, void *context)
+	{
+		CaptureCount *count = static_cast<CaptureCount *>(context);
+		for (long i = 0; i < symbol->num_spans; i++)
+		{
+			const TokenSpan& span = symbol->spans[i];
+			count->spans++;
+			if (span.start < symbol->start || symbol->end < span.end || span.start == span.end)
+				count->mismatches++;
+			//The captures of the grammar are numbers and quoted strings
+			char c = count->input[span.start];
+			if (c != '"' && c != '-' && !('0' <= c && c <= '9'))
+				count->mismatches++;
+		}
+		return 1;
+	}
+
+	TEST_CLASS(CaptureTest)
+	{
+	public:
+		TEST_METHOD(CaptureSpans1)
+		{
+			Grammar<char> grammar = LoadGrammar<char>("../../grammars/json_spans.cgr");
+
+			ParserEM64T<char> parser(grammar);
+
+			const char json[] = "{\"a\": [1, -2.5, \"x\"], \"bc\": {\"d\": 30}, \"e\": [true, null]}";
+
+			MemoryInput input(json, sizeof(json) - 1);
+
+			CaptureCount count{json, 0, 0};
+
+			InlineRunner runner{input, &parser, &count};
+			runner.register_listener(count_captures);
+
+			Assert::IsTrue(runner.run());
+			//Four keys and four scalars
+			Assert::AreEqual(8, count.spans);
+			Assert::AreEqual(0, count.mismatches);
+		}
+	};
+}
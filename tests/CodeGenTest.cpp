@@ -8,6 +8,7 @@
 #include "Stage3Runner.hpp"
 
 #include <time.h>
+#include <vector>
 
 #if defined(CENTAURUS_BUILD_LINUX)
 #include <sys/time.h>
@@ -198,6 +199,52 @@ public:
 
         //_aligned_free(json);
     }
+    TEST_METHOD(ExplicitStackParserTest1)
+    {
+        using namespace Centaurus;
+
+        Grammar<unsigned char> grammar = LoadGrammar<unsigned char>("../../grammars/json.cgr");
+
+        MyErrorHandler errhandler;
+
+        ParserOptions options;
+        options.explicit_stack = true;
+        options.max_nesting_depth = 1024 * 1024;
+
+        ParserEM64T<unsigned char> parser(grammar, NULL, &errhandler, options);
+
+        Assert::IsFalse(parser.uses_native_stack());
+
+        //Deeper than the native stack of the compact Stage1 thread could hold
+        const int depth = 200000;
+        std::vector<char> json(depth * 2 + 64, 0);
+        for (int i = 0; i < depth; i++)
+        {
+            json[i] = '[';
+            json[depth * 2 - 1 - i] = ']';
+        }
+
+        MemoryInput input(json.data(), depth * 2);
+
+        Stage1Runner runner{input, &parser, 8 * 1024 * 1024, 8, true};
+
+        runner.start();
+        runner.wait();
+
+        Assert::IsTrue(runner.get_result() == json.data() + depth * 2);
+
+        //Nesting beyond the limit is rejected instead of overflowing
+        options.max_nesting_depth = 1000;
+
+        ParserEM64T<unsigned char> shallow_parser(grammar, NULL, &errhandler, options);
+
+        Stage1Runner shallow_runner{input, &shallow_parser, 8 * 1024 * 1024, 8, true};
+
+        shallow_runner.start();
+        shallow_runner.wait();
+
+        Assert::IsTrue(shallow_runner.get_result() == NULL);
+    }
     TEST_METHOD(ChaserGenTest1)
     {
         using namespace Centaurus;
@@ -0,0 +1,86 @@
+#include "CppUnitTest.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Decode.hpp"
+#include "TextView.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	TEST_CLASS(DecodeTest)
+	{
+		static bool same_as_strtod(const char *text)
+		{
+			double value;
+			const char *end = decode_double(text, text + strlen(text), value);
+			return end == text + strlen(text) && value == std::strtod(text, nullptr);
+		}
+	public:
+		TEST_METHOD(DecodeDouble1)
+		{
+			Assert::IsTrue(same_as_strtod("0"));
+			Assert::IsTrue(same_as_strtod("-122.41889249357"));
+			Assert::IsTrue(same_as_strtod("37.80741170944378"));
+			Assert::IsTrue(same_as_strtod("-122.42258632641401"));
+			Assert::IsTrue(same_as_strtod("9007199254740993"));
+			Assert::IsTrue(same_as_strtod("0.30000000000000004"));
+			Assert::IsTrue(same_as_strtod("1.5e300"));
+			Assert::IsTrue(same_as_strtod("123456789012345678901234567890"));
+			Assert::IsTrue(same_as_strtod("4.9e-324"));
+
+			double value;
+			const char *text = "12.5,";
+			Assert::IsTrue(decode_double(text, text + 5, value) == text + 4);
+			Assert::IsTrue(decode_double(text + 4, text + 5, value) == nullptr);
+		}
+		TEST_METHOD(DecodeInt1)
+		{
+			int64_t value;
+			const char *min = "-9223372036854775808";
+			Assert::IsTrue(decode_int(min, min + strlen(min), value) != nullptr);
+			Assert::IsTrue(value == INT64_MIN);
+			const char *overflow = "9223372036854775808";
+			Assert::IsTrue(decode_int(overflow, overflow + strlen(overflow), value) == nullptr);
+			const char *padded = "00000000000000000000000000042";
+			Assert::IsTrue(decode_int(padded, padded + strlen(padded), value) != nullptr);
+			Assert::IsTrue(value == 42);
+		}
+		TEST_METHOD(UnescapeJSON1)
+		{
+			std::string out;
+			const char *text = "tab\\there \\\"quoted\\\" \\u00e9\\ud83d\\ude00";
+			Assert::IsTrue(unescape_json(text, text + strlen(text), out));
+			Assert::IsTrue(out == "tab\there \"quoted\" \xc3\xa9\xf0\x9f\x98\x80");
+
+			out.clear();
+			const char *lone = "\\udc00";
+			Assert::IsFalse(unescape_json(lone, lone + strlen(lone), out));
+		}
+		TEST_METHOD(DecodeXML1)
+		{
+			std::string out;
+			const char *text = "Fish &amp; Chips &lt;&#233;&#x1F600;&gt;";
+			Assert::IsTrue(decode_xml(text, text + strlen(text), out));
+			Assert::IsTrue(out == "Fish & Chips <\xc3\xa9\xf0\x9f\x98\x80>");
+
+			//Entities declared in the DTD are left alone
+			out.clear();
+			const char *dtd = "M&uuml;ller";
+			Assert::IsFalse(decode_xml(dtd, dtd + strlen(dtd), out));
+			Assert::IsTrue(out == dtd);
+		}
+		TEST_METHOD(TextView1)
+		{
+			const char *text = " \t value\r\n";
+			TextView<char> view(text, strlen(text));
+			Assert::IsTrue(view.trim() == "value");
+			Assert::IsTrue(view.trim().substr(1, 3) == std::string("alu"));
+			Assert::IsTrue(view.substr(100).empty());
+		}
+	};
+}
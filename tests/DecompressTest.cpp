@@ -0,0 +1,190 @@
+#include "CppUnitTest.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(CENTAURUS_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(CENTAURUS_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include "Context.hpp"
+#include "TempFile.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long decompressed_sum;
+
+	static long decompressed_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	static long decompressed_object(const SymbolContext<char, long>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : 0;
+	}
+
+	static long decompressed_list(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		decompressed_sum = sum;
+		return sum;
+	}
+
+	TEST_CLASS(DecompressTest)
+	{
+		//A list of count numbers, long enough for the parser to catch up with the decompressor
+		static std::string make_list(long count)
+		{
+			std::string text = "[";
+			for (long i = 0; i < count; i++)
+			{
+				text += std::to_string(i);
+				text += (i + 1 < count) ? ", " : "]\n";
+			}
+			return text;
+		}
+		static void attach_sum(Context<char, long>& context)
+		{
+			context.attach(L"Number", decompressed_number);
+			context.attach(L"Object", decompressed_object);
+			context.attach(L"List", decompressed_list);
+		}
+		static std::vector<char> read_file(const char *path)
+		{
+			std::vector<char> bytes;
+			std::FILE *file = std::fopen(path, "rb");
+			char buffer[65536];
+			size_t length;
+			while ((length = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+				bytes.insert(bytes.end(), buffer, buffer + length);
+			std::fclose(file);
+			return bytes;
+		}
+		static void write_file(const char *path, const char *data, size_t length)
+		{
+			std::FILE *file = std::fopen(path, "wb");
+			std::fwrite(data, 1, length, file);
+			std::fclose(file);
+		}
+	public:
+#if defined(CENTAURUS_HAVE_ZLIB)
+		TEST_METHOD(GzipParse1)
+		{
+			TempFile file("GzipParse1.json.gz");
+			const char *path = file.path();
+			const long count = 2000000;
+			std::string text = make_list(count);
+
+			//Two members, which decode to the concatenation of their contents
+			size_t half = text.size() / 2;
+			gzFile gz = gzopen(path, "wb");
+			gzwrite(gz, text.data(), half);
+			gzclose(gz);
+			gz = gzopen(path, "ab");
+			gzwrite(gz, text.data() + half, text.size() - half);
+			gzclose(gz);
+			Assert::IsTrue(DecompressedInput::detect(path) == DecompressedInput::Format::Gzip);
+
+			Context<char, long> context("../../grammars/json.cgr");
+			attach_sum(context);
+			decompressed_sum = -1;
+			context.parse(path, 4);
+			Assert::AreEqual(count * (count - 1) / 2, decompressed_sum);
+			Assert::AreEqual(text.size(), context.get_input_size());
+
+			//The end of the stream is missing
+			std::vector<char> bytes = read_file(path);
+			write_file(path, bytes.data(), bytes.size() - 64);
+			bool thrown = false;
+			try
+			{
+				context.parse(path, 4);
+			}
+			catch (const SimpleException& ex)
+			{
+				thrown = true;
+			}
+			Assert::IsTrue(thrown);
+		}
+#endif
+#if defined(CENTAURUS_HAVE_ZLIB)
+		TEST_METHOD(GzipLongToken1)
+		{
+			TempFile file("GzipLongToken1.json.gz");
+			const char *path = file.path();
+			//No actions, the numbers do not fit in a long
+			Context<char, long> context("../../grammars/json.cgr");
+
+			//Numbers of random digits up to the refill guard always parse,
+			//numbers twice as long always reject the input
+			const size_t guard = DecompressedInput::REFILL_GUARD;
+			const size_t lengths[] = { guard, 2 * guard, 4 * guard };
+			for (size_t length : lengths)
+			{
+				std::string text = "[1, ";
+				unsigned seed = 1;
+				for (size_t i = 0; i < length; i++)
+				{
+					seed = seed * 1103515245 + 12345;
+					text += static_cast<char>('1' + (seed >> 16) % 9);
+				}
+				text += ", 2]\n";
+				gzFile gz = gzopen(path, "wb");
+				gzwrite(gz, text.data(), text.size());
+				gzclose(gz);
+
+				std::string message;
+				try
+				{
+					context.parse(path, 4);
+				}
+				catch (const SimpleException& ex)
+				{
+					message = ex.what();
+				}
+				if (length == guard)
+				{
+					Assert::IsTrue(message.empty());
+					Assert::AreEqual(text.size(), context.get_input_size());
+				}
+				else
+					Assert::IsTrue(message == "A token of the decompressed input is longer than the refill guard");
+			}
+		}
+#endif
+#if defined(CENTAURUS_HAVE_ZSTD)
+		TEST_METHOD(ZstdParse1)
+		{
+			TempFile file("ZstdParse1.json.zst");
+			const char *path = file.path();
+			const long count = 2000000;
+			std::string text = make_list(count);
+
+			std::vector<char> compressed(ZSTD_compressBound(text.size()));
+			size_t length = ZSTD_compress(compressed.data(), compressed.size(), text.data(), text.size(), 3);
+			Assert::IsFalse(ZSTD_isError(length));
+			write_file(path, compressed.data(), length);
+			Assert::IsTrue(DecompressedInput::detect(path) == DecompressedInput::Format::Zstd);
+
+			Context<char, long> context("../../grammars/json.cgr");
+			attach_sum(context);
+			decompressed_sum = -1;
+			context.parse(path, 4);
+			Assert::AreEqual(count * (count - 1) / 2, decompressed_sum);
+			Assert::AreEqual(text.size(), context.get_input_size());
+		}
+#endif
+	};
+}
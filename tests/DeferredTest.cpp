@@ -0,0 +1,152 @@
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::atomic<long> deferred_strings;
+	static long deferred_number_sum;
+	static long deferred_string_sum;
+	static long deferred_children;
+	static uintptr_t deferred_fold;
+	static long deferred_text_length;
+
+	//Odd, like a pointer to a character of the input
+	static void *odd_number(const SymbolContext<char>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return reinterpret_cast<void *>(static_cast<uintptr_t>(2 * value + 1));
+	}
+
+	static void *deferred_string(const SymbolContext<char>& ctx)
+	{
+		deferred_strings++;
+		return ctx.alloc<long>(ctx.end() - ctx.start() - 2);
+	}
+
+	static void *pass_object(const SymbolContext<char>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value<void>(1) : nullptr;
+	}
+
+	static void *sum_list(const SymbolContext<char>& ctx)
+	{
+		deferred_number_sum = 0;
+		deferred_string_sum = 0;
+		deferred_children = ctx.count();
+		for (int i = 1; i <= ctx.count(); i++)
+		{
+			uintptr_t value = reinterpret_cast<uintptr_t>(ctx.value<void>(i));
+			if (value & 1)
+				deferred_number_sum += static_cast<long>(value / 2);
+			else
+				deferred_string_sum += *reinterpret_cast<long *>(value);
+		}
+		return nullptr;
+	}
+
+	static void *keep_root(const SymbolContext<char>& ctx)
+	{
+		if (ctx.end() - ctx.start() == deferred_text_length)
+			deferred_fold = reinterpret_cast<uintptr_t>(ctx.value<void>(1));
+		return ctx.count() == 1 ? ctx.value<void>(1) : nullptr;
+	}
+
+	//The accumulator is 1 + 2 * the number of children, so it is always odd
+	static void *count_init()
+	{
+		return reinterpret_cast<void *>(1);
+	}
+
+	static void count_child(void *&acc, void *value)
+	{
+		acc = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(acc) + 2);
+	}
+
+	static void count_merge(void *&acc, void *value)
+	{
+		acc = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(acc) + reinterpret_cast<uintptr_t>(value) - 1);
+	}
+
+	TEST_CLASS(DeferredTest)
+	{
+		std::string m_text;
+		long m_count;
+		long m_number_sum;
+		long m_string_sum;
+
+		//Numbers and strings alternate; the strings are reduced by deferred actions
+		void make_list(long count)
+		{
+			m_count = count;
+			m_number_sum = 0;
+			m_string_sum = 0;
+			m_text = "[";
+			for (long i = 0; i < count; i++)
+			{
+				if (i % 2 == 0)
+				{
+					m_text += std::to_string(i);
+					m_number_sum += i;
+				}
+				else
+				{
+					m_text += '"' + std::string(i % 5, 'a') + '"';
+					m_string_sum += i % 5;
+				}
+				m_text += (i + 1 < count) ? ", " : "]";
+			}
+		}
+	public:
+		TEST_METHOD(DeferredOddSiblings1)
+		{
+			Context<char> context("../../grammars/json.cgr");
+			context.attach(L"Number", odd_number);
+			context.attach(L"Object", pass_object);
+			context.attach(L"List", sum_list);
+			context.attach_deferred(L"String", deferred_string);
+			context.set_deferred_threads(2);
+
+			//Inline, then through the pipeline over several banks
+			const long counts[] = { 1000, 600000 };
+			for (long count : counts)
+			{
+				make_list(count);
+				MemoryInput input(m_text.data(), m_text.size());
+				for (int round = 0; round < 2; round++)
+				{
+					deferred_strings = 0;
+					deferred_children = 0;
+					context.parse(input, 4);
+					Assert::AreEqual(m_count, deferred_children);
+					Assert::AreEqual(m_count / 2, deferred_strings.load());
+					Assert::AreEqual(m_number_sum, deferred_number_sum);
+					Assert::AreEqual(m_string_sum, deferred_string_sum);
+				}
+			}
+		}
+		TEST_METHOD(DeferredOddFold1)
+		{
+			Context<char> context("../../grammars/json.cgr");
+			context.attach(L"Number", odd_number);
+			context.attach(L"Object", keep_root);
+			context.attach_deferred(L"String", deferred_string);
+			context.attach_fold(L"List", CppFold<char>{ count_init, count_child, count_merge });
+
+			//The partial accumulators of the banks are odd as well
+			make_list(600000);
+			MemoryInput input(m_text.data(), m_text.size());
+			deferred_fold = 0;
+			deferred_text_length = static_cast<long>(m_text.size());
+			context.parse(input, 4);
+			Assert::AreEqual(static_cast<uintptr_t>(1 + 2 * m_count), deferred_fold);
+		}
+	};
+}
@@ -0,0 +1,172 @@
+#include "CppUnitTest.h"
+
+#include <string>
+#include <vector>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::vector<long> folded_groups;
+
+	static long one_item(const SymbolContext<char, long>& ctx)
+	{
+		return 1;
+	}
+
+	static long collect_groups(const SymbolContext<char, long>& ctx)
+	{
+		folded_groups.clear();
+		for (int i = 1; i <= ctx.count(); i++)
+			folded_groups.push_back(ctx.value(i));
+		return 0;
+	}
+
+	static long fold_init()
+	{
+		return 0;
+	}
+
+	static void fold_add(long& acc, const long& value)
+	{
+		acc += value;
+	}
+
+	static long item_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	//The accumulator packs the first and last child and the number of
+	//children in 21 bits each; children out of order saturate the count
+	static const long SPAN_BITS = 21;
+	static const long SPAN_MASK = (1L << SPAN_BITS) - 1;
+
+	static long span_first(long span)
+	{
+		return (span >> (2 * SPAN_BITS)) & SPAN_MASK;
+	}
+
+	static long span_last(long span)
+	{
+		return (span >> SPAN_BITS) & SPAN_MASK;
+	}
+
+	static long span_count(long span)
+	{
+		return span & SPAN_MASK;
+	}
+
+	static long make_span(long first, long last, long count)
+	{
+		return (first << (2 * SPAN_BITS)) | (last << SPAN_BITS) | count;
+	}
+
+	static void span_merge(long& acc, const long& partial)
+	{
+		if (span_count(partial) == 0)
+			return;
+		if (span_count(acc) == 0)
+		{
+			acc = partial;
+			return;
+		}
+		bool ordered = span_first(partial) == span_last(acc) + 1 && span_count(acc) != SPAN_MASK && span_count(partial) != SPAN_MASK;
+		acc = make_span(span_first(acc), span_last(partial), ordered ? span_count(acc) + span_count(partial) : SPAN_MASK);
+	}
+
+	static void span_add(long& acc, const long& value)
+	{
+		span_merge(acc, make_span(value, value, 1));
+	}
+
+	TEST_CLASS(FoldTest)
+	{
+	public:
+		TEST_METHOD(OrderedFoldBanks1)
+		{
+			Context<char, long> context("../../grammars/groups.cgr");
+			context.attach(L"Item", item_number);
+			context.attach(L"Root", collect_groups);
+			context.attach_fold(L"Group", CppFold<char, long>{ fold_init, span_add, span_merge });
+
+			//The items of each group are numbered from 0; the first groups
+			//span several 8 MiB banks, whose partial accumulators have to be
+			//merged in bank order
+			const long sizes[] = { 1200000, 0, 700000, 3, 900000, 1 };
+			std::string text;
+			for (long size : sizes)
+			{
+				text += '[';
+				for (long i = 0; i < size; i++)
+					text += std::to_string(i) + " ";
+				text += "]\n";
+			}
+			MemoryInput input(text.data(), text.size());
+
+			for (int round = 0; round < 3; round++)
+			{
+				folded_groups.clear();
+				context.parse(input, 4);
+				Assert::AreEqual((size_t)6, folded_groups.size());
+				for (int i = 0; i < 6; i++)
+				{
+					Assert::AreEqual(sizes[i], span_count(folded_groups[i]));
+					if (sizes[i] != 0)
+					{
+						Assert::AreEqual(0L, span_first(folded_groups[i]));
+						Assert::AreEqual(sizes[i] - 1, span_last(folded_groups[i]));
+					}
+				}
+			}
+		}
+		TEST_METHOD(CommutativeFoldSiblings1)
+		{
+			Context<char, long> context("../../grammars/groups.cgr");
+			context.attach(L"Item", one_item);
+			context.attach(L"Root", collect_groups);
+			context.attach_fold(L"Group", CppFold<char, long>{ fold_init, fold_add, fold_add }, true);
+
+			//Each Item writes two markers, so the first groups span several
+			//8 MiB banks, and the next group opens in the bank the previous
+			//one ends in
+			const long sizes[] = { 1200000, 700000, 3, 900000, 1 };
+			std::string text;
+			for (long size : sizes)
+			{
+				text += '[';
+				for (long i = 0; i < size; i++)
+					text += "1 ";
+				text += "]\n";
+			}
+			MemoryInput input(text.data(), text.size());
+
+			for (int round = 0; round < 3; round++)
+			{
+				folded_groups.clear();
+				context.parse(input, 4);
+				Assert::AreEqual((size_t)5, folded_groups.size());
+				for (int i = 0; i < 5; i++)
+					Assert::AreEqual(sizes[i], folded_groups[i]);
+			}
+
+			//Nested occurrences would pool their children together
+			Context<char, long> nesting("../../grammars/json.cgr");
+			bool thrown = false;
+			try
+			{
+				nesting.attach_fold(L"List", CppFold<char, long>{ fold_init, fold_add, fold_add }, true);
+			}
+			catch (const SimpleException& ex)
+			{
+				thrown = true;
+			}
+			Assert::IsTrue(thrown);
+		}
+	};
+}
@@ -0,0 +1,100 @@
+#include "CppUnitTest.h"
+
+#include <cstring>
+#include <string>
+
+#include "CodeGenEM64T.hpp"
+#include "CATNLoader.hpp"
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long fragment_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	static long fragment_sum(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		return sum;
+	}
+
+	TEST_CLASS(FragmentTest)
+	{
+		static void attach_sum(Context<char, long>& context)
+		{
+			context.attach(L"Number", fragment_number);
+			context.attach(L"Object", fragment_sum);
+			context.attach(L"List", fragment_sum);
+			context.attach(L"DictEntry", fragment_sum);
+			context.attach(L"Dict", fragment_sum);
+		}
+		static std::string parse_error(Context<char, long>& context, const char *text, const wchar_t *machine)
+		{
+			MemoryInput input(text, std::strlen(text));
+			try
+			{
+				context.parse_fragment(input, machine);
+			}
+			catch (const SimpleException& ex)
+			{
+				return ex.what();
+			}
+			return "";
+		}
+	public:
+		TEST_METHOD(ParseFragment1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			attach_sum(context);
+
+			//A value at the start of the rest of a larger document
+			std::string text = "{\"a\": [1, 2, 3], \"b\": 4}, 5]";
+			MemoryInput input(text.data(), text.size());
+			Assert::AreEqual(10L, context.parse_fragment(input, L"Dict"));
+			std::string number = "42";
+			MemoryInput number_input(number.data(), number.size());
+			Assert::AreEqual(42L, context.parse_fragment(number_input, L"Number"));
+
+			Assert::IsTrue(parse_error(context, "[1, 2", L"List") == "Input rejected by the parser");
+			//A list is not a dictionary
+			Assert::IsTrue(parse_error(context, "[1, 2]", L"Dict") == "Input rejected by the parser");
+		}
+		TEST_METHOD(ParseFragmentProjection1)
+		{
+			ParserOptions options;
+			options.projection = "Object/Dict/DictEntry[String]";
+
+			//The parser specialized for the projection only starts from the root
+			Grammar<char> grammar = LoadGrammar<char>("../../grammars/json.cgr");
+			ParserEM64T<char> parser(grammar, NULL, NULL, options);
+			const char text[] = "{\"a\": [1, 2, 3], \"b\": 4}";
+			std::string message;
+			try
+			{
+				parser.parse_from(grammar.get_machine_id(L"Dict"), nullptr, text);
+			}
+			catch (const SimpleException& ex)
+			{
+				message = ex.what();
+			}
+			Assert::IsTrue(message == "The parser cannot start from the machine");
+
+			//So fragments are parsed by a parser of the whole grammar, and all
+			//their symbols are reduced
+			Context<char, long> context("../../grammars/json.cgr", options);
+			attach_sum(context);
+			MemoryInput input(text, sizeof(text) - 1);
+			Assert::AreEqual(10L, context.parse_fragment(input, L"Dict"));
+			Assert::AreEqual(10L, context.parse_fragment(input, L"Object"));
+		}
+	};
+}
@@ -0,0 +1,94 @@
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "Context.hpp"
+#include "Incremental.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::atomic<int> appended_entries;
+	static std::atomic<long> appended_sum;
+
+	static void *count_entry(const SymbolContext<char>& ctx)
+	{
+		std::string text = ctx.read();
+		appended_entries++;
+		appended_sum += std::strtol(text.c_str() + text.find('=') + 1, NULL, 10);
+		return nullptr;
+	}
+
+	TEST_CLASS(IncrementalTest)
+	{
+	public:
+		TEST_METHOD(IncrementalCheckpoint1)
+		{
+			const char *path = "IncrementalCheckpoint1.ckpt";
+			std::remove(path);
+			std::string log(5000, 'a');
+			log += "{\"id\":1}\n";
+
+			IncrementalCheckpoint fresh(path);
+			Assert::AreEqual((uint64_t)0, fresh.offset());
+			Assert::IsTrue(fresh.matches(log.data(), log.size()));
+
+			fresh.advance("Line", log.data(), log.size());
+			fresh.save(path);
+			IncrementalCheckpoint loaded(path);
+			Assert::IsTrue(loaded.machine() == "Line");
+			Assert::AreEqual((uint64_t)log.size(), loaded.offset());
+
+			//Appending keeps the checkpoint valid
+			std::string grown = log + "{\"id\":2}\n";
+			Assert::IsTrue(loaded.matches(grown.data(), grown.size()));
+			//Rewriting the tail or truncating the input does not
+			std::string rewritten = grown;
+			rewritten[log.size() - 2] = '2';
+			Assert::IsFalse(loaded.matches(rewritten.data(), rewritten.size()));
+			Assert::IsFalse(loaded.matches(log.data(), log.size() - 1));
+			std::remove(path);
+		}
+		TEST_METHOD(IncrementalAppend1)
+		{
+			Context<char> context("../../grammars/log.cgr");
+			context.attach(L"Entry", count_entry);
+			IncrementalCheckpoint checkpoint;
+			appended_entries = 0;
+			appended_sum = 0;
+
+			//The last entry is still being written, so the parse is rejected
+			//there but the entries before it are reduced
+			std::string log = "a=1;\nb=22;\nc=3";
+			MemoryInput partial(log.data(), log.size());
+			Assert::IsFalse(context.parse_appended(partial, L"Entry", checkpoint, 1));
+			Assert::AreEqual(2, appended_entries.load());
+			Assert::AreEqual(23L, appended_sum.load());
+			Assert::IsTrue(checkpoint.machine() == "Entry");
+			Assert::AreEqual((uint64_t)log.find('\n', 5), checkpoint.offset());
+
+			//Only the entry completed since then and the new one are reduced
+			log += "33;\nd=4;\n";
+			MemoryInput complete(log.data(), log.size());
+			Assert::IsTrue(context.parse_appended(complete, L"Entry", checkpoint, 1));
+			Assert::AreEqual(4, appended_entries.load());
+			Assert::AreEqual(60L, appended_sum.load());
+			Assert::AreEqual((uint64_t)log.size() - 1, checkpoint.offset());
+
+			//Nothing but whitespace was appended
+			Assert::IsTrue(context.parse_appended(complete, L"Entry", checkpoint, 1));
+			Assert::AreEqual(4, appended_entries.load());
+
+			//A rewritten input is parsed from the beginning
+			log[0] = 'z';
+			MemoryInput rewritten(log.data(), log.size());
+			Assert::IsTrue(context.parse_appended(rewritten, L"Entry", checkpoint, 1));
+			Assert::AreEqual(8, appended_entries.load());
+		}
+	};
+}
@@ -0,0 +1,84 @@
+#include "CppUnitTest.h"
+
+#include <atomic>
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::atomic<long> batched_numbers;
+	static std::atomic<long> batches_of_one;
+	static long batched_sum;
+	static long batched_text_length;
+
+	static void batch_numbers(const SymbolBatch<char, long>& batch, long *results)
+	{
+		for (int i = 0; i < batch.size(); i++)
+		{
+			int64_t value;
+			Assert::IsTrue(batch[i].to_int(value));
+			results[i] = static_cast<long>(value);
+		}
+		batched_numbers += batch.size();
+		if (batch.size() == 1)
+			batches_of_one++;
+	}
+
+	static long batch_object(const SymbolContext<char, long>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : 0;
+	}
+
+	static long batch_list(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		if (ctx.end() - ctx.start() == batched_text_length)
+			batched_sum = sum;
+		return sum;
+	}
+
+	TEST_CLASS(LeafBatchTest)
+	{
+	public:
+		TEST_METHOD(LeafBatchSplit1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach_batch(L"Number", batch_numbers);
+			context.attach(L"Object", batch_object);
+			context.attach(L"List", batch_list);
+
+			//Each element writes four markers after the two of the outer
+			//Object and List, so every 8 MiB bank ends between the start and
+			//the end marker of a Number. Wrapped in another list, the banks
+			//end between elements instead.
+			const long count = 2000000;
+			std::string list = "[";
+			for (long i = 0; i < count; i++)
+				list += std::to_string(i % 1000) + (i + 1 < count ? ", " : "]");
+			const long sum = (count / 1000) * (999 * 1000 / 2);
+
+			for (int wrapped = 0; wrapped < 2; wrapped++)
+			{
+				std::string text = wrapped ? "[" + list + "]" : list;
+				MemoryInput input(text.data(), text.size());
+				batched_text_length = static_cast<long>(text.size());
+
+				batched_numbers = 0;
+				batches_of_one = 0;
+				batched_sum = -1;
+				context.parse(input, 4);
+				Assert::AreEqual(count, batched_numbers.load());
+				Assert::AreEqual(sum, batched_sum);
+				//The split leaves reach Stage3 on their own
+				if (!wrapped)
+					Assert::IsTrue(batches_of_one.load() > 0);
+			}
+		}
+	};
+}
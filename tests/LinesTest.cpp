@@ -0,0 +1,181 @@
+#include "CppUnitTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static std::atomic<int> line_numbers;
+	static long throw_at = -1;
+
+	static long line_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		if (value == throw_at)
+			throw SimpleException("Number rejected by the action");
+		line_numbers++;
+		return static_cast<long>(value);
+	}
+
+	static long line_object(const SymbolContext<char, long>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : -1;
+	}
+
+	struct LineResult
+	{
+		int index;
+		bool accepted;
+		long value;
+		bool operator<(const LineResult& other) const
+		{
+			return index < other.index;
+		}
+	};
+
+	struct LineResults
+	{
+		std::mutex mutex;
+		std::vector<LineResult> results;
+		std::thread::id caller;
+		bool other_thread = false;
+	};
+
+	static void collect_line(int index, bool accepted, const long& value, void *user)
+	{
+		LineResults& lines = *static_cast<LineResults *>(user);
+		std::lock_guard<std::mutex> lock(lines.mutex);
+		lines.results.push_back(LineResult{ index, accepted, value });
+		if (std::this_thread::get_id() != lines.caller)
+			lines.other_thread = true;
+	}
+
+	TEST_CLASS(LinesTest)
+	{
+		std::string m_text;
+		std::vector<LineResult> m_expected;
+		int m_numbers;
+
+		//Lines spread over several batches, with CRLF breaks, empty lines and malformed lines
+		void make_lines()
+		{
+			m_text.clear();
+			m_expected.clear();
+			m_numbers = 0;
+			for (int i = 0; i < 2000; i++)
+			{
+				if (i % 50 == 0)
+					m_text += "\n\r\n";
+				bool malformed = i % 100 == 99;
+				m_text += malformed ? "{bad" : std::to_string(i);
+				m_text += (i % 7 == 3) ? "\r\n" : "\n";
+				m_expected.push_back(LineResult{ i, !malformed, malformed ? 0 : (long)i });
+				if (!malformed)
+					m_numbers++;
+			}
+			//Neither half may be completed by the other line, nor run the
+			//actions of its numbers
+			m_text += "[1\n,2]\n";
+			m_expected.push_back(LineResult{ 2000, false, 0 });
+			m_expected.push_back(LineResult{ 2001, false, 0 });
+			//The last line has no line break
+			m_text += "[3, 4]";
+			m_expected.push_back(LineResult{ 2002, true, -1 });
+			m_numbers += 2;
+		}
+		void check_lines(std::vector<LineResult> results)
+		{
+			std::sort(results.begin(), results.end());
+			Assert::AreEqual(m_expected.size(), results.size());
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				Assert::AreEqual(m_expected[i].index, results[i].index);
+				Assert::AreEqual(m_expected[i].accepted, results[i].accepted);
+				if (results[i].accepted)
+					Assert::AreEqual(m_expected[i].value, results[i].value);
+			}
+		}
+	public:
+		TEST_METHOD(ParseLinesOrdered1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach(L"Number", line_number);
+			context.attach(L"Object", line_object);
+			make_lines();
+			MemoryInput input(m_text.data(), m_text.size());
+
+			LineResults lines;
+			lines.caller = std::this_thread::get_id();
+			line_numbers = 0;
+			context.parse_lines(input, 4, collect_line, &lines);
+			//Delivered in line order on the calling thread
+			for (size_t i = 0; i < lines.results.size(); i++)
+				Assert::AreEqual((int)i, lines.results[i].index);
+			Assert::IsFalse(lines.other_thread);
+			check_lines(lines.results);
+			Assert::AreEqual(m_numbers, line_numbers.load());
+		}
+		TEST_METHOD(ParseLinesUnordered1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach(L"Number", line_number);
+			context.attach(L"Object", line_object);
+			make_lines();
+			MemoryInput input(m_text.data(), m_text.size());
+
+			LineResults lines;
+			lines.caller = std::this_thread::get_id();
+			line_numbers = 0;
+			context.parse_lines(input, 4, collect_line, &lines, false);
+			//Delivered from the workers, each line once
+			Assert::IsTrue(lines.other_thread);
+			check_lines(lines.results);
+			Assert::AreEqual(m_numbers, line_numbers.load());
+		}
+		TEST_METHOD(ParseLinesThrow1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach(L"Number", line_number);
+			context.attach(L"Object", line_object);
+			make_lines();
+			MemoryInput input(m_text.data(), m_text.size());
+
+			for (int ordered = 0; ordered < 2; ordered++)
+			{
+				LineResults lines;
+				lines.caller = std::this_thread::get_id();
+				throw_at = 1234;
+				bool thrown = false;
+				try
+				{
+					context.parse_lines(input, 4, collect_line, &lines, ordered != 0);
+				}
+				catch (const SimpleException& ex)
+				{
+					thrown = std::string(ex.what()) == "Number rejected by the action";
+				}
+				throw_at = -1;
+				Assert::IsTrue(thrown);
+				//The line never reaches the callback
+				for (const auto& result : lines.results)
+					Assert::AreNotEqual(1234, result.index);
+			}
+
+			//The context parses again once the workers are joined
+			LineResults lines;
+			lines.caller = std::this_thread::get_id();
+			context.parse_lines(input, 4, collect_line, &lines);
+			check_lines(lines.results);
+		}
+	};
+}
@@ -0,0 +1,35 @@
+#include "CppUnitTest.h"
+
+#include "Opaque.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	TEST_CLASS(OpaqueTest)
+	{
+	public:
+		TEST_METHOD(OpaqueSkip1)
+		{
+			OpaqueSyntax<char> syntax;
+			syntax.brackets = "{}[]";
+			syntax.quote = '"';
+			syntax.escape = '\\';
+
+			//Brackets inside strings, escaped quotes and a region longer than a block
+			alignas(16) const char text[] = "{\"a\":[1,2,{\"}\\\"]\":[[3]]}],\"b\":\"{\"}, \"c\"";
+			const char *end = skip_opaque(text, syntax);
+			Assert::IsTrue(end != NULL);
+			Assert::AreEqual(',', *end);
+			Assert::AreEqual('}', end[-1]);
+
+			Assert::IsTrue(skip_opaque(text + 1, syntax) == text + 4);
+			Assert::IsTrue(skip_opaque("123", syntax) == NULL);
+			Assert::IsTrue(skip_opaque("[[1]", syntax) == NULL);
+			alignas(16) const char closed[] = "[1]]";
+			Assert::IsTrue(skip_opaque(closed, syntax) == closed + 3);
+			Assert::IsTrue(skip_opaque("{\"}", syntax) == NULL);
+		}
+	};
+}
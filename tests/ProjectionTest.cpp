@@ -0,0 +1,49 @@
+#include "CppUnitTest.h"
+
+#include "CodeGenEM64T.hpp"
+#include "CATNLoader.hpp"
+#include "InlineRunner.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long CENTAURUS_CALLBACK count_symbols(const SymbolEntry *symbol, uint64_t *values, int num_values, void *context)
+	{
+		std::vector<int>& counts = *static_cast<std::vector<int> *>(context);
+		counts[symbol->id]++;
+		return 1;
+	}
+
+	TEST_CLASS(ProjectionTest)
+	{
+	public:
+		TEST_METHOD(ProjectionCount1)
+		{
+			Grammar<char> grammar = LoadGrammar<char>("../../grammars/json.cgr");
+
+			ParserOptions options;
+			options.projection = "Object/Dict/DictEntry[String]";
+			ParserEM64T<char> parser(grammar, NULL, NULL, options);
+
+			const char json[] = "{\"a\": [1, \"x\"], \"bc\": {\"d\": 30}}";
+
+			MemoryInput input(json, sizeof(json) - 1);
+
+			std::vector<int> counts(grammar.get_machine_num() + 1, 0);
+
+			InlineRunner runner{input, &parser, &counts};
+			runner.register_listener(count_symbols);
+
+			Assert::IsTrue(runner.run());
+			//Only the keys of the outer dictionary are reported under its entries
+			Assert::AreEqual(1, counts[grammar.get_machine_id(L"Object")]);
+			Assert::AreEqual(1, counts[grammar.get_machine_id(L"Dict")]);
+			Assert::AreEqual(2, counts[grammar.get_machine_id(L"DictEntry")]);
+			Assert::AreEqual(2, counts[grammar.get_machine_id(L"String")]);
+			Assert::AreEqual(0, counts[grammar.get_machine_id(L"Number")]);
+			Assert::AreEqual(0, counts[grammar.get_machine_id(L"List")]);
+		}
+	};
+}
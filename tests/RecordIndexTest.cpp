@@ -0,0 +1,179 @@
+#include "CppUnitTest.h"
+
+#include <cstdio>
+#include <string>
+
+#include "Context.hpp"
+#include "RecordIndex.hpp"
+#include "TempFile.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long indexed_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	static long indexed_sum(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		return sum;
+	}
+
+	static uint64_t indexed_key(const SymbolContext<char, long>& ctx)
+	{
+		return RecordIndex::hash_key(ctx.start(), ctx.end());
+	}
+
+	TEST_CLASS(RecordIndexTest)
+	{
+		std::string m_text;
+
+		//The value of the i-th record is 3 * i
+		static std::string make_record(long i)
+		{
+			return "{\"a\": " + std::to_string(i) + ", \"b\": " + std::to_string(2 * i) + "}";
+		}
+		void make_records(long count)
+		{
+			m_text = "[";
+			for (long i = 0; i < count; i++)
+				m_text += (i == 0 ? "" : ", ") + make_record(i);
+			m_text += "]";
+		}
+		static void attach_sum(Context<char, long>& context)
+		{
+			context.attach(L"Number", indexed_number);
+			context.attach(L"Object", indexed_sum);
+			context.attach(L"DictEntry", indexed_sum);
+			context.attach(L"Dict", indexed_sum);
+		}
+	public:
+		TEST_METHOD(RecordIndexFile1)
+		{
+			const char *path = "RecordIndexFile1.idx";
+			RecordIndexBuilder builder;
+			builder.reserve(3);
+			builder.set_machine("Article", true);
+			builder.add(2, 7, 100, 150);
+			builder.add(0, 3, 0, 50);
+			builder.add(1, 7, 50, 100);
+			builder.add(1, 1, 150, 160);
+			builder.write(path, 1000);
+
+			RecordIndex keyed(path);
+			Assert::IsTrue(keyed.machine() == "Article");
+			Assert::IsTrue(keyed.keyed());
+			Assert::AreEqual((size_t)4, keyed.size());
+			Assert::AreEqual((uint64_t)1000, keyed.input_length());
+			auto range = keyed.find(7);
+			Assert::AreEqual((ptrdiff_t)2, range.second - range.first);
+			Assert::AreEqual((uint64_t)50, range.first->start);
+			Assert::AreEqual((uint64_t)150, range.first[1].end);
+			range = keyed.find(5);
+			Assert::IsTrue(range.first == range.second);
+
+			//Without keys the records are numbered in input order
+			builder.set_machine("Article", false);
+			builder.write(path, 1000);
+			RecordIndex numbered(path);
+			for (size_t i = 0; i < numbered.size(); i++)
+			{
+				Assert::AreEqual((uint64_t)i, numbered[i].key);
+				Assert::AreEqual((uint64_t)(i * 50), numbered[i].start);
+			}
+			std::remove(path);
+		}
+		TEST_METHOD(RecordIndexByPosition1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			attach_sum(context);
+			RecordIndexBuilder builder;
+			context.attach_index(L"Dict", builder);
+
+			//The records span several banks, so the index is built by every
+			//worker and by Stage3
+			const long count = 300000;
+			make_records(count);
+			MemoryInput input(m_text.data(), m_text.size());
+			context.parse(input, 4);
+			TempFile file("RecordIndexByPosition1.idx");
+			builder.write(file.path(), context.get_input_size());
+
+			RecordIndex index(file.path());
+			Assert::IsTrue(index.machine() == "Dict");
+			Assert::IsFalse(index.keyed());
+			Assert::AreEqual((size_t)count, index.size());
+			for (long i = 0; i < count; i++)
+			{
+				Assert::AreEqual((uint64_t)i, index[i].key);
+				Assert::IsTrue(m_text.compare(index[i].start, index[i].end - index[i].start, make_record(i)) == 0);
+			}
+			const long positions[] = { 0, 1, count / 2, count - 1 };
+			for (long i : positions)
+				Assert::AreEqual(3 * i, context.parse_record(input, index, index[i]));
+
+			//The text of a record was rewritten after the index was built
+			std::string rewritten = m_text;
+			std::string shorter = "{\"a\": 7}";
+			rewritten.replace(index[1].start, shorter.size(), shorter);
+			MemoryInput rewritten_input(rewritten.data(), rewritten.size());
+			std::string message;
+			try
+			{
+				context.parse_record(rewritten_input, index, index[1]);
+			}
+			catch (const SimpleException& ex)
+			{
+				message = ex.what();
+			}
+			Assert::IsTrue(message == "The record does not match the index");
+
+			//So was the length of the input
+			MemoryInput truncated(m_text.data(), m_text.size() - 1);
+			message.clear();
+			try
+			{
+				context.parse_record(truncated, index, index[0]);
+			}
+			catch (const SimpleException& ex)
+			{
+				message = ex.what();
+			}
+			Assert::IsTrue(message == "The input does not match the index");
+		}
+		TEST_METHOD(RecordIndexByKey1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			attach_sum(context);
+			RecordIndexBuilder builder;
+			context.attach_index(L"Dict", builder, indexed_key);
+
+			const long count = 300000;
+			make_records(count);
+			MemoryInput input(m_text.data(), m_text.size());
+			context.parse(input, 4);
+			TempFile file("RecordIndexByKey1.idx");
+			builder.write(file.path(), context.get_input_size());
+
+			RecordIndex index(file.path());
+			Assert::IsTrue(index.keyed());
+			Assert::AreEqual((size_t)count, index.size());
+			const long records[] = { 0, 12345, count - 1 };
+			for (long i : records)
+			{
+				std::string record = make_record(i);
+				auto range = index.find(RecordIndex::hash_key(record.data(), record.data() + record.size()));
+				Assert::AreEqual((ptrdiff_t)1, range.second - range.first);
+				Assert::AreEqual(3 * i, context.parse_record(input, index, *range.first));
+			}
+		}
+	};
+}
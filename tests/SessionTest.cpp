@@ -0,0 +1,94 @@
+#include "CppUnitTest.h"
+
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long session_root;
+	static long session_text_length;
+
+	static long session_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	static long session_object(const SymbolContext<char, long>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : 0;
+	}
+
+	static long session_list(const SymbolContext<char, long>& ctx)
+	{
+		long sum = 0;
+		for (int i = 1; i <= ctx.count(); i++)
+			sum += ctx.value(i);
+		if (ctx.end() - ctx.start() == session_text_length)
+			session_root = sum;
+		return sum;
+	}
+
+	TEST_CLASS(SessionTest)
+	{
+	public:
+		TEST_METHOD(SessionReuse1)
+		{
+			Context<char, long> context("../../grammars/json.cgr");
+			context.attach(L"Number", session_number);
+			context.attach(L"Object", session_object);
+			context.attach(L"List", session_list);
+			Session<char, long> session(context, 2);
+
+			//Inputs of different sizes, one of them rejected, through the
+			//same runners and window
+			const long counts[] = { 1500000, 10, -1, 600000, 1 };
+			for (long count : counts)
+			{
+				std::string text = "[";
+				long sum = 0;
+				for (long i = 0; i < (count < 0 ? 100000 : count); i++)
+				{
+					text += (i == 0 ? "" : ", ") + std::to_string(i);
+					sum += i;
+				}
+				//The rejected input lacks its closing bracket
+				if (count >= 0)
+					text += "]";
+				MemoryInput input(text.data(), text.size());
+				session_text_length = static_cast<long>(text.size());
+
+				session_root = -1;
+				bool thrown = false;
+				try
+				{
+					session.parse(input, true);
+				}
+				catch (const SimpleException& ex)
+				{
+					thrown = std::string(ex.what()) == "Input rejected by the parser";
+				}
+				Assert::AreEqual(count < 0, thrown);
+				Assert::AreEqual(count >= 0, session.accepted());
+				if (count >= 0)
+				{
+					Assert::AreEqual(sum, session_root);
+					Assert::AreEqual(text.size(), session.get_input_size());
+				}
+			}
+
+			//Small inputs go inline unless the pipeline is forced
+			std::string text = "[1, 2, 3]";
+			MemoryInput input(text.data(), text.size());
+			session_text_length = static_cast<long>(text.size());
+			session_root = -1;
+			session.parse(input);
+			Assert::AreEqual(6L, session_root);
+		}
+	};
+}
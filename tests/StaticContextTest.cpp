@@ -0,0 +1,95 @@
+#include "CppUnitTest.h"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include "Context.hpp"
+//Written by "centaurus generate-ids -g grammars/calc.cgr"
+#include "calc_ids.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	struct CalcVisitor
+	{
+		typedef CALC grammar_type;
+		typedef long value_type;
+		long result = 0;
+		int reductions = 0;
+		long INPUT(const SymbolContext<char, long>& ctx)
+		{
+			reductions++;
+			result = ctx.value(1);
+			return result;
+		}
+		long EXPR(const SymbolContext<char, long>& ctx)
+		{
+			reductions++;
+			return (ctx.count() == 1) ? ctx.value(1) : ctx.value(1) + ctx.value(2);
+		}
+		long TERM(const SymbolContext<char, long>& ctx)
+		{
+			reductions++;
+			return (ctx.count() == 1) ? ctx.value(1) : ctx.value(1) * ctx.value(2);
+		}
+		long FACT(const SymbolContext<char, long>& ctx)
+		{
+			reductions++;
+			if (ctx.count() == 1)
+				return ctx.value(1);
+			int64_t value;
+			Assert::IsTrue(ctx.to_int(value));
+			return static_cast<long>(value);
+		}
+	};
+
+	TEST_CLASS(StaticContextTest)
+	{
+	public:
+		TEST_METHOD(StaticGeneratedIds1)
+		{
+			//The header in the tree is what the generator writes for the grammar
+			Grammar<char> grammar;
+			grammar.parse("../../grammars/calc.cgr");
+			std::wostringstream os;
+			grammar.print_ids(os, L"");
+			std::wstring generated = os.str();
+
+			std::ifstream file("../../tests/calc_ids.hpp");
+			std::string header((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			Assert::IsTrue(std::string(generated.begin(), generated.end()) == header);
+			Assert::AreEqual(static_cast<unsigned long long>(grammar.get_hash()), CALC::GRAMMAR_HASH);
+			Assert::AreEqual(grammar.get_machine_id(L"EXPR"), static_cast<int>(CALC::EXPR));
+		}
+		TEST_METHOD(StaticDispatch1)
+		{
+			CalcVisitor visitor;
+			StaticContext<char, CalcVisitor> context("../../grammars/calc.cgr", visitor);
+
+			const char text[] = "2*(3+4)+5*6=";
+			MemoryInput input(text, sizeof(text) - 1);
+			context.parse(input, 2);
+			Assert::AreEqual(44L, visitor.result);
+			//Every symbol is reduced by the member named after it
+			Assert::AreEqual(17, visitor.reductions);
+		}
+		TEST_METHOD(StaticHashMismatch1)
+		{
+			CalcVisitor visitor;
+			std::string message;
+			try
+			{
+				StaticContext<char, CalcVisitor> context("../../grammars/json.cgr", visitor);
+			}
+			catch (const SimpleException& ex)
+			{
+				message = ex.what();
+			}
+			Assert::IsTrue(message == "The ids of the visitor were generated from another grammar");
+		}
+	};
+}
@@ -0,0 +1,59 @@
+#include "CppUnitTest.h"
+
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static long stream_number(const SymbolContext<char, long>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		return static_cast<long>(value);
+	}
+
+	TEST_CLASS(StreamTest)
+	{
+	public:
+		TEST_METHOD(StreamRecords1)
+		{
+			Context<char, long> context("../../grammars/items.cgr");
+			context.attach(L"Item", stream_number);
+
+			//Enough records for several banks, far more than the stream holds
+			const long count = 1000000;
+			std::string text;
+			for (long i = 0; i < count; i++)
+				text += std::to_string(i) + " ";
+			MemoryInput input(text.data(), text.size());
+
+			for (int round = 0; round < 2; round++)
+			{
+				//Dropped after a few records, which cancels the parse
+				{
+					auto stream = context.stream(input, L"Item", 4, 64);
+					long expected = 0;
+					for (long record : *stream)
+					{
+						Assert::AreEqual(expected++, record);
+						if (expected == 1000)
+							break;
+					}
+				}
+				Assert::IsTrue(context.cancelled());
+
+				//Records arrive in input order
+				auto stream = context.stream(input, L"Item", 4);
+				long expected = 0;
+				for (long record : *stream)
+					Assert::AreEqual(expected++, record);
+				Assert::AreEqual(count, expected);
+				Assert::IsFalse(context.cancelled());
+			}
+		}
+	};
+}
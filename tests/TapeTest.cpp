@@ -0,0 +1,72 @@
+#include "CppUnitTest.h"
+
+#include "Tape.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	static uint64_t start_marker(int id, uint64_t offset)
+	{
+		return ((uint64_t)1 << 63) | ((uint64_t)id << 48) | offset;
+	}
+
+	static uint64_t end_marker(int id, uint64_t offset)
+	{
+		return ((uint64_t)id << 48) | offset;
+	}
+
+	TEST_CLASS(TapeTest)
+	{
+	public:
+		TEST_METHOD(TapeStitch1)
+		{
+			//"(a(bc)d)" split between two banks in the middle of the inner list
+			const char text[] = "(a(bc)d)";
+			const uint64_t bank1[] = {
+				start_marker(1, 0),
+				start_marker(2, 1), end_marker(2, 2),
+				start_marker(1, 2),
+				start_marker(2, 3), end_marker(2, 4),
+				0
+			};
+			const uint64_t bank2[] = {
+				start_marker(2, 4), end_marker(2, 5),
+				end_marker(1, 6),
+				start_marker(2, 6), end_marker(2, 7),
+				end_marker(1, 8),
+				0
+			};
+			TapeSegment segment1, segment2;
+			segment1.build(bank1, sizeof(bank1) / sizeof(bank1[0]));
+			segment2.build(bank2, sizeof(bank2) / sizeof(bank2[0]));
+
+			TapeBuilder builder;
+			builder.reset(text);
+			builder.append(segment1);
+			builder.append(segment2);
+			Tape tape = builder.finish();
+
+			Assert::AreEqual((size_t)6, tape.size());
+
+			TapeCursor root = tape.root();
+			Assert::IsTrue(root.valid());
+			Assert::AreEqual((size_t)6, root.subtree_size());
+			Assert::AreEqual((uint64_t)8, root.end());
+
+			TapeCursor child = root.first_child();
+			Assert::AreEqual(2, child.id());
+			Assert::IsTrue(child.view<char>() == "a");
+			child.next();
+			Assert::AreEqual(1, child.id());
+			Assert::IsTrue(child.view<char>() == "(bc)");
+			Assert::AreEqual((size_t)3, child.subtree_size());
+			//Skips the subtree of the inner list
+			child.next();
+			Assert::IsTrue(child.view<char>() == "d");
+			child.next();
+			Assert::IsFalse(child.valid());
+		}
+	};
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/*!
+ * @brief Path of a file a test writes, removed when it goes out of scope
+ *
+ * A failed assertion exits the process without unwinding the stack, so the
+ * files still in use are removed at exit as well.
+ */
+class TempFile
+{
+    std::string m_path;
+
+    static std::vector<std::string>& pending()
+    {
+        static std::vector<std::string> paths;
+        return paths;
+    }
+    static void remove_pending()
+    {
+        for (const auto& path : pending())
+            std::remove(path.c_str());
+    }
+public:
+    explicit TempFile(const char *path)
+        : m_path(path)
+    {
+        //The list is constructed first, so it outlives the handler
+        pending();
+        static bool registered = std::atexit(remove_pending) == 0;
+        (void)registered;
+        pending().push_back(m_path);
+        std::remove(m_path.c_str());
+    }
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+    ~TempFile()
+    {
+        std::remove(m_path.c_str());
+        auto& paths = pending();
+        paths.erase(std::find(paths.begin(), paths.end(), m_path));
+    }
+    const char *path() const
+    {
+        return m_path.c_str();
+    }
+};
@@ -0,0 +1,113 @@
+#include "CppUnitTest.h"
+
+#include <string>
+
+#include "Context.hpp"
+
+using namespace Centaurus;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTest1
+{
+	//16 bytes, the largest value kept inline in the reduction stacks
+	struct SumCount
+	{
+		int64_t sum;
+		int64_t count;
+	};
+
+	static SumCount typed_root;
+	static long typed_text_length;
+	static long typed_mismatches;
+
+	static SumCount typed_number(const SymbolContext<char, SumCount>& ctx)
+	{
+		int64_t value;
+		Assert::IsTrue(ctx.to_int(value));
+		//The count of a number tells it apart from a list of one number
+		return SumCount{ value, -1 };
+	}
+
+	static SumCount typed_object(const SymbolContext<char, SumCount>& ctx)
+	{
+		return ctx.count() == 1 ? ctx.value(1) : SumCount{ 0, 0 };
+	}
+
+	static SumCount typed_list(const SymbolContext<char, SumCount>& ctx)
+	{
+		SumCount total{ 0, 0 };
+		for (int i = 1; i <= ctx.count(); i++)
+		{
+			SumCount value = ctx.value(i);
+			if (value.count == -1)
+			{
+				total.sum += value.sum;
+				total.count++;
+			}
+			else
+			{
+				//Both halves of a nested list must arrive intact
+				if (value.count == 0 || value.sum != value.count * (value.count - 1) / 2)
+					typed_mismatches++;
+				total.sum += value.sum;
+				total.count += value.count;
+			}
+		}
+		if (ctx.end() - ctx.start() == typed_text_length)
+			typed_root = total;
+		return total;
+	}
+
+	TEST_CLASS(TypedValueTest)
+	{
+	public:
+		TEST_METHOD(TypedValue16Bytes1)
+		{
+			Context<char, SumCount> context("../../grammars/json.cgr");
+			context.attach(L"Number", typed_number);
+			context.attach(L"Object", typed_object);
+			context.attach(L"List", typed_list);
+
+			//Lists of 0..n-1, the longest of which spans several banks, so
+			//Stage3 gets the values Stage2 reduced in the middle of it
+			const long sizes[] = { 1, 5, 1500000, 3, 700000, 2 };
+			std::string text = "[";
+			long total_sum = 0, total_count = 0;
+			for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++)
+			{
+				text += k == 0 ? "[" : ", [";
+				for (long i = 0; i < sizes[k]; i++)
+				{
+					text += (i == 0 ? "" : ", ") + std::to_string(i);
+					total_sum += i;
+				}
+				text += "]";
+				total_count += sizes[k];
+			}
+			text += "]";
+			MemoryInput input(text.data(), text.size());
+			typed_text_length = static_cast<long>(text.size());
+
+			for (int round = 0; round < 2; round++)
+			{
+				typed_root = SumCount{ -1, -1 };
+				typed_mismatches = 0;
+				context.parse(input, 4);
+				Assert::AreEqual(0L, typed_mismatches);
+				Assert::AreEqual(static_cast<int64_t>(total_sum), typed_root.sum);
+				Assert::AreEqual(static_cast<int64_t>(total_count), typed_root.count);
+			}
+
+			//The same values through the inline runner
+			std::string small = "[[0, 1, 2], [0], [0, 1]]";
+			MemoryInput small_input(small.data(), small.size());
+			typed_text_length = static_cast<long>(small.size());
+			typed_root = SumCount{ -1, -1 };
+			typed_mismatches = 0;
+			context.parse(small_input, 4);
+			Assert::AreEqual(0L, typed_mismatches);
+			Assert::AreEqual(static_cast<int64_t>(4), typed_root.sum);
+			Assert::AreEqual(static_cast<int64_t>(6), typed_root.count);
+		}
+	};
+}
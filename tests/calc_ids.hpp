@@ -0,0 +1,79 @@
+#pragma once
+
+//Generated by "centaurus generate-ids". Do not edit.
+
+struct CALC
+{
+    enum : int
+    {
+        INPUT = 1,
+        EXPR = 2,
+        TERM = 3,
+        FACT = 4,
+    };
+    static constexpr int MACHINE_NUM = 4;
+    //Checked against the grammar a StaticContext is built from
+    static constexpr unsigned long long GRAMMAR_HASH = 16298354523835235324ULL;
+    /*!
+     * @brief Calls the member of visitor named after the symbol with the given id
+     *
+     * Returns false if the visitor has no such member.
+     */
+    template<typename Visitor, typename Context, typename Result>
+    static bool reduce(Visitor& visitor, int id, const Context& ctx, Result& result)
+    {
+        switch (id)
+        {
+        case INPUT: return reduce_INPUT(visitor, ctx, result, 0);
+        case EXPR: return reduce_EXPR(visitor, ctx, result, 0);
+        case TERM: return reduce_TERM(visitor, ctx, result, 0);
+        case FACT: return reduce_FACT(visitor, ctx, result, 0);
+        default: return false;
+        }
+    }
+private:
+    template<typename Visitor, typename Context, typename Result>
+    static auto reduce_INPUT(Visitor& visitor, const Context& ctx, Result& result, int) -> decltype(result = visitor.INPUT(ctx), true)
+    {
+        result = visitor.INPUT(ctx);
+        return true;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static bool reduce_INPUT(Visitor&, const Context&, Result&, long)
+    {
+        return false;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static auto reduce_EXPR(Visitor& visitor, const Context& ctx, Result& result, int) -> decltype(result = visitor.EXPR(ctx), true)
+    {
+        result = visitor.EXPR(ctx);
+        return true;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static bool reduce_EXPR(Visitor&, const Context&, Result&, long)
+    {
+        return false;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static auto reduce_TERM(Visitor& visitor, const Context& ctx, Result& result, int) -> decltype(result = visitor.TERM(ctx), true)
+    {
+        result = visitor.TERM(ctx);
+        return true;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static bool reduce_TERM(Visitor&, const Context&, Result&, long)
+    {
+        return false;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static auto reduce_FACT(Visitor& visitor, const Context& ctx, Result& result, int) -> decltype(result = visitor.FACT(ctx), true)
+    {
+        result = visitor.FACT(ctx);
+        return true;
+    }
+    template<typename Visitor, typename Context, typename Result>
+    static bool reduce_FACT(Visitor&, const Context&, Result&, long)
+    {
+        return false;
+    }
+};